@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Vec3.hpp"
+#include "Ray.hpp"
+#include "Real.hpp"
+
+namespace Smurf {
+    // Axis aligned bounding box, default constructed as empty so that expanding it by anything yields that thing
+    struct AABB {
+        AABB() restrict(cpu, amp) : min{RealMax, RealMax, RealMax},
+                                    max{-RealMax, -RealMax, -RealMax} { }
+        AABB(const Vec3<Real>& min, const Vec3<Real>& max) restrict(cpu, amp) : min{min}, max{max} { }
+
+        void expand(const Vec3<Real>& point) restrict(cpu, amp) {
+            min.x = point.x < min.x ? point.x : min.x;
+            min.y = point.y < min.y ? point.y : min.y;
+            min.z = point.z < min.z ? point.z : min.z;
+            max.x = point.x > max.x ? point.x : max.x;
+            max.y = point.y > max.y ? point.y : max.y;
+            max.z = point.z > max.z ? point.z : max.z;
+        }
+
+        void expand(const AABB& other) restrict(cpu, amp) {
+            if (other.isEmpty()) return;
+            expand(other.min);
+            expand(other.max);
+        }
+
+        bool isEmpty() const restrict(cpu, amp) {
+            return min.x > max.x || min.y > max.y || min.z > max.z;
+        }
+
+        Vec3<Real> centroid() const restrict(cpu, amp) {
+            return Real(0.5) * (min + max);
+        }
+
+        Real surfaceArea() const restrict(cpu, amp) {
+            if (isEmpty()) return 0;
+            auto extent = max - min;
+            return 2 * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+        }
+
+        // Slab test, returns the entry distance through tNear
+        bool intersect(const Ray& ray, const Vec3<Real>& inverseDirection, Real tMax, Real& tNear) const restrict(cpu, amp) {
+            auto tx1 = (min.x - ray.origin.x) * inverseDirection.x;
+            auto tx2 = (max.x - ray.origin.x) * inverseDirection.x;
+            auto tEnter = tx1 < tx2 ? tx1 : tx2;
+            auto tExit = tx1 < tx2 ? tx2 : tx1;
+
+            auto ty1 = (min.y - ray.origin.y) * inverseDirection.y;
+            auto ty2 = (max.y - ray.origin.y) * inverseDirection.y;
+            tEnter = (ty1 < ty2 ? ty1 : ty2) > tEnter ? (ty1 < ty2 ? ty1 : ty2) : tEnter;
+            tExit = (ty1 < ty2 ? ty2 : ty1) < tExit ? (ty1 < ty2 ? ty2 : ty1) : tExit;
+
+            auto tz1 = (min.z - ray.origin.z) * inverseDirection.z;
+            auto tz2 = (max.z - ray.origin.z) * inverseDirection.z;
+            tEnter = (tz1 < tz2 ? tz1 : tz2) > tEnter ? (tz1 < tz2 ? tz1 : tz2) : tEnter;
+            tExit = (tz1 < tz2 ? tz2 : tz1) < tExit ? (tz1 < tz2 ? tz2 : tz1) : tExit;
+
+            tNear = tEnter;
+            return tExit >= tEnter && tExit > 0 && tEnter < tMax;
+        }
+
+        static Real axis(const Vec3<Real>& vec, int axis) restrict(cpu, amp) {
+            return axis == 0 ? vec.x : (axis == 1 ? vec.y : vec.z);
+        }
+
+        Vec3<Real> min;
+        Vec3<Real> max;
+    };
+} // namespace Smurf
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Backend.hpp"
+#include "Color.hpp"
+#include "Vec2.hpp"
+#include "Vec3.hpp"
+#include "Random.hpp"
+#include "SamplePatterns.hpp"
+
+namespace Smurf {
+    // Per-render sampling parameters, plain data so that kernels can capture it by value
+    struct SamplingPolicy {
+        int numSamples;
+        int numSampleGroups;
+        bool adaptive;
+        int initialSamples;
+        int maxSamples;
+        float errorThreshold;
+        unsigned seed;
+        SamplePattern pattern;
+        int lightSamples; // Point lights per shading point, 0 - every one
+    };
+
+    // Running estimate of a single pixel - the mean color, plus Welford's running variance of the luminance which
+    // decides when the pixel has had enough samples
+    struct PixelEstimate {
+        PixelEstimate() restrict(cpu, amp) : count{0}, mean{0.0F}, m2{0.0F} { }
+
+        void add(const Color& sample) restrict(cpu, amp) {
+            sum += sample;
+            ++count;
+            const float luminance = sample.luminance();
+            const float delta = luminance - mean;
+            mean += delta / count;
+            m2 += delta * (luminance - mean);
+        }
+
+        // Without adaptive sampling every pixel gets exactly numSamples, with it a pixel is done once the standard
+        // error of its mean luminance is below the threshold, compared squared to stay clear of a sqrt per sample
+        bool isConverged(const SamplingPolicy& policy) const restrict(cpu, amp) {
+            if (!policy.adaptive) return count >= policy.numSamples;
+            if (count < policy.initialSamples) return false;
+            if (count >= policy.maxSamples) return true;
+            return m2 <= policy.errorThreshold * policy.errorThreshold * (count - 1) * count;
+        }
+
+        Color average() const restrict(cpu, amp) {
+            return sum * (1.0F / count);
+        }
+
+        Color sum;
+        int count;
+        float mean;
+        float m2;
+    };
+
+    // Sample sampleIdx of a pixel whose sample-groups start at group - past numSamples it carries on into the
+    // following groups, so that every batch of numSamples stays stratified
+    template <typename Samples, typename Indices>
+    auto pickSample(const Samples& samples, const Indices& indices, const SamplingPolicy& policy, int group, int sampleIdx) restrict(cpu, amp) -> decltype(samples[0]) {
+        const int offset = ((group + sampleIdx / policy.numSamples) % policy.numSampleGroups) * policy.numSamples;
+        return samples[offset + indices[offset + sampleIdx % policy.numSamples]];
+    }
+
+    // Where the samples of one pixel come from, reproducible from the seed and the pixel alone - the jittered pattern
+    // starts at a random sample-group of the tables, the others are scrambled per pixel and generated on the fly
+    // Lens and ambient occlusion samples always come out of the sampler's premapped tables, each starting at a
+    // sample-group of its own so that they don't line up with the pixel samples
+    struct PixelSampler {
+        PixelSampler() restrict(cpu, amp) : scramble{0}, firstGroup{0}, lensGroup{0}, occlusionGroup{0} { }
+        PixelSampler(const SamplingPolicy& policy, int pixelIdx) restrict(cpu, amp)
+            : scramble{Random::CounterRng(policy.seed, static_cast<unsigned>(pixelIdx)).nextUInt()},
+              firstGroup{static_cast<int>(scramble % static_cast<unsigned>(policy.numSampleGroups))},
+              lensGroup{static_cast<int>(Random::pcgHash(scramble) % static_cast<unsigned>(policy.numSampleGroups))},
+              occlusionGroup{static_cast<int>(Random::pcgHash(~scramble) % static_cast<unsigned>(policy.numSampleGroups))} { }
+
+        template <typename Samples, typename Indices>
+        Vec2<double> sample(const Samples& samples, const Indices& indices, const SamplingPolicy& policy, int sampleIdx) const restrict(cpu, amp) {
+            if (policy.pattern == SamplePattern::Jittered) return pickSample(samples, indices, policy, firstGroup, sampleIdx);
+            return SamplePatterns::generate(policy.pattern, static_cast<unsigned>(sampleIdx), static_cast<unsigned>(policy.numSamples), scramble);
+        }
+
+        // On the unit disc
+        template <typename DiscSamples, typename Indices>
+        Vec2<double> lensSample(const DiscSamples& discSamples, const Indices& indices, const SamplingPolicy& policy, int sampleIdx) const restrict(cpu, amp) {
+            return pickSample(discSamples, indices, policy, lensGroup, sampleIdx);
+        }
+
+        // Around +z, the rayIdx-th of numRays occlusion rays cast for the pixel's sampleIdx-th sample
+        template <typename HemisphereSamples, typename Indices>
+        Vec3<double> occlusionSample(const HemisphereSamples& hemisphereSamples, const Indices& indices, const SamplingPolicy& policy,
+                                     int sampleIdx, int rayIdx, int numRays) const restrict(cpu, amp) {
+            return pickSample(hemisphereSamples, indices, policy, occlusionGroup, sampleIdx * numRays + rayIdx);
+        }
+
+        unsigned scramble;
+        int firstGroup;
+        int lensGroup;
+        int occlusionGroup;
+    };
+
+    // Which sample of which pixel a shading point belongs to, for picking its ambient occlusion rays and lights
+    struct ShadingSampling {
+        SamplingPolicy policy;
+        PixelSampler pixelSampler;
+        int sampleIdx;
+        int depth; // Surfaces the path hit before this one, 0 where the camera ray lands
+    };
+} // namespace Smurf
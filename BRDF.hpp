@@ -1,20 +1,15 @@
 #pragma once
 
+#include "Backend.hpp"
 #include "Color.hpp"
 #include "GeometricObject.hpp"
 #include "Vec3.hpp"
+#include "Real.hpp"
 
 namespace Smurf {
 
     struct Lambertian {
         Lambertian() restrict(cpu, amp) : intensity{1.0F}, color{1.0F, 1.0F, 1.0F} { }
-        Lambertian(const Lambertian& other) restrict(cpu, amp) : intensity{other.intensity}, color{other.color} { }
-        Lambertian& operator=(const Lambertian& other) restrict(cpu, amp) {
-            if (this == &other) return *this;
-            intensity = other.intensity;
-            color = other.color;
-            return *this;
-        }
         Lambertian(float intensity, const Color& color) restrict(cpu, amp) : intensity{intensity}, color{color} { }
 
         Color diffuseF() const restrict(cpu, amp) {
@@ -31,24 +26,16 @@ namespace Smurf {
 
     struct Specular {
         Specular() restrict(cpu, amp) : intensity{1.0F}, color{1.0F, 1.0F, 1.0F}, exponent{1} { }
-        Specular(const Specular& other) restrict(cpu, amp) : intensity{other.intensity}, color{other.color}, exponent{other.exponent} { }
-        Specular& operator=(const Specular& other) restrict(cpu, amp) {
-            if (this == &other) return *this;
-            intensity = other.intensity;
-            color = other.color;
-            exponent = other.exponent;
-            return *this;
-        }
         Specular(float intensity, const Color& color, float exponent) restrict(cpu, amp) : intensity{intensity}, color{color}, exponent{exponent} { }
 
-        Color diffuseF(const Vec3<double>& normal, const Vec3<double>& origin, const Vec3<double>& direction) const restrict(amp) {
+        Color diffuseF(const Vec3<Real>& normal, const Vec3<Real>& origin, const Vec3<Real>& direction) const restrict(amp) {
             Color result;
             float normalDotDirection = static_cast<float>(normal * direction);
-            Vec3<double> reflectedDirection{-direction + 2.0 * normal * normalDotDirection};
+            Vec3<Real> reflectedDirection{-direction + 2.0 * normal * normalDotDirection};
             float reflectedDirectionDotOrigin = static_cast<float>(reflectedDirection * origin);
 
             if (reflectedDirectionDotOrigin > 0.0) {
-                result = intensity * color * Concurrency::fast_math::powf(reflectedDirectionDotOrigin, exponent);
+                result = intensity * color * Backend::fast_math::powf(reflectedDirectionDotOrigin, exponent);
             }
 
             return result;
@@ -63,4 +50,27 @@ namespace Smurf {
         float exponent;
     };
 
+    // Mirror reflection - whatever the mirrored ray sees, scaled by intensity * color
+    struct PerfectSpecular {
+        PerfectSpecular() restrict(cpu, amp) : intensity{0.0F}, color{1.0F, 1.0F, 1.0F} { }
+        PerfectSpecular(float intensity, const Color& color) restrict(cpu, amp) : intensity{intensity}, color{color} { }
+
+        Color rho() const restrict(cpu, amp) {
+            return intensity * color;
+        }
+
+        float intensity;
+        Color color;
+    };
+
+    // Refraction through a dielectric - whatever the bent ray sees, scaled by intensity
+    // ior is the index of refraction inside over outside, the side the normal points to
+    struct PerfectTransmitter {
+        PerfectTransmitter() restrict(cpu, amp) : intensity{0.0F}, ior{1.0F} { }
+        PerfectTransmitter(float intensity, float ior) restrict(cpu, amp) : intensity{intensity}, ior{ior} { }
+
+        float intensity;
+        float ior;
+    };
+
 } // namespace Smurf
\ No newline at end of file
@@ -0,0 +1,312 @@
+#pragma once
+
+#include "AABB.hpp"
+#include "Ray.hpp"
+#include "Vec3.hpp"
+#include "Real.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace Smurf {
+    // Flattened node - siblings are stored next to each other, so an inner node only needs the index of its left child
+    struct BVHNode {
+        BVHNode() restrict(cpu, amp) : leftOrFirst{0}, primitiveCount{0} { }
+
+        bool isLeaf() const restrict(cpu, amp) {
+            return primitiveCount > 0;
+        }
+
+        // Root of a tree over no primitives at all - it has no children, while those of any other inner node come after
+        // it and so never start at 0. Its bounds are inverted, which the slab test takes for an infinite box rather than
+        // an empty one, so traversal has to check for it up front.
+        bool isEmptyRoot() const restrict(cpu, amp) {
+            return primitiveCount == 0 && leftOrFirst == 0;
+        }
+
+        AABB bounds;
+        int leftOrFirst; // Inner node: index of the left child, leaf: first slot in the primitive index list
+        int primitiveCount; // 0 for inner nodes
+    };
+
+    // Bounding volume hierarchy over anything that can be boxed, built with the binned surface area heuristic
+    // The tree only stores indices into the caller's primitive list, it doesn't care what the primitives are
+    class BVH {
+    public:
+        static const int NumBins = 12;
+        static const int MaxLeafPrimitives = 4;
+        static const int MaxDepth = 48;
+        static const int StackSize = 64;
+        static const int TraversalCost = 1; // Relative to a single primitive test
+
+        void build(const std::vector<AABB>& primitiveBounds) {
+            nodes.clear();
+            primitiveIndices.resize(primitiveBounds.size());
+            std::iota(std::begin(primitiveIndices), std::end(primitiveIndices), 0);
+
+            std::vector<Vec3<Real>> centroids;
+            centroids.reserve(primitiveBounds.size());
+            for (auto&& bounds : primitiveBounds) {
+                centroids.push_back(bounds.centroid());
+            }
+
+            // The root always exists, an empty one is left childless - see BVHNode::isEmptyRoot
+            nodes.reserve(primitiveBounds.empty() ? 1 : 2 * primitiveBounds.size() - 1);
+            nodes.emplace_back();
+            nodes[0].leftOrFirst = 0;
+            nodes[0].primitiveCount = static_cast<int>(primitiveBounds.size());
+            if (primitiveBounds.empty()) return;
+
+            subdivide(0, 0, primitiveBounds, centroids);
+            linkNodes();
+        }
+
+        // Fits the leaves of the given primitives and everything above them around where the primitives are now
+        // The tree keeps the shape it was built with, which stays good for primitives that move a little and gets
+        // worse the further they go. Returns the range of nodes that changed, empty if first > last.
+        template <typename BoundsOf>
+        std::pair<int, int> refit(const std::vector<int>& primitives, const BoundsOf& boundsOf) {
+            std::vector<int> touched;
+            for (const int primitive : primitives) {
+                for (int nodeIdx = leaves[primitive]; nodeIdx >= 0; nodeIdx = parents[nodeIdx]) {
+                    touched.push_back(nodeIdx);
+                }
+            }
+            if (touched.empty()) return {0, -1};
+
+            // Children always come after their parent, so going backwards every node sees its children done
+            std::sort(std::begin(touched), std::end(touched), std::greater<int>());
+            touched.erase(std::unique(std::begin(touched), std::end(touched)), std::end(touched));
+            for (const int nodeIdx : touched) {
+                auto& node = nodes[nodeIdx];
+                AABB bounds;
+                if (node.isLeaf()) {
+                    for (int i = node.leftOrFirst; i < node.leftOrFirst + node.primitiveCount; ++i) {
+                        bounds.expand(boundsOf(primitiveIndices[i]));
+                    }
+                } else {
+                    bounds.expand(nodes[node.leftOrFirst].bounds);
+                    bounds.expand(nodes[node.leftOrFirst + 1].bounds);
+                }
+                node.bounds = bounds;
+            }
+            return {touched.back(), touched.front()};
+        }
+
+        const std::vector<BVHNode>& getNodes() const {
+            return nodes;
+        }
+
+        const std::vector<int>& getPrimitiveIndices() const {
+            return primitiveIndices;
+        }
+
+        bool isEmpty() const {
+            return primitiveIndices.empty();
+        }
+
+        // Takes over a tree built earlier over the same primitives instead of building it again
+        void restore(std::vector<BVHNode> savedNodes, std::vector<int> savedPrimitiveIndices) {
+            nodes = std::move(savedNodes);
+            primitiveIndices = std::move(savedPrimitiveIndices);
+            linkNodes();
+        }
+
+    private:
+        struct Bin {
+            Bin() : count{0} { }
+            AABB bounds;
+            int count;
+        };
+
+        int binIndex(const Vec3<Real>& centroid, const AABB& centroidBounds, int axis) const {
+            auto extent = AABB::axis(centroidBounds.max, axis) - AABB::axis(centroidBounds.min, axis);
+            auto idx = static_cast<int>(NumBins * (AABB::axis(centroid, axis) - AABB::axis(centroidBounds.min, axis)) / extent);
+            return std::min(std::max(idx, 0), NumBins - 1);
+        }
+
+        void subdivide(int nodeIdx, int depth, const std::vector<AABB>& primitiveBounds, const std::vector<Vec3<Real>>& centroids) {
+            const int first = nodes[nodeIdx].leftOrFirst;
+            const int count = nodes[nodeIdx].primitiveCount;
+
+            AABB bounds;
+            AABB centroidBounds;
+            for (int i = first; i < first + count; ++i) {
+                bounds.expand(primitiveBounds[primitiveIndices[i]]);
+                centroidBounds.expand(centroids[primitiveIndices[i]]);
+            }
+            nodes[nodeIdx].bounds = bounds;
+
+            if (count == 1 || depth >= MaxDepth) return;
+
+            // Evaluate every bin boundary on every axis, cost is relative to the parent's surface area
+            int bestAxis = -1;
+            int bestSplit = 0;
+            double bestCost = std::numeric_limits<double>::max();
+            for (int axis = 0; axis < 3; ++axis) {
+                if (AABB::axis(centroidBounds.max, axis) <= AABB::axis(centroidBounds.min, axis)) continue;
+
+                Bin bins[NumBins];
+                for (int i = first; i < first + count; ++i) {
+                    auto& bin = bins[binIndex(centroids[primitiveIndices[i]], centroidBounds, axis)];
+                    bin.bounds.expand(primitiveBounds[primitiveIndices[i]]);
+                    ++bin.count;
+                }
+
+                double rightArea[NumBins - 1];
+                int rightCount[NumBins - 1];
+                AABB rightBounds;
+                int rightSum = 0;
+                for (int split = NumBins - 1; split > 0; --split) {
+                    rightBounds.expand(bins[split].bounds);
+                    rightSum += bins[split].count;
+                    rightArea[split - 1] = rightBounds.surfaceArea();
+                    rightCount[split - 1] = rightSum;
+                }
+
+                AABB leftBounds;
+                int leftSum = 0;
+                for (int split = 0; split < NumBins - 1; ++split) {
+                    leftBounds.expand(bins[split].bounds);
+                    leftSum += bins[split].count;
+                    if (leftSum == 0 || rightCount[split] == 0) continue;
+                    auto cost = leftSum * leftBounds.surfaceArea() + rightCount[split] * rightArea[split];
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = split;
+                    }
+                }
+            }
+
+            // All centroids coincide, nothing to split on
+            if (bestAxis == -1) return;
+
+            const double leafCost = count * bounds.surfaceArea();
+            if (bestCost + TraversalCost * bounds.surfaceArea() >= leafCost && count <= MaxLeafPrimitives) return;
+
+            auto middle = std::partition(std::begin(primitiveIndices) + first, std::begin(primitiveIndices) + first + count,
+                                         [&](int primitiveIdx) {
+                                             return binIndex(centroids[primitiveIdx], centroidBounds, bestAxis) <= bestSplit;
+                                         });
+            const int leftCount = static_cast<int>(middle - (std::begin(primitiveIndices) + first));
+            if (leftCount == 0 || leftCount == count) return;
+
+            const int leftChild = static_cast<int>(nodes.size());
+            nodes.emplace_back();
+            nodes.emplace_back();
+            nodes[leftChild].leftOrFirst = first;
+            nodes[leftChild].primitiveCount = leftCount;
+            nodes[leftChild + 1].leftOrFirst = first + leftCount;
+            nodes[leftChild + 1].primitiveCount = count - leftCount;
+            nodes[nodeIdx].leftOrFirst = leftChild;
+            nodes[nodeIdx].primitiveCount = 0;
+
+            subdivide(leftChild, depth + 1, primitiveBounds, centroids);
+            subdivide(leftChild + 1, depth + 1, primitiveBounds, centroids);
+        }
+
+        // Parent of every node and the leaf holding every primitive, the way up that refit takes
+        // A restored tree is only checked after this, so whatever points outside of it is skipped here
+        void linkNodes() {
+            const int numNodes = static_cast<int>(nodes.size());
+            const int numPrimitives = static_cast<int>(primitiveIndices.size());
+            parents.assign(numNodes, -1);
+            leaves.assign(numPrimitives, 0);
+            if (numPrimitives == 0) return;
+            for (int nodeIdx = 0; nodeIdx < numNodes; ++nodeIdx) {
+                const auto& node = nodes[nodeIdx];
+                if (node.isLeaf()) {
+                    for (int i = std::max(node.leftOrFirst, 0); i < std::min(node.leftOrFirst + node.primitiveCount, numPrimitives); ++i) {
+                        if (primitiveIndices[i] >= 0 && primitiveIndices[i] < numPrimitives) leaves[primitiveIndices[i]] = nodeIdx;
+                    }
+                } else if (node.leftOrFirst > nodeIdx && node.leftOrFirst + 1 < numNodes) {
+                    parents[node.leftOrFirst] = nodeIdx;
+                    parents[node.leftOrFirst + 1] = nodeIdx;
+                }
+            }
+        }
+
+    private:
+        std::vector<BVHNode> nodes;
+        std::vector<int> primitiveIndices;
+        std::vector<int> parents;
+        std::vector<int> leaves;
+    };
+
+    // Stackful front-to-back walk over the leaves a ray passes through
+    // Kept as an explicit iterator rather than a visitor, AMP is picky about lambdas and containers inside kernels:
+    //     BVHTraversal traversal(ray);
+    //     while (traversal.nextLeaf(nodes, ray, tMax, first, count)) { ... test primitives, shrink tMax ... }
+    struct BVHTraversal {
+        explicit BVHTraversal(const Ray& ray) restrict(cpu, amp) : stackSize{0} {
+            inverseDirection.x = 1 / ray.direction.x;
+            inverseDirection.y = 1 / ray.direction.y;
+            inverseDirection.z = 1 / ray.direction.z;
+            nodeStack[0] = 0;
+            nearStack[0] = 0;
+            stackSize = 1;
+            rootPending = true;
+        }
+
+        template <typename Nodes>
+        bool nextLeaf(const Nodes& nodes, const Ray& ray, Real tMax, int& first, int& count) restrict(cpu, amp) {
+            Real tNear;
+            if (rootPending) {
+                rootPending = false;
+                if (nodes[0].isEmptyRoot() || !nodes[0].bounds.intersect(ray, inverseDirection, tMax, tNear)) {
+                    stackSize = 0;
+                }
+            }
+
+            while (stackSize > 0) {
+                --stackSize;
+                // Something closer has been found since this node was pushed
+                if (nearStack[stackSize] >= tMax) continue;
+
+                const auto& node = nodes[nodeStack[stackSize]];
+                if (node.isLeaf()) {
+                    first = node.leftOrFirst;
+                    count = node.primitiveCount;
+                    return true;
+                }
+
+                Real tLeft;
+                Real tRight;
+                const int left = node.leftOrFirst;
+                bool hitLeft = nodes[left].bounds.intersect(ray, inverseDirection, tMax, tLeft);
+                bool hitRight = nodes[left + 1].bounds.intersect(ray, inverseDirection, tMax, tRight);
+
+                // Push the farther child first so that the nearer one is visited first
+                if (hitLeft && hitRight) {
+                    bool leftFirst = tLeft <= tRight;
+                    push(leftFirst ? left + 1 : left, leftFirst ? tRight : tLeft);
+                    push(leftFirst ? left : left + 1, leftFirst ? tLeft : tRight);
+                } else if (hitLeft) {
+                    push(left, tLeft);
+                } else if (hitRight) {
+                    push(left + 1, tRight);
+                }
+            }
+
+            return false;
+        }
+
+    private:
+        void push(int nodeIdx, Real tNear) restrict(cpu, amp) {
+            nodeStack[stackSize] = nodeIdx;
+            nearStack[stackSize] = tNear;
+            ++stackSize;
+        }
+
+        Vec3<Real> inverseDirection;
+        int nodeStack[BVH::StackSize];
+        Real nearStack[BVH::StackSize];
+        int stackSize;
+        bool rootPending;
+    };
+} // namespace Smurf
@@ -0,0 +1,188 @@
+#pragma once
+
+// Data-parallel backend
+// With USE_AMP the kernels go through C++ AMP as they always have, without it they run on the CPU through a
+// minimal stand-in for the handful of AMP facilities the renderer uses, executed on the shared thread pool.
+// Kernel code only ever spells Backend::array, Backend::parallel_for_each etc. and compiles against either.
+
+#ifdef USE_AMP
+
+#include <amp.h>
+#include <amp_math.h>
+#undef max
+#undef min
+
+namespace Smurf {
+    namespace Backend {
+        using Concurrency::array;
+        using Concurrency::array_view;
+        using Concurrency::extent;
+        using Concurrency::index;
+        using Concurrency::parallel_for_each;
+        namespace fast_math = Concurrency::fast_math;
+
+        // Overwrites count elements of dest from offset on, the rest of it stays as it is
+        template <typename InputIterator, typename T>
+        void copyInto(InputIterator srcBegin, int count, array<T, 1>& dest, int offset) {
+            Concurrency::copy(srcBegin, srcBegin + count, dest.section(index<1>(offset), extent<1>(count)));
+        }
+
+        inline const char* name() {
+            return "C++ AMP";
+        }
+    } // namespace Backend
+} // namespace Smurf
+
+#else
+
+// restrict(cpu, amp) is an AMP language extension, on the CPU backend every function is just a CPU function
+#define restrict(...)
+
+#include "ThreadPool.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+namespace Smurf {
+    namespace Backend {
+        template <int Rank>
+        struct index;
+
+        template <>
+        struct index<1> {
+            index() : value{0} { }
+            explicit index(int value) : value{value} { }
+
+            int operator[](int) const {
+                return value;
+            }
+
+            int value;
+        };
+
+        template <int Rank>
+        struct extent;
+
+        template <>
+        struct extent<1> {
+            extent() : value{0} { }
+            explicit extent(int value) : value{value} { }
+
+            int size() const {
+                return value;
+            }
+
+            int operator[](int) const {
+                return value;
+            }
+
+            int value;
+        };
+
+        // Owning linear buffer, "device" memory is host memory
+        template <typename T, int Rank = 1>
+        class array {
+            static_assert(Rank == 1, "Only one-dimensional arrays are supported by the CPU backend.");
+        public:
+            template <typename InputIterator>
+            array(int numElements, InputIterator srcBegin, InputIterator srcEnd) : data(srcBegin, srcEnd) {
+                data.resize(numElements);
+            }
+
+            template <typename InputIterator>
+            array(int numElements, InputIterator srcBegin) : data(srcBegin, srcBegin + numElements) { }
+
+            array(const array&) = delete;
+            array& operator=(const array&) = delete;
+
+            T& operator[](const index<1>& idx) {
+                return data[idx.value];
+            }
+
+            const T& operator[](const index<1>& idx) const {
+                return data[idx.value];
+            }
+
+            T& operator[](int idx) {
+                return data[idx];
+            }
+
+            const T& operator[](int idx) const {
+                return data[idx];
+            }
+
+            Backend::extent<1> get_extent() const {
+                return Backend::extent<1>(static_cast<int>(data.size()));
+            }
+
+        private:
+            std::vector<T> data;
+        };
+
+        // Non-owning view over host memory, writes land in the viewed container straight away
+        template <typename T, int Rank = 1>
+        class array_view {
+            static_assert(Rank == 1, "Only one-dimensional array views are supported by the CPU backend.");
+        public:
+            template <typename Container>
+            array_view(int numElements, Container& container) : extent(numElements), data(container.data()) { }
+
+            T& operator[](const index<1>& idx) const {
+                return data[idx.value];
+            }
+
+            T& operator[](int idx) const {
+                return data[idx];
+            }
+
+            void synchronize() const { }
+
+            Backend::extent<1> extent;
+
+        private:
+            T* data;
+        };
+
+        // Overwrites count elements of dest from offset on, the rest of it stays as it is
+        template <typename InputIterator, typename T>
+        void copyInto(InputIterator srcBegin, int count, array<T, 1>& dest, int offset) {
+            for (int i = 0; i < count; ++i, ++srcBegin) {
+                dest[offset + i] = *srcBegin;
+            }
+        }
+
+        // Launches kernel(idx) for every index in the extent, in chunks spread over the shared thread pool
+        template <typename Kernel>
+        void parallel_for_each(const extent<1>& computeDomain, const Kernel& kernel) {
+            const int ChunkSize = 256;
+            const int numChunks = (computeDomain.size() + ChunkSize - 1) / ChunkSize;
+            Utils::ThreadPool::instance().parallelFor(numChunks, [&](int chunk) {
+                const int end = std::min((chunk + 1) * ChunkSize, computeDomain.size());
+                for (int i = chunk * ChunkSize; i < end; ++i) {
+                    kernel(index<1>(i));
+                }
+            });
+        }
+
+        namespace fast_math {
+            inline float sqrt(float x) {
+                return std::sqrt(x);
+            }
+
+            inline float sqrtf(float x) {
+                return std::sqrt(x);
+            }
+
+            inline float powf(float x, float y) {
+                return std::pow(x, y);
+            }
+        } // namespace fast_math
+
+        inline const char* name() {
+            return "CPU";
+        }
+    } // namespace Backend
+} // namespace Smurf
+
+#endif
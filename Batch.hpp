@@ -0,0 +1,171 @@
+#pragma once
+
+#include "Scene.hpp"
+#include "Sampler.hpp"
+#include "Camera.hpp"
+#include "Bitmap.hpp"
+#include "Pixel.hpp"
+#include "RenderConfig.hpp"
+#include "Timer.hpp"
+#include "Vec3.hpp"
+#include "Real.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Smurf {
+    // Many frames out of one process - turntables, camera moves, sample count sweeps over the same scene
+    // A job file holds one job per line, key=value pairs applied on top of the command line's config:
+    //     output=front.bmp spp=16
+    //     output=top.bmp eye=0,600,1 look-at=0,0,0 path=kernel
+    //     output=turntable.bmp frames=36 orbit=360 width=640 height=400
+    // Any render setting goes but threads, scene, scene-cache and batch, those hold for the whole process. The camera
+    // is the scene's own unless eye, look-at, up or view-distance say otherwise. frames=N expands into N jobs written
+    // to name_0000.bmp and on, orbit=DEGREES swings the eye that far around the vertical through look-at over them.
+    // # starts a comment.
+    namespace Batch {
+        struct Job {
+            RenderConfig config;
+            Camera camera;
+            std::string output;
+        };
+
+        namespace Internal {
+            inline double parseNumber(const std::string& key, const std::string& value) {
+                std::size_t parsed = 0;
+                double result = 0.0;
+                try {
+                    result = std::stod(value, &parsed);
+                } catch (const std::logic_error&) { }
+                if (parsed == 0 || parsed != value.size()) throw std::runtime_error("Expected a number for " + key + ", got: " + value);
+                return result;
+            }
+
+            // x,y,z
+            inline Vec3<Real> parseVector(const std::string& key, const std::string& value) {
+                const auto first = value.find(',');
+                const auto second = first == std::string::npos ? first : value.find(',', first + 1);
+                if (second == std::string::npos) throw std::runtime_error("Expected x,y,z for " + key + ", got: " + value);
+                return {static_cast<Real>(parseNumber(key, value.substr(0, first))),
+                        static_cast<Real>(parseNumber(key, value.substr(first + 1, second - first - 1))),
+                        static_cast<Real>(parseNumber(key, value.substr(second + 1)))};
+            }
+
+            // turntable.bmp, 7 - turntable_0007.bmp
+            inline std::string frameName(const std::string& output, int frame) {
+                char number[16];
+                std::snprintf(number, sizeof(number), "_%04d", frame);
+                const auto extension = output.find_last_of('.');
+                const auto directory = output.find_last_of("/\\");
+                if (extension == std::string::npos || (directory != std::string::npos && extension < directory)) return output + number;
+                return output.substr(0, extension) + number + output.substr(extension);
+            }
+
+            inline void writeBitmap(const std::string& fileName, int hRes, int vRes, std::vector<Pixel> pixels) {
+                std::ofstream file(fileName, std::ios::binary);
+                if (!file) throw std::runtime_error("Cannot open image file: " + fileName);
+                file << FileFormat::Bitmap(hRes, vRes, std::move(pixels));
+                if (!file) throw std::runtime_error("Cannot write image file: " + fileName);
+            }
+        } // namespace Internal
+
+        inline std::vector<Job> loadJobs(const std::string& fileName, const RenderConfig& base, const Camera& sceneCamera) {
+            std::ifstream file(fileName);
+            if (!file) throw std::runtime_error("Cannot open job file: " + fileName);
+
+            std::vector<Job> jobs;
+            std::string line;
+            for (int lineNumber = 1; std::getline(file, line); ++lineNumber) {
+                std::istringstream tokens(line.substr(0, line.find('#')));
+                RenderConfig config = base;
+                std::string output;
+                auto eye = sceneCamera.getEye();
+                auto lookAt = sceneCamera.getLookAt();
+                auto up = sceneCamera.getUp();
+                auto viewDistance = sceneCamera.getVPDistance();
+                int frames = 1;
+                double orbit = 0.0;
+                bool empty = true;
+                try {
+                    std::string token;
+                    while (tokens >> token) {
+                        empty = false;
+                        const auto separator = token.find('=');
+                        if (separator == std::string::npos) throw std::runtime_error("Expected key=value, got: " + token);
+                        const auto key = token.substr(0, separator);
+                        const auto value = token.substr(separator + 1);
+                        if (key == "output") output = value;
+                        else if (key == "eye") eye = Internal::parseVector(key, value);
+                        else if (key == "look-at") lookAt = Internal::parseVector(key, value);
+                        else if (key == "up") up = Internal::parseVector(key, value);
+                        else if (key == "view-distance") viewDistance = static_cast<float>(Internal::parseNumber(key, value));
+                        else if (key == "frames") frames = static_cast<int>(Internal::parseNumber(key, value));
+                        else if (key == "orbit") orbit = Internal::parseNumber(key, value);
+                        else if (key == "threads" || key == "scene" || key == "scene-cache" || key == "batch") {
+                            throw std::runtime_error(key + " holds for the whole batch, it can't be set per job");
+                        }
+                        else config.set(key, value);
+                    }
+                    if (empty) continue;
+                    if (output.empty()) throw std::runtime_error("Job has no output");
+                    if (frames <= 0) throw std::runtime_error("A job needs at least one frame");
+                    if (viewDistance <= 0.0F) throw std::runtime_error("View distance has to be positive");
+                    config.validate();
+                } catch (const std::runtime_error& e) {
+                    throw std::runtime_error(fileName + ":" + std::to_string(lineNumber) + ": " + e.what());
+                }
+
+                const auto offset = eye - lookAt;
+                for (int frame = 0; frame < frames; ++frame) {
+                    const auto angle = orbit * 3.141592653589793 / 180.0 * frame / frames;
+                    const auto cosAngle = static_cast<Real>(std::cos(angle));
+                    const auto sinAngle = static_cast<Real>(std::sin(angle));
+                    const Vec3<Real> swung{offset.x * cosAngle + offset.z * sinAngle, offset.y, offset.z * cosAngle - offset.x * sinAngle};
+                    jobs.push_back({config, Camera(lookAt + swung, lookAt, up, viewDistance),
+                                    frames == 1 ? output : Internal::frameName(output, frame)});
+                }
+            }
+            if (jobs.empty()) throw std::runtime_error("No jobs in " + fileName);
+            return jobs;
+        }
+
+        // Frames go through the one scene in order, its kernel-side copy and the thread pool carry over between them
+        // Each render overlaps with writing out the frame before it and, if the frame after it samples differently,
+        // with making that one's sample tables
+        inline void render(Scene& scene, const std::vector<Job>& jobs, std::ostream& log) {
+            Timer timer;
+            timer.start();
+            std::future<void> writing;
+            std::future<std::unique_ptr<Sampler>> nextSampler;
+            for (std::size_t i = 0; i < jobs.size(); ++i) {
+                const auto& job = jobs[i];
+                scene.setCamera(job.camera);
+                if (nextSampler.valid()) {
+                    scene.configure(job.config, nextSampler.get());
+                } else {
+                    scene.configure(job.config);
+                }
+                if (i + 1 < jobs.size() && !job.config.sharesSamples(jobs[i + 1].config)) {
+                    const auto& nextConfig = jobs[i + 1].config;
+                    nextSampler = std::async(std::launch::async, [&nextConfig] { return Scene::makeSampler(nextConfig); });
+                }
+
+                log << "Frame " << i + 1 << " of " << jobs.size() << ": " << job.output << std::endl;
+                auto pixels = scene.render();
+                if (writing.valid()) writing.get();
+                writing = std::async(std::launch::async, Internal::writeBitmap, job.output, job.config.hRes, job.config.vRes, std::move(pixels));
+            }
+            writing.get();
+            timer.end();
+            log << "Batch finished.\n" << jobs.size() << " frames in " << timer.seconds() << " s" << std::endl;
+        }
+    } // namespace Batch
+} // namespace Smurf
@@ -5,10 +5,8 @@
 #include "_DIBHeader.hpp"
 #include "_BitmapFileHeader.hpp"
 
-#include <boost/detail/endian.hpp>
-
-#include <intrin.h>
 #include <iostream>
+#include <cstdlib>
 #include <type_traits>
 #include <algorithm>
 #include <tuple>
@@ -41,15 +39,31 @@ namespace Smurf {
                    Origin origin   = Origin::BottomLeft,
                    word colorDepth = ColorDepth::bpp24) :
                    Bitmap{hRes, vRes, origin, colorDepth} {
-                image = data;
+                image = std::move(data);
             }
 
             friend std::ostream& operator<<(std::ostream& os, const Bitmap& bitmap) {
-                os << bitmap._bitmapFileHeader << bitmap._dibHeader;
+                bitmap.writeHeaders(os);
                 bitmap.writeData(os);
                 return os;
             }
 
+            // The pieces of operator<< for writing pixel data that lives elsewhere, e.g. streamed out of a framebuffer
+            void writeHeaders(std::ostream& os) const {
+                os << _bitmapFileHeader << _dibHeader;
+            }
+
+            // Pixels are tightly packed BGR triplets, so every row goes out in a single write
+            void writeRows(std::ostream& os, const Pixel* rows, int numRows) const {
+                static_assert(sizeof(Pixel) == 3, "Pixels have to be laid out exactly like 24 bpp bitmap data.");
+                auto numPad = getRowPadding();
+                byte pad[] = { 0x00, 0x00, 0x00 };
+                for (int row = 0; row < numRows; ++row) {
+                    os.write(reinterpret_cast<const char*>(rows + row * _dibHeader.width), _dibHeader.width * sizeof(Pixel));
+                    if (numPad > 0) os.write(reinterpret_cast<const char*>(pad), numPad);
+                }
+            }
+
         private:
             int getRowPadding() const {
                 // Padding so that rows are divisible by 4
@@ -61,14 +75,7 @@ namespace Smurf {
             }
 
             void writeData(std::ostream& os) const {
-                auto numPad = getRowPadding();
-                byte pad[] = { 0x00, 0x00, 0x00 };
-                for (int row = 0; row < abs(_dibHeader.height); ++row) {
-                    for (int col = 0; col < _dibHeader.width; ++col) {
-                        os << image[row * _dibHeader.width + col];
-                    }
-                    os.write(reinterpret_cast<const char*>(pad), numPad);
-                }
+                writeRows(os, image.data(), abs(_dibHeader.height));
             }
         private:
             _BitmapFileHeader _bitmapFileHeader;
@@ -1,24 +1,38 @@
 #pragma once
 
+#include "Backend.hpp"
+#include "Vec2.hpp"
 #include "Vec3.hpp"
+#include "Ray.hpp"
+#include "Real.hpp"
 
 #include <array>
+#include <cmath>
 
 namespace Smurf {
+    // Perspective rays fan out from the eye (or the lens), orthographic ones leave the view plane in parallel
+    enum class Projection { Perspective, Orthographic };
+
     class Camera {
     public:
         Camera() restrict(cpu, amp) : eyePos{0, 0, 0},
                                       lookAt{0, 0, 0},
                                       up{0, 1, 0},
-                                      viewPlaneDistance{100} {
+                                      viewPlaneDistance{100},
+                                      lensRadius{0},
+                                      focalDistance{0},
+                                      projection{Projection::Perspective} {
             initializeCameraCoordSystem();
         }
 
-        Camera(Vec3<double> eyePos, Vec3<double> lookAt, Vec3<double> up, float viewPlaneDistance) restrict(cpu, amp) :
+        Camera(Vec3<Real> eyePos, Vec3<Real> lookAt, Vec3<Real> up, float viewPlaneDistance) restrict(cpu, amp) :
             eyePos{eyePos},
             lookAt{lookAt},
             up{up},
-            viewPlaneDistance{viewPlaneDistance} {
+            viewPlaneDistance{viewPlaneDistance},
+            lensRadius{0},
+            focalDistance{0},
+            projection{Projection::Perspective} {
             initializeCameraCoordSystem();
         }
 
@@ -49,45 +63,135 @@ namespace Smurf {
             }
         }
 
-        Vec3<double> inferRayDirection(const Vec2<double>& pixel) const restrict(cpu, amp) {
-            auto direction = pixel.x * cameraX + pixel.y * cameraY - viewPlaneDistance * cameraZ;
+        Vec3<Real> inferRayDirection(const Vec2<double>& pixel) const restrict(cpu, amp) {
+            auto direction = static_cast<Real>(pixel.x) * cameraX + static_cast<Real>(pixel.y) * cameraY - viewPlaneDistance * cameraZ;
             direction.normalize();
             return direction;
         }
 
+        // A pinhole without a lens radius, a thin lens otherwise - everything at focalDistance along the view
+        // direction is sharp, 0 focuses on lookAt
+        void setLens(float lensRadius, float focalDistance) restrict(cpu, amp) {
+            this->lensRadius = lensRadius;
+            this->focalDistance = focalDistance > 0 ? focalDistance : static_cast<float>(eyePos.distance(lookAt));
+        }
+
+        // The lens only applies to perspective projection
+        void setProjection(Projection projection) restrict(cpu, amp) {
+            this->projection = projection;
+        }
+
+        bool hasLens() const restrict(cpu, amp) {
+            return projection == Projection::Perspective && lensRadius != 0;
+        }
+
+        // Primary ray through pixel, leaving the lens at lensSample on the unit disc
+        // The thin lens ray aims at the point where the pinhole ray meets the focal plane
+        Ray inferRay(const Vec2<double>& pixel, const Vec2<double>& lensSample) const restrict(cpu, amp) {
+            if (projection == Projection::Orthographic) {
+                return {eyePos + static_cast<Real>(pixel.x) * cameraX + static_cast<Real>(pixel.y) * cameraY, -cameraZ};
+            }
+            if (lensRadius == 0) return {eyePos, inferRayDirection(pixel)};
+            const auto lensX = static_cast<Real>(lensSample.x * lensRadius);
+            const auto lensY = static_cast<Real>(lensSample.y * lensRadius);
+            const auto focalScale = static_cast<Real>(focalDistance / viewPlaneDistance);
+            auto direction = (static_cast<Real>(pixel.x) * focalScale - lensX) * cameraX
+                           + (static_cast<Real>(pixel.y) * focalScale - lensY) * cameraY
+                           - static_cast<Real>(focalDistance) * cameraZ;
+            direction.normalize();
+            return {eyePos + lensX * cameraX + lensY * cameraY, direction};
+        }
+
+        // inferRay for count view plane points at once, one pass per component straight into structure of arrays
+        // The projection is decided once per batch, which leaves loops without calls or branches that vectorize
+        // lensX and lensY are only read with hasLens()
+        void generateRays(int count, const Real* pixelX, const Real* pixelY, const Real* lensX, const Real* lensY, const RayArrays& rays) const {
+            if (projection == Projection::Orthographic) {
+                for (int i = 0; i < count; ++i) {
+                    rays.originX[i] = eyePos.x + pixelX[i] * cameraX.x + pixelY[i] * cameraY.x;
+                    rays.originY[i] = eyePos.y + pixelX[i] * cameraX.y + pixelY[i] * cameraY.y;
+                    rays.originZ[i] = eyePos.z + pixelX[i] * cameraX.z + pixelY[i] * cameraY.z;
+                    rays.directionX[i] = -cameraZ.x;
+                    rays.directionY[i] = -cameraZ.y;
+                    rays.directionZ[i] = -cameraZ.z;
+                }
+                return;
+            }
+
+            if (lensRadius == 0) {
+                const auto depth = static_cast<Real>(viewPlaneDistance);
+                for (int i = 0; i < count; ++i) {
+                    rays.originX[i] = eyePos.x;
+                    rays.originY[i] = eyePos.y;
+                    rays.originZ[i] = eyePos.z;
+                    const Real x = pixelX[i] * cameraX.x + pixelY[i] * cameraY.x - depth * cameraZ.x;
+                    const Real y = pixelX[i] * cameraX.y + pixelY[i] * cameraY.y - depth * cameraZ.y;
+                    const Real z = pixelX[i] * cameraX.z + pixelY[i] * cameraY.z - depth * cameraZ.z;
+                    const Real length = std::sqrt(x * x + y * y + z * z);
+                    rays.directionX[i] = x / length;
+                    rays.directionY[i] = y / length;
+                    rays.directionZ[i] = z / length;
+                }
+                return;
+            }
+
+            const auto radius = static_cast<Real>(lensRadius);
+            const auto depth = static_cast<Real>(focalDistance);
+            const auto focalScale = static_cast<Real>(focalDistance / viewPlaneDistance);
+            for (int i = 0; i < count; ++i) {
+                const Real offsetX = lensX[i] * radius;
+                const Real offsetY = lensY[i] * radius;
+                rays.originX[i] = eyePos.x + offsetX * cameraX.x + offsetY * cameraY.x;
+                rays.originY[i] = eyePos.y + offsetX * cameraX.y + offsetY * cameraY.y;
+                rays.originZ[i] = eyePos.z + offsetX * cameraX.z + offsetY * cameraY.z;
+                const Real focalX = pixelX[i] * focalScale - offsetX;
+                const Real focalY = pixelY[i] * focalScale - offsetY;
+                const Real x = focalX * cameraX.x + focalY * cameraY.x - depth * cameraZ.x;
+                const Real y = focalX * cameraX.y + focalY * cameraY.y - depth * cameraZ.y;
+                const Real z = focalX * cameraX.z + focalY * cameraY.z - depth * cameraZ.z;
+                const Real length = std::sqrt(x * x + y * y + z * z);
+                rays.directionX[i] = x / length;
+                rays.directionY[i] = y / length;
+                rays.directionZ[i] = z / length;
+            }
+        }
+
         float getVPDistance() const restrict(cpu, amp) {
             return viewPlaneDistance;
         }
 
-        const Vec3<double>& getCameraAxisX() const restrict(cpu, amp) {
+        const Vec3<Real>& getCameraAxisX() const restrict(cpu, amp) {
             return {cameraX};
         }
 
-        const Vec3<double>& getCameraAxisY() const restrict(cpu, amp) {
+        const Vec3<Real>& getCameraAxisY() const restrict(cpu, amp) {
             return {cameraY};
         }
 
-        const Vec3<double>& getCameraAxisZ() const restrict(cpu, amp) {
+        const Vec3<Real>& getCameraAxisZ() const restrict(cpu, amp) {
             return {cameraZ};
         }
 
-        const Vec3<double>& getEye() const restrict(cpu, amp) {
+        const Vec3<Real>& getEye() const restrict(cpu, amp) {
             return eyePos;
         }
 
-        const Vec3<double>& getLookAt() const restrict(cpu, amp) {
+        const Vec3<Real>& getLookAt() const restrict(cpu, amp) {
             return lookAt;
         }
 
-        const Vec3<double>& getUp() const restrict(cpu, amp) {
+        const Vec3<Real>& getUp() const restrict(cpu, amp) {
             return up;
         }
 
     private:
-        Vec3<double> cameraX, cameraY, cameraZ;
-        Vec3<double> eyePos;
-        Vec3<double> lookAt;
-        Vec3<double> up;
+        Vec3<Real> cameraX, cameraY, cameraZ;
+        Vec3<Real> eyePos;
+        Vec3<Real> lookAt;
+        Vec3<Real> up;
         float viewPlaneDistance;
+        float lensRadius;
+        float focalDistance;
+        Projection projection;
     };
 } // namespace Smurf
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Backend.hpp"
 #include "Wheels.hpp"
 
 namespace Smurf {
@@ -8,14 +9,6 @@ namespace Smurf {
         static const byte ByteMax = 255;
 
         Color() restrict(cpu, amp) : red{0.0F}, green{0.0F}, blue{0.0F} { }
-        Color(const Color& other) restrict(cpu, amp) : red{other.red}, green{other.green}, blue{other.blue} { }
-        Color& operator=(const Color& other) restrict(cpu, amp) {
-            if (this == &other) return *this;
-            red = other.red;
-            green = other.green;
-            blue = other.blue;
-            return *this;
-        }
 
         Color(float red, float green, float blue) restrict(cpu, amp) : red{red}, green{green}, blue{blue} { }
 
@@ -71,6 +64,11 @@ namespace Smurf {
             return red == other.red && green == other.green && blue == other.blue;
         }
 
+        // Brightness as the eye sees it, Rec. 709 weights
+        float luminance() const restrict(cpu, amp) {
+            return 0.2126F * red + 0.7152F * green + 0.0722F * blue;
+        }
+
         float red;
         float green;
         float blue;
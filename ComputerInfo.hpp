@@ -1,22 +1,34 @@
 #pragma once
 
-#include <amp.h>
+#include "Backend.hpp"
+#include "RenderConfig.hpp"
+#include "ThreadPool.hpp"
 
 #include <ostream>
+#include <string>
 
 namespace Smurf {
-    void printPCInfo(std::wostream& os) {
+    // Narrow streams only - mixing wcout and cout on the same stdout drops output with glibc
+    inline void printPCInfo(std::ostream& os) {
+        #ifdef USE_AMP
         auto accelerators = Concurrency::accelerator::get_all();
         for (auto && elem : accelerators) {
-            os << elem.description << std::endl;
+            os << std::string(std::begin(elem.description), std::end(elem.description)) << std::endl;
         }
+        #else
+        os << "CPU backend, " << Utils::ThreadPool::instance().size() << " worker threads" << std::endl;
+        #endif
     }
 
-    void printRayTraceInfo(std::wostream& os) {
-        os << L"Resolution: " << Settings::HRes << L" * " << Settings::VRes << "\n"
-           << L"Antialiasing: " << Settings::NumSamples << "\n"
-           << L"Shading: " << L"Simple lights" << "\n"
-           << L"Materials: " << L"Matte" << "\n"
+    inline void printRayTraceInfo(std::ostream& os, const RenderConfig& config) {
+        os << "Backend: " << Backend::name() << "\n"
+           << "Render path: " << name(config.path) << "\n"
+           << "Scene: " << config.scene << (config.sceneCache.empty() ? "" : " (cached in " + config.sceneCache + ")") << "\n"
+           << (config.batch.empty() ? "" : "Batch: " + config.batch + "\n")
+           << "Resolution: " << config.hRes << " * " << config.vRes << "\n"
+           << "Antialiasing: " << config.numSamples << " " << name(config.pattern) << (config.adaptive ? " (adaptive)" : "") << "\n"
+           << "Shading: " << (config.path == RenderPath::Wavefront ? "Path traced, max depth " + std::to_string(config.maxDepth) : "Simple lights") << "\n"
+           << "Materials: " << "Matte" << "\n"
            << std::endl; 
     }
 } // namespace Smurf
\ No newline at end of file
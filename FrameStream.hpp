@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Bitmap.hpp"
+#include "Pixel.hpp"
+#include "Tile.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Smurf {
+    // Writes the bitmap straight out of the framebuffer while the frame is still being rendered
+    // Tiles report in as they finish, a band of tile rows goes out once all of its tiles and all bands below it are
+    // done - the file fills up front to back and the framebuffer is never copied
+    class FrameStream {
+    public:
+        FrameStream(const std::string& fileName, int hRes, int vRes, int tileSize) :
+                    bitmap{hRes, vRes},
+                    hRes{hRes},
+                    vRes{vRes},
+                    tileSize{tileSize},
+                    nextBand{0},
+                    remainingTiles((vRes + tileSize - 1) / tileSize, (hRes + tileSize - 1) / tileSize),
+                    file{fileName, std::ios::binary} {
+            if (!file) throw std::runtime_error("Cannot open image file: " + fileName);
+            bitmap.writeHeaders(file);
+        }
+
+        FrameStream(const FrameStream&) = delete;
+        FrameStream& operator=(const FrameStream&) = delete;
+
+        // Tiles have to come from makeTiles with the same resolution and tile size, called from any thread
+        void tileFinished(const Tile& tile, const std::vector<Pixel>& framebuffer) {
+            std::lock_guard<std::mutex> lock(mutex);
+            --remainingTiles[tile.y0 / tileSize];
+            while (nextBand < numBands() && remainingTiles[nextBand] == 0) {
+                writeBand(nextBand++, framebuffer);
+            }
+        }
+
+        // Writes whatever hasn't gone out yet, for render paths that don't report tiles
+        void flush(const std::vector<Pixel>& framebuffer) {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (nextBand < numBands()) {
+                writeBand(nextBand++, framebuffer);
+            }
+            file.flush();
+        }
+
+    private:
+        int numBands() const {
+            return static_cast<int>(remainingTiles.size());
+        }
+
+        void writeBand(int band, const std::vector<Pixel>& framebuffer) {
+            const int firstRow = band * tileSize;
+            bitmap.writeRows(file, framebuffer.data() + firstRow * hRes, std::min(tileSize, vRes - firstRow));
+        }
+
+        FileFormat::Bitmap bitmap; // Headers only, the pixels stay in the framebuffer
+        int hRes;
+        int vRes;
+        int tileSize;
+        int nextBand;
+        std::vector<int> remainingTiles; // Per band
+        std::ofstream file;
+        std::mutex mutex;
+    };
+} // namespace Smurf
@@ -4,32 +4,41 @@
 #include "Vec3.hpp"
 #include "Ray.hpp"
 #include "Color.hpp"
+#include "AABB.hpp"
+#include "Real.hpp"
+#include "Triangle.hpp"
 
-#include <boost\optional.hpp>
+#include "Backend.hpp"
 
-#ifdef USE_AMP
-#include <amp_math.h>
-#endif
+#include <boost/optional.hpp>
 
-namespace Smurf {
-    enum ActiveMaterial { ActiveMatte, ActiveGlossy };
+#include <vector>
 
+namespace Smurf {
+    // Owned by the caller and updated in place - tMin going in is the farthest distance still of interest, so
+    // anything behind the closest hit so far gets rejected without touching the record
     struct RayHit {
-        RayHit() : depth{0}, hitPoint{0.0, 0.0, 0.0}, tMin{0.0}  { }
-        RayHit(double tMin) : tMin{tMin} { }
-        RayHit(double tMin, Vec3<double> hitPoint, int depth) : depth{depth}, hitPoint{hitPoint}, tMin{tMin} { }
+        RayHit() : depth{0}, hitPoint{0, 0, 0}, tMin{RealMax}, material{-1} { }
+        RayHit(Real tMin) : depth{0}, tMin{tMin}, material{-1} { }
+        RayHit(Real tMin, Vec3<Real> hitPoint, int depth) : depth{depth}, hitPoint{hitPoint}, tMin{tMin}, material{-1} { }
 
         int depth;
-        Vec3<double> hitPoint;
-        double tMin;
+        Vec3<Real> hitPoint;
+        Real tMin;
+        int material;
     };
 
     struct GeometricObject {
-        GeometricObject() : color{0.7F, 0.65F, 1.0F} { }
-        GeometricObject(Color color) : color{color} { }
+        GeometricObject() : color{0.7F, 0.65F, 1.0F}, active{ActiveMaterial::ActiveMatte} { }
+        GeometricObject(Color color) : color{color}, active{ActiveMaterial::ActiveMatte} { }
         GeometricObject(Color color, Matte material) : color{ color }, matte{ material }, active{ ActiveMaterial::ActiveMatte } { }
         GeometricObject(Color color, Glossy material) : color{ color }, glossy{ material }, active{ ActiveMaterial::ActiveGlossy } { }
-        virtual boost::optional<RayHit> onRayCast(const Ray& ray) = 0;
+        // True and hit.tMin updated if the object is hit closer than hit.tMin
+        virtual bool onRayCast(const Ray& ray, RayHit& hit) = 0;
+        // Unbounded objects don't have a box and stay out of the acceleration structure
+        virtual boost::optional<AABB> getBoundingBox() const {
+            return {};
+        }
         virtual ~GeometricObject() { }
         // Probably replace this later
         Color color;
@@ -41,202 +50,248 @@ namespace Smurf {
     class Plane : public GeometricObject {
     public:
         Plane() : point{0.0, 0.0, 0.0}, normal{0.0, 1.0, 0.0} { }
-        Plane(const Vec3<double>& point, const Vec3<double>& normal, Color color) : GeometricObject{color},
+        Plane(const Vec3<Real>& point, const Vec3<Real>& normal, Color color) : GeometricObject{color},
                                                                                     point{point},
                                                                                     normal{normal} { }
-        Plane(const Vec3<double>& point, const Vec3<double>& normal, Color color, Matte matte) : GeometricObject{ color, matte },
+        Plane(const Vec3<Real>& point, const Vec3<Real>& normal, Color color, Matte matte) : GeometricObject{ color, matte },
                                                                                                  point{ point },
                                                                                                  normal{ normal } { }
-        Plane(const Vec3<double>& point, const Vec3<double>& normal, Color color, Glossy glossy) : GeometricObject{ color, glossy },
+        Plane(const Vec3<Real>& point, const Vec3<Real>& normal, Color color, Glossy glossy) : GeometricObject{ color, glossy },
                                                                                                    point{ point },
                                                                                                    normal{ normal } { }
-        boost::optional<RayHit> onRayCast(const Ray& ray) override {
+        bool onRayCast(const Ray& ray, RayHit& hit) override {
             auto t = (point - ray.origin) * normal / (ray.direction * normal);
-            if (t > 0) {
-                RayHit hit(t);
-                return boost::optional<RayHit>(hit);
+            if (t > 0 && t < hit.tMin) {
+                hit.tMin = t;
+                return true;
             }
             // Didn't hit
-            return boost::optional<RayHit>();
+            return false;
         }
-        #ifdef USE_AMP
-        const Vec3<double>& getPoint() {
+        const Vec3<Real>& getPoint() {
             return point;
         }
-        const Vec3<double>& getNormal() {
+        const Vec3<Real>& getNormal() {
             return normal;
         }
-        #endif
     private:
-        Vec3<double> point;
-        Vec3<double> normal;
+        Vec3<Real> point;
+        Vec3<Real> normal;
     };
 
     class Sphere : public GeometricObject {
     public:
         Sphere() : center{0.0, 0.0, 0.0}, radius{1.0} { }
-        Sphere(const Vec3<double>& center, double radius) : center{center},
+        Sphere(const Vec3<Real>& center, Real radius) : center{center},
                                                             radius{radius} { }
-        Sphere(const Vec3<double>& center, double radius, Matte material) : GeometricObject{ {0.0F, 0.0F, 0.0F}, material },
+        Sphere(const Vec3<Real>& center, Real radius, Matte material) : GeometricObject{ {0.0F, 0.0F, 0.0F}, material },
                                                                             center{ center },
                                                                             radius{ radius } { }
-        Sphere(const Vec3<double>& center, double radius, Glossy material) : GeometricObject{ { 0.0F, 0.0F, 0.0F }, material },
+        Sphere(const Vec3<Real>& center, Real radius, Glossy material) : GeometricObject{ { 0.0F, 0.0F, 0.0F }, material },
                                                                             center{ center },
                                                                             radius{ radius } { }
-        boost::optional<RayHit> onRayCast(const Ray& ray) override {
+        bool onRayCast(const Ray& ray, RayHit& hit) override {
             auto temp = ray.origin - center;
             auto a = ray.direction * ray.direction;
-            auto b = ray.direction * (2.0 * temp);
+            auto b = ray.direction * (2 * temp);
             auto c = temp * temp - radius * radius;
-            auto discriminant = b * b - (4.0 * a * c);
+            auto discriminant = b * b - (4 * a * c);
 
             // Didn't hit
-            if (discriminant < 0.0) return boost::optional<RayHit>();
+            if (discriminant < 0) return false;
 
             auto e = sqrt(discriminant);
-            auto quadraticDenominator = 2.0 * a;
-
-            auto finalize = [](double tMin) -> boost::optional<RayHit> {
-                RayHit hit(tMin);
-                return boost::optional<RayHit>(hit);
-            };
+            auto quadraticDenominator = 2 * a;
 
             auto t = (-b - e) / quadraticDenominator;
-            if (t > 0) return finalize(t);
+            if (t <= 0) t = (-b + e) / quadraticDenominator;
 
-            t = (-b + e) / quadraticDenominator;
-            if (t > 0) return finalize(t);
+            // Didn't hit, or not closer than what's already been hit
+            if (t <= 0 || t >= hit.tMin) return false;
 
-            // Didn't hit
-            return boost::optional<RayHit>();
+            hit.tMin = t;
+            return true;
+        }
+        boost::optional<AABB> getBoundingBox() const override {
+            Vec3<Real> extent{radius, radius, radius};
+            return AABB(center - extent, center + extent);
         }
-        #ifdef USE_AMP
-        const Vec3<double>& getCenter() {
+        const Vec3<Real>& getCenter() {
             return center;
         }
-        double getRadius() {
+        Real getRadius() {
             return radius;
         }
-        #endif
     private:
-        Vec3<double> center;
-        double radius;
+        Vec3<Real> center;
+        Real radius;
     };
 
     class Rectangle : public GeometricObject {
     public:
         Rectangle() : point{0.0, 0.0, 0.0}, a{5.0, 0.0, 0.0}, b{0.0, -5.0, 0.0}, normal{0.0, 0.0, 1.0} { }
-        Rectangle(Vec3<double> point, Vec3<double> a, Vec3<double> b, Vec3<double> normal) : point{point}, a{a}, b{b}, normal{normal} { }
-        Rectangle(Vec3<double> point, Vec3<double> a, Vec3<double> b, Vec3<double> normal, Matte material) : GeometricObject{ { 0.0F, 0.0F, 0.0F }, material }, point{ point }, a{ a }, b{ b }, normal{ normal } { }
-        Rectangle(Vec3<double> point, Vec3<double> a, Vec3<double> b, Vec3<double> normal, Glossy material) : GeometricObject{ { 0.0F, 0.0F, 0.0F }, material }, point{ point }, a{ a }, b{ b }, normal{ normal } { }
+        Rectangle(Vec3<Real> point, Vec3<Real> a, Vec3<Real> b, Vec3<Real> normal) : point{point}, a{a}, b{b}, normal{normal} { }
+        Rectangle(Vec3<Real> point, Vec3<Real> a, Vec3<Real> b, Vec3<Real> normal, Matte material) : GeometricObject{ { 0.0F, 0.0F, 0.0F }, material }, point{ point }, a{ a }, b{ b }, normal{ normal } { }
+        Rectangle(Vec3<Real> point, Vec3<Real> a, Vec3<Real> b, Vec3<Real> normal, Glossy material) : GeometricObject{ { 0.0F, 0.0F, 0.0F }, material }, point{ point }, a{ a }, b{ b }, normal{ normal } { }
 
-        boost::optional<RayHit> onRayCast(const Ray& ray) override {
-            double t = (point - ray.origin) * normal / (ray.direction * normal);
-            if (t <= 0) return {};
+        bool onRayCast(const Ray& ray, RayHit& hit) override {
+            Real t = (point - ray.origin) * normal / (ray.direction * normal);
+            if (t <= 0 || t >= hit.tMin) return false;
 
             auto temp = ray.origin + t * ray.direction;
             auto tempDir = temp - point;
 
             auto tempDirDotSide = tempDir * a;
-            if (tempDirDotSide > a.lengthSquared() || tempDirDotSide < 0.0) {
-                return {};
+            if (tempDirDotSide > a.lengthSquared() || tempDirDotSide < 0) {
+                return false;
             }
 
             tempDirDotSide = tempDir * b;
-            if (tempDirDotSide > b.lengthSquared() || tempDirDotSide < 0.0) {
-                return {};
+            if (tempDirDotSide > b.lengthSquared() || tempDirDotSide < 0) {
+                return false;
             }
 
-            return {{t}};
+            hit.tMin = t;
+            return true;
+        }
+        boost::optional<AABB> getBoundingBox() const override {
+            AABB bounds;
+            bounds.expand(point);
+            bounds.expand(point + a);
+            bounds.expand(point + b);
+            bounds.expand(point + a + b);
+            return bounds;
         }
-        #ifdef USE_AMP
-        const Vec3<double>& getPoint() {
+        const Vec3<Real>& getPoint() {
             return point;
         }
-        const Vec3<double>& getA() {
+        const Vec3<Real>& getA() {
             return a;
         }
-        const Vec3<double>& getB() {
+        const Vec3<Real>& getB() {
             return b;
         }
-        const Vec3<double>& getNormal() {
+        const Vec3<Real>& getNormal() {
             return normal;
         }
-        #endif
     private:
-        Vec3<double> point;
-        Vec3<double> a, b;
-        Vec3<double> normal;
+        Vec3<Real> point;
+        Vec3<Real> a, b;
+        Vec3<Real> normal;
     };
-    #ifdef USE_AMP
 
+    // Triangles over shared vertices - three vertex indices per triangle, counter-clockwise seen from the front
+    // Normals are per vertex and optional, without them every triangle is flat shaded
+    class TriangleMesh : public GeometricObject {
+    public:
+        TriangleMesh(std::vector<Vec3<Real>> vertices, std::vector<Vec3<Real>> normals, std::vector<int> indices) : vertices{std::move(vertices)},
+                                                                                                                   normals{std::move(normals)},
+                                                                                                                   indices{std::move(indices)} { }
+        TriangleMesh(std::vector<Vec3<Real>> vertices, std::vector<Vec3<Real>> normals, std::vector<int> indices, Matte material) : GeometricObject{ { 0.0F, 0.0F, 0.0F }, material },
+                                                                                                                                    vertices{std::move(vertices)},
+                                                                                                                                    normals{std::move(normals)},
+                                                                                                                                    indices{std::move(indices)} { }
+        TriangleMesh(std::vector<Vec3<Real>> vertices, std::vector<Vec3<Real>> normals, std::vector<int> indices, Glossy material) : GeometricObject{ { 0.0F, 0.0F, 0.0F }, material },
+                                                                                                                                     vertices{std::move(vertices)},
+                                                                                                                                     normals{std::move(normals)},
+                                                                                                                                     indices{std::move(indices)} { }
+
+        // Every triangle in turn - the scene takes meshes apart into its acceleration structure instead
+        bool onRayCast(const Ray& ray, RayHit& hit) override {
+            const WatertightRay watertight(ray);
+            bool hasHit = false;
+            for (std::size_t first = 0; first + 2 < indices.size(); first += 3) {
+                Real t, b1, b2;
+                if (intersectTriangle(watertight, vertices[indices[first]], vertices[indices[first + 1]], vertices[indices[first + 2]],
+                                      hit.tMin, t, b1, b2)) {
+                    hit.tMin = t;
+                    hasHit = true;
+                }
+            }
+            return hasHit;
+        }
+        boost::optional<AABB> getBoundingBox() const override {
+            if (vertices.empty()) return {};
+            AABB bounds;
+            for (const auto& vertex : vertices) {
+                bounds.expand(vertex);
+            }
+            return bounds;
+        }
+        const std::vector<Vec3<Real>>& getVertices() const {
+            return vertices;
+        }
+        const std::vector<Vec3<Real>>& getNormals() const {
+            return normals;
+        }
+        const std::vector<int>& getIndices() const {
+            return indices;
+        }
+    private:
+        std::vector<Vec3<Real>> vertices;
+        std::vector<Vec3<Real>> normals;
+        std::vector<int> indices;
+    };
+
+    // The kernel-side primitives only keep the index of their entry in the material table
     struct g_Plane {
     public:
-        g_Plane() restrict(cpu, amp) : point{ 0.0, 0.0, 0.0 }, normal{ 0.0, 1.0, 0.0 }, matte{}, active{ ActiveMaterial::ActiveMatte } { }
-        g_Plane(const Vec3<double>& point, const Vec3<double>& normal, const Matte& material) restrict(cpu, amp) : point{ point },
-                                                                                                                   normal{ normal },
-                                                                                                                   matte{ material },
-                                                                                                                   active{ ActiveMaterial::ActiveMatte } { }
-        g_Plane(const Vec3<double>& point, const Vec3<double>& normal, const Glossy& material) restrict(cpu, amp) : point{ point },
-                                                                                                                    normal{ normal },
-                                                                                                                    glossy{ material },
-                                                                                                                    active{ ActiveMaterial::ActiveGlossy } { }
-        Vec3<double> point;
-        Vec3<double> normal;
-        ActiveMaterial active;
-        Matte matte;
-        Glossy glossy;
+        g_Plane() restrict(cpu, amp) : point{ 0.0, 0.0, 0.0 }, normal{ 0.0, 1.0, 0.0 }, material{ 0 } { }
+        g_Plane(const Vec3<Real>& point, const Vec3<Real>& normal, int material) restrict(cpu, amp) : point{ point },
+                                                                                                      normal{ normal },
+                                                                                                      material{ material } { }
+        Vec3<Real> point;
+        Vec3<Real> normal;
+        int material;
     };
 
     struct g_Sphere {
-        g_Sphere() restrict(amp) : center{ 0.0, 0.0, 0.0 }, radius{ 1.0 }, matte{}, active{ ActiveMaterial::ActiveMatte } { }
-        g_Sphere(const Vec3<double>& center, double radius, const Matte& material) restrict(cpu, amp) : center{center},
-                                                                                                        radius{radius},
-                                                                                                        matte{material},
-                                                                                                        active{ ActiveMaterial::ActiveMatte } { }
-        g_Sphere(const Vec3<double>& center, double radius, const Glossy& material) restrict(cpu, amp) : center{ center },
-                                                                                                        radius{ radius },
-                                                                                                        glossy{ material },
-                                                                                                        active{ ActiveMaterial::ActiveGlossy } { }
-        ActiveMaterial active;
-        Vec3<double> center;
-        double radius;
-        Matte matte;
-        Glossy glossy;
+        g_Sphere() restrict(amp) : center{ 0.0, 0.0, 0.0 }, radius{ 1.0 }, material{ 0 } { }
+        g_Sphere(const Vec3<Real>& center, Real radius, int material) restrict(cpu, amp) : center{center},
+                                                                                           radius{radius},
+                                                                                           material{material} { }
+        Vec3<Real> center;
+        Real radius;
+        int material;
     };
 
     struct g_Rectangle {
-        g_Rectangle() restrict(cpu, amp) : point{0.0, 0.0, 0.0}, a{5.0, 0.0, 0.0}, b{0.0, -5.0, 0.0}, normal{0.0, 0.0, 1.0} { }
-        g_Rectangle(const Vec3<double>& point, const Vec3<double>& a, const Vec3<double>& b, const Vec3<double>& normal, const Matte& matte) restrict(cpu, amp) : point{ point }, a{ a }, b{ b }, normal{ normal }, matte{ matte }, active{ ActiveMaterial::ActiveMatte } { }
-        g_Rectangle(const Vec3<double>& point, const Vec3<double>& a, const Vec3<double>& b, const Vec3<double>& normal, const Glossy& glossy) restrict(cpu, amp) : point{ point }, a{ a }, b{ b }, normal{ normal }, glossy{ glossy }, active{ ActiveMaterial::ActiveGlossy } { }
-        g_Rectangle(const g_Rectangle& other) restrict(cpu, amp) : point{ other.point }, a{ other.a }, b{ other.b }, normal{ other.normal }, matte{ other.matte }, glossy{ other.glossy }, active{ other.active } { }
-        g_Rectangle(g_Rectangle&& other) restrict(cpu, amp) : point{static_cast<Vec3<double>&&>(other.point)},
-                                                              a{static_cast<Vec3<double>&&>(other.a)},
-                                                              b{static_cast<Vec3<double>&&>(other.b)},
-                                                              normal{static_cast<Vec3<double>&&>(other.normal)},
-                                                              matte{static_cast<Matte&&>(other.matte)},
-                                                              glossy{ static_cast<Glossy&&>(other.glossy)},
-                                                              active{ static_cast<ActiveMaterial&&>(other.active) } { }
+        g_Rectangle() restrict(cpu, amp) : point{0.0, 0.0, 0.0}, a{5.0, 0.0, 0.0}, b{0.0, -5.0, 0.0}, normal{0.0, 0.0, 1.0}, material{0} { }
+        g_Rectangle(const Vec3<Real>& point, const Vec3<Real>& a, const Vec3<Real>& b, const Vec3<Real>& normal, int material) restrict(cpu, amp) : point{ point }, a{ a }, b{ b }, normal{ normal }, material{ material } { }
+        g_Rectangle(const g_Rectangle& other) restrict(cpu, amp) : point{ other.point }, a{ other.a }, b{ other.b }, normal{ other.normal }, material{ other.material } { }
+        g_Rectangle(g_Rectangle&& other) restrict(cpu, amp) : point{static_cast<Vec3<Real>&&>(other.point)},
+                                                              a{static_cast<Vec3<Real>&&>(other.a)},
+                                                              b{static_cast<Vec3<Real>&&>(other.b)},
+                                                              normal{static_cast<Vec3<Real>&&>(other.normal)},
+                                                              material{ other.material } { }
         g_Rectangle& operator=(const g_Rectangle& other) restrict(cpu, amp) {
             point = other.point;
             a = other.a;
             b = other.b;
             normal = other.normal;
-            active = other.active;
+            material = other.material;
             return *this;
         }
 
-        ActiveMaterial active;
-        Vec3<double> point;
-        Vec3<double> a, b;
-        Vec3<double> normal;
-        Matte matte;
-        Glossy glossy;
+        Vec3<Real> point;
+        Vec3<Real> a, b;
+        Vec3<Real> normal;
+        int material;
+    };
+
+    // Indices into the vertex and normal buffers every mesh of the scene shares, smooth is 0 for meshes without normals
+    struct g_Triangle {
+        g_Triangle() restrict(cpu, amp) : v0{0}, v1{0}, v2{0}, material{0}, smooth{0} { }
+        g_Triangle(int v0, int v1, int v2, int material, int smooth) restrict(cpu, amp) : v0{v0}, v1{v1}, v2{v2}, material{material}, smooth{smooth} { }
+
+        int v0, v1, v2;
+        int material;
+        int smooth;
     };
 
     struct g_RayHit {
-        g_RayHit() restrict(amp) : hasHit{false} { }
-        g_RayHit(double tMin, const Vec3<double>& normal, ActiveMaterial active) restrict(amp) : tMin{ tMin }, normal{ normal }, hasHit{ true }, active{ active } { }
+        g_RayHit() restrict(amp) : material{-1}, hasHit{false} { }
+        g_RayHit(Real tMin, const Vec3<Real>& normal, int material) restrict(amp) : normal{ normal }, tMin{ tMin }, material{ material }, hasHit{ true } { }
 
         operator bool() const restrict(amp) {
             return hasHit;
@@ -244,12 +299,10 @@ namespace Smurf {
 
         Ray ray;
         int depth;
-        ActiveMaterial active;
-        Vec3<double> hitPoint;
-        Vec3<double> normal;
-        Matte matte;
-        Glossy glossy;
-        double tMin;
+        Vec3<Real> hitPoint;
+        Vec3<Real> normal;
+        Real tMin;
+        int material; // Into the material table, -1 without a hit
         bool hasHit;
     };
 
@@ -270,14 +323,19 @@ namespace Smurf {
             return 0.0001F;
         }
 
-        g_RayHit onRayCast(const g_Plane& plane, const Ray& ray) restrict(amp) {
+        // Closest-hit tests only narrow tMin down, the winner's normal and material are looked up once it's known
+        bool onRayCast(const g_Plane& plane, const Ray& ray, Real& tMin) restrict(amp) {
             auto t = (plane.point - ray.origin) * plane.normal / (ray.direction * plane.normal);
-            if (t > GetEpsilon()) {
-                g_RayHit hit{t, plane.normal, plane.active};
-                return hit;
+            if (t > GetEpsilon() && t < tMin) {
+                tMin = t;
+                return true;
             }
             // Didn't hit
-            return {};
+            return false;
+        }
+
+        Vec3<Real> getNormal(const g_Plane& plane, const Vec3<Real>& hitPoint) restrict(amp) {
+            return plane.normal;
         }
 
         g_ShadowRayHit onShadowRayCast(const g_Plane& plane, const Ray& ray) restrict(amp) {
@@ -288,45 +346,45 @@ namespace Smurf {
             return {};
         }
 
-        g_RayHit onRayCast(const g_Sphere& sphere, const Ray& ray) restrict(amp) {
+        bool onRayCast(const g_Sphere& sphere, const Ray& ray, Real& tMin) restrict(amp) {
             auto temp = ray.origin - sphere.center;
             auto a = ray.direction * ray.direction;
-            auto b = ray.direction * (2.0 * temp);
+            auto b = ray.direction * (2 * temp);
             auto c = temp * temp - sphere.radius * sphere.radius;
-            auto discriminant = b * b - (4.0 * a * c);
+            auto discriminant = b * b - (4 * a * c);
 
             // Didn't hit
-            if (discriminant < 0.0) return {};
+            if (discriminant < 0) return false;
 
-            auto e = Concurrency::fast_math::sqrt(static_cast<float>(discriminant));
-            auto quadraticDenominator = 2.0 * a;
-
-            auto finalize = [](double tMin, const Vec3<double>& normal, const g_Sphere& sphere) restrict(amp) {
-                return g_RayHit{tMin, normal, sphere.active};
-            };
+            auto e = Backend::fast_math::sqrt(static_cast<float>(discriminant));
+            auto quadraticDenominator = 2 * a;
 
             auto t = (-b - e) / quadraticDenominator;
-            if (t > GetEpsilon()) return finalize(t, (temp + t * ray.direction).normalizeAndReturn(), sphere);
+            if (t <= GetEpsilon()) t = (-b + e) / quadraticDenominator;
 
-            t = (-b + e) / quadraticDenominator;
-            if (t > GetEpsilon()) return finalize(t, (temp + t * ray.direction).normalizeAndReturn(), sphere);
+            // Didn't hit, or not closer than what's already been hit
+            if (t <= GetEpsilon() || t >= tMin) return false;
 
-            // Didn't hit
-            return {};
+            tMin = t;
+            return true;
+        }
+
+        Vec3<Real> getNormal(const g_Sphere& sphere, const Vec3<Real>& hitPoint) restrict(amp) {
+            return (hitPoint - sphere.center).normalizeAndReturn();
         }
 
         g_ShadowRayHit onShadowRayCast(const g_Sphere& sphere, const Ray& ray) restrict(amp) {
             auto temp = ray.origin - sphere.center;
             auto a = ray.direction * ray.direction;
-            auto b = ray.direction * (2.0 * temp);
+            auto b = ray.direction * (2 * temp);
             auto c = temp * temp - sphere.radius * sphere.radius;
-            auto discriminant = b * b - (4.0 * a * c);
+            auto discriminant = b * b - (4 * a * c);
 
             // Didn't hit
-            if (discriminant < 0.0) return {};
+            if (discriminant < 0) return {};
 
-            auto e = Concurrency::fast_math::sqrt(static_cast<float>(discriminant));
-            auto quadraticDenominator = 2.0 * a;
+            auto e = Backend::fast_math::sqrt(static_cast<float>(discriminant));
+            auto quadraticDenominator = 2 * a;
 
             auto t = static_cast<float>((-b - e) / quadraticDenominator);
             if (t > GetEpsilon()) return {t};
@@ -338,32 +396,37 @@ namespace Smurf {
             return {};
         }
 
-        g_RayHit onRayCast(const g_Rectangle& rect, const Ray& ray) restrict(amp) {
-            double t = (rect.point - ray.origin) * rect.normal / (ray.direction * rect.normal);
+        bool onRayCast(const g_Rectangle& rect, const Ray& ray, Real& tMin) restrict(amp) {
+            Real t = (rect.point - ray.origin) * rect.normal / (ray.direction * rect.normal);
             
-            // Didn't hit
-            if (t <= 0) return {};
+            // Didn't hit, or not closer than what's already been hit
+            if (t <= 0 || t >= tMin) return false;
 
             auto temp = ray.origin + t * ray.direction;
             auto tempDir = temp - rect.point;
 
             auto tempDirDotSide = tempDir * rect.a;
-            if (tempDirDotSide > rect.a.lengthSquared() || tempDirDotSide < 0.0) {
+            if (tempDirDotSide > rect.a.lengthSquared() || tempDirDotSide < 0) {
                 // Didn't hit
-                return {};
+                return false;
             }
 
             tempDirDotSide = tempDir * rect.b;
-            if (tempDirDotSide > rect.b.lengthSquared() || tempDirDotSide < 0.0) {
+            if (tempDirDotSide > rect.b.lengthSquared() || tempDirDotSide < 0) {
                 // Didn't hit
-                return {};
+                return false;
             }
 
-            return {t, rect.normal, rect.active};
+            tMin = t;
+            return true;
+        }
+
+        Vec3<Real> getNormal(const g_Rectangle& rect, const Vec3<Real>& hitPoint) restrict(amp) {
+            return rect.normal;
         }
 
         g_ShadowRayHit onShadowRayCast(const g_Rectangle& rect, const Ray& ray) restrict(amp) {
-            double t = (rect.point - ray.origin) * rect.normal / (ray.direction * rect.normal);
+            Real t = (rect.point - ray.origin) * rect.normal / (ray.direction * rect.normal);
 
             // Didn't hit
             if (t <= 0) return {};
@@ -372,19 +435,63 @@ namespace Smurf {
             auto tempDir = temp - rect.point;
 
             auto tempDirDotSide = tempDir * rect.a;
-            if (tempDirDotSide > rect.a.lengthSquared() || tempDirDotSide < 0.0) {
+            if (tempDirDotSide > rect.a.lengthSquared() || tempDirDotSide < 0) {
                 // Didn't hit
                 return {};
             }
 
             tempDirDotSide = tempDir * rect.b;
-            if (tempDirDotSide > rect.b.lengthSquared() || tempDirDotSide < 0.0) {
+            if (tempDirDotSide > rect.b.lengthSquared() || tempDirDotSide < 0) {
                 // Didn't hit
                 return {};
             }
 
             return {static_cast<float>(t)};
         }
+
+        // Triangles read their corners out of the shared vertex buffer, the watertight setup is per ray
+        template <typename Vertices>
+        bool onRayCast(const g_Triangle& triangle, const Vertices& vertices, const WatertightRay& ray, Real& tMin) restrict(amp) {
+            Real t, b1, b2;
+            if (!intersectTriangle(ray, vertices[triangle.v0], vertices[triangle.v1], vertices[triangle.v2], tMin, t, b1, b2)) return false;
+            tMin = t;
+            return true;
+        }
+
+        // Interpolated across the triangle for smooth meshes, the face normal for flat ones
+        template <typename Vertices, typename Normals>
+        Vec3<Real> getNormal(const g_Triangle& triangle, const Vertices& vertices, const Normals& normals, const Ray& ray) restrict(amp) {
+            const auto& v0 = vertices[triangle.v0];
+            const auto& v1 = vertices[triangle.v1];
+            const auto& v2 = vertices[triangle.v2];
+            Real t, b1, b2;
+            if (triangle.smooth && intersectTriangle(WatertightRay(ray), v0, v1, v2, RealMax, t, b1, b2)) {
+                return ((1 - b1 - b2) * normals[triangle.v0] + b1 * normals[triangle.v1] + b2 * normals[triangle.v2]).normalizeAndReturn();
+            }
+            return triangleNormal(v0, v1, v2);
+        }
+
+        template <typename Vertices>
+        g_ShadowRayHit onShadowRayCast(const g_Triangle& triangle, const Vertices& vertices, const WatertightRay& ray) restrict(amp) {
+            Real t, b1, b2;
+            if (intersectTriangle(ray, vertices[triangle.v0], vertices[triangle.v1], vertices[triangle.v2], RealMax, t, b1, b2)) {
+                return {static_cast<float>(t)};
+            }
+            return {};
+        }
+
+        AABB getBoundingBox(const g_Sphere& sphere) restrict(cpu) {
+            Vec3<Real> extent{sphere.radius, sphere.radius, sphere.radius};
+            return {sphere.center - extent, sphere.center + extent};
+        }
+
+        AABB getBoundingBox(const g_Rectangle& rect) restrict(cpu) {
+            AABB bounds;
+            bounds.expand(rect.point);
+            bounds.expand(rect.point + rect.a);
+            bounds.expand(rect.point + rect.b);
+            bounds.expand(rect.point + rect.a + rect.b);
+            return bounds;
+        }
     } // namespace OnRayCastAspect
-    #endif
 } // namespace Smurf
\ No newline at end of file
@@ -0,0 +1,486 @@
+#pragma once
+
+#include "GeometricObject.hpp"
+#include "Material.hpp"
+#include "Color.hpp"
+#include "AABB.hpp"
+#include "Ray.hpp"
+#include "Triangle.hpp"
+#include "Vec3.hpp"
+#include "Real.hpp"
+#include "Instrumentation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace Smurf {
+    // Materials are stored once and referenced by index from the primitives
+    // The flat color is what the plain CPU path shades with, the kernels read the BRDF records
+    class MaterialTable {
+    public:
+        // Any material g_Material can be made from - Matte, Glossy, Reflective or Transparent
+        template <typename Material>
+        int add(const Color& color, const Material& material) {
+            colors.push_back(color);
+            records.emplace_back(material);
+            return size() - 1;
+        }
+
+        ActiveMaterial getActive(int materialIdx) const {
+            return records[materialIdx].type;
+        }
+
+        const Color& getColor(int materialIdx) const {
+            return colors[materialIdx];
+        }
+
+        // Padded as AMP doesn't do empty arrays - without materials there are no primitives to refer to the dummy
+        std::vector<g_Material> getKernelMaterials() const {
+            auto kernelMaterials = records;
+            if (kernelMaterials.empty()) kernelMaterials.emplace_back();
+            return kernelMaterials;
+        }
+
+        int size() const {
+            return static_cast<int>(records.size());
+        }
+
+        const std::vector<Color>& getColors() const {
+            return colors;
+        }
+
+        const std::vector<g_Material>& getRecords() const {
+            return records;
+        }
+
+        // Takes over a table saved earlier, both have an entry per material
+        void restore(std::vector<Color> savedColors, std::vector<g_Material> savedRecords) {
+            colors = std::move(savedColors);
+            records = std::move(savedRecords);
+        }
+
+    private:
+        std::vector<Color> colors;
+        std::vector<g_Material> records;
+    };
+
+    // Takes element idx out of every one of the component arrays, the ones after it move down
+    template <typename... Components>
+    void eraseAt(int idx, Components&... components) {
+        const int erased[] = {(components.erase(std::begin(components) + idx), 0)...};
+        (void)erased;
+    }
+
+    // Structure-of-arrays primitive storage - one contiguous array per component, so that a loop over many
+    // primitives only pulls in the components it actually reads
+    // Primitives are changed in place with set, remove moves every primitive after the removed one down a slot
+    struct SphereArrays {
+        int add(const Vec3<Real>& center, Real radius, int material) {
+            centerX.push_back(center.x);
+            centerY.push_back(center.y);
+            centerZ.push_back(center.z);
+            radii.push_back(radius);
+            materials.push_back(material);
+            return size() - 1;
+        }
+
+        void set(int idx, const Vec3<Real>& center, Real radius, int material) {
+            centerX[idx] = center.x;
+            centerY[idx] = center.y;
+            centerZ[idx] = center.z;
+            radii[idx] = radius;
+            materials[idx] = material;
+        }
+
+        void remove(int idx) {
+            eraseAt(idx, centerX, centerY, centerZ, radii, materials);
+        }
+
+        int size() const {
+            return static_cast<int>(radii.size());
+        }
+
+        Vec3<Real> getCenter(int idx) const {
+            return {centerX[idx], centerY[idx], centerZ[idx]};
+        }
+
+        AABB getBoundingBox(int idx) const {
+            Vec3<Real> extent{radii[idx], radii[idx], radii[idx]};
+            return {getCenter(idx) - extent, getCenter(idx) + extent};
+        }
+
+        // Same contract as GeometricObject::onRayCast, the material is recorded along with a closer hit
+        bool onRayCast(int idx, const Ray& ray, RayHit& hit) const {
+            SMURF_COUNT(intersectionTests[Instrumentation::Sphere]);
+            Vec3<Real> temp{ray.origin.x - centerX[idx], ray.origin.y - centerY[idx], ray.origin.z - centerZ[idx]};
+            auto a = ray.direction * ray.direction;
+            auto b = ray.direction * (2 * temp);
+            auto c = temp * temp - radii[idx] * radii[idx];
+            auto discriminant = b * b - (4 * a * c);
+
+            // Didn't hit
+            if (discriminant < 0) return false;
+
+            auto e = std::sqrt(discriminant);
+            auto quadraticDenominator = 2 * a;
+
+            auto t = (-b - e) / quadraticDenominator;
+            if (t <= 0) t = (-b + e) / quadraticDenominator;
+
+            // Didn't hit, or not closer than what's already been hit
+            if (t <= 0 || t >= hit.tMin) return false;
+
+            SMURF_COUNT(intersectionHits[Instrumentation::Sphere]);
+            hit.tMin = t;
+            hit.material = materials[idx];
+            return true;
+        }
+
+        std::vector<Real> centerX, centerY, centerZ;
+        std::vector<Real> radii;
+        std::vector<int> materials;
+    };
+
+    struct PlaneArrays {
+        int add(const Vec3<Real>& point, const Vec3<Real>& normal, int material) {
+            pointX.push_back(point.x);
+            pointY.push_back(point.y);
+            pointZ.push_back(point.z);
+            normalX.push_back(normal.x);
+            normalY.push_back(normal.y);
+            normalZ.push_back(normal.z);
+            materials.push_back(material);
+            return size() - 1;
+        }
+
+        void set(int idx, const Vec3<Real>& point, const Vec3<Real>& normal, int material) {
+            pointX[idx] = point.x;
+            pointY[idx] = point.y;
+            pointZ[idx] = point.z;
+            normalX[idx] = normal.x;
+            normalY[idx] = normal.y;
+            normalZ[idx] = normal.z;
+            materials[idx] = material;
+        }
+
+        void remove(int idx) {
+            eraseAt(idx, pointX, pointY, pointZ, normalX, normalY, normalZ, materials);
+        }
+
+        int size() const {
+            return static_cast<int>(materials.size());
+        }
+
+        Vec3<Real> getPoint(int idx) const {
+            return {pointX[idx], pointY[idx], pointZ[idx]};
+        }
+
+        Vec3<Real> getNormal(int idx) const {
+            return {normalX[idx], normalY[idx], normalZ[idx]};
+        }
+
+        bool onRayCast(int idx, const Ray& ray, RayHit& hit) const {
+            SMURF_COUNT(intersectionTests[Instrumentation::Plane]);
+            auto normal = getNormal(idx);
+            auto t = (getPoint(idx) - ray.origin) * normal / (ray.direction * normal);
+            // Didn't hit, or not closer than what's already been hit
+            if (t <= 0 || t >= hit.tMin) return false;
+
+            SMURF_COUNT(intersectionHits[Instrumentation::Plane]);
+            hit.tMin = t;
+            hit.material = materials[idx];
+            return true;
+        }
+
+        std::vector<Real> pointX, pointY, pointZ;
+        std::vector<Real> normalX, normalY, normalZ;
+        std::vector<int> materials;
+    };
+
+    struct RectangleArrays {
+        int add(const Vec3<Real>& point, const Vec3<Real>& a, const Vec3<Real>& b, const Vec3<Real>& normal, int material) {
+            pointX.push_back(point.x);
+            pointY.push_back(point.y);
+            pointZ.push_back(point.z);
+            aX.push_back(a.x);
+            aY.push_back(a.y);
+            aZ.push_back(a.z);
+            bX.push_back(b.x);
+            bY.push_back(b.y);
+            bZ.push_back(b.z);
+            normalX.push_back(normal.x);
+            normalY.push_back(normal.y);
+            normalZ.push_back(normal.z);
+            aLengthSquared.push_back(a.lengthSquared());
+            bLengthSquared.push_back(b.lengthSquared());
+            materials.push_back(material);
+            return size() - 1;
+        }
+
+        void set(int idx, const Vec3<Real>& point, const Vec3<Real>& a, const Vec3<Real>& b, const Vec3<Real>& normal, int material) {
+            pointX[idx] = point.x;
+            pointY[idx] = point.y;
+            pointZ[idx] = point.z;
+            aX[idx] = a.x;
+            aY[idx] = a.y;
+            aZ[idx] = a.z;
+            bX[idx] = b.x;
+            bY[idx] = b.y;
+            bZ[idx] = b.z;
+            normalX[idx] = normal.x;
+            normalY[idx] = normal.y;
+            normalZ[idx] = normal.z;
+            aLengthSquared[idx] = a.lengthSquared();
+            bLengthSquared[idx] = b.lengthSquared();
+            materials[idx] = material;
+        }
+
+        void remove(int idx) {
+            eraseAt(idx, pointX, pointY, pointZ, aX, aY, aZ, bX, bY, bZ, normalX, normalY, normalZ, aLengthSquared, bLengthSquared, materials);
+        }
+
+        int size() const {
+            return static_cast<int>(materials.size());
+        }
+
+        Vec3<Real> getPoint(int idx) const {
+            return {pointX[idx], pointY[idx], pointZ[idx]};
+        }
+
+        Vec3<Real> getA(int idx) const {
+            return {aX[idx], aY[idx], aZ[idx]};
+        }
+
+        Vec3<Real> getB(int idx) const {
+            return {bX[idx], bY[idx], bZ[idx]};
+        }
+
+        Vec3<Real> getNormal(int idx) const {
+            return {normalX[idx], normalY[idx], normalZ[idx]};
+        }
+
+        AABB getBoundingBox(int idx) const {
+            AABB bounds;
+            bounds.expand(getPoint(idx));
+            bounds.expand(getPoint(idx) + getA(idx));
+            bounds.expand(getPoint(idx) + getB(idx));
+            bounds.expand(getPoint(idx) + getA(idx) + getB(idx));
+            return bounds;
+        }
+
+        bool onRayCast(int idx, const Ray& ray, RayHit& hit) const {
+            SMURF_COUNT(intersectionTests[Instrumentation::Rectangle]);
+            auto normal = getNormal(idx);
+            Real t = (getPoint(idx) - ray.origin) * normal / (ray.direction * normal);
+            // Didn't hit, or not closer than what's already been hit
+            if (t <= 0 || t >= hit.tMin) return false;
+
+            auto tempDir = ray.origin + t * ray.direction - getPoint(idx);
+
+            auto tempDirDotSide = tempDir * getA(idx);
+            if (tempDirDotSide > aLengthSquared[idx] || tempDirDotSide < 0) {
+                return false;
+            }
+
+            tempDirDotSide = tempDir * getB(idx);
+            if (tempDirDotSide > bLengthSquared[idx] || tempDirDotSide < 0) {
+                return false;
+            }
+
+            SMURF_COUNT(intersectionHits[Instrumentation::Rectangle]);
+            hit.tMin = t;
+            hit.material = materials[idx];
+            return true;
+        }
+
+        std::vector<Real> pointX, pointY, pointZ;
+        std::vector<Real> aX, aY, aZ;
+        std::vector<Real> bX, bY, bZ;
+        std::vector<Real> normalX, normalY, normalZ;
+        std::vector<Real> aLengthSquared, bLengthSquared;
+        std::vector<int> materials;
+    };
+
+    // Every mesh's vertices go into one buffer that the triangles index into, vertices shared between triangles are
+    // stored once. Vertices stay whole rather than split per component - a triangle gathers all three of its corners.
+    // Each mesh keeps its triangles and its vertices in one contiguous range of either.
+    struct TriangleArrays {
+        struct MeshRange {
+            int firstTriangle;
+            int numTriangles;
+            int firstVertex;
+            int numVertices;
+        };
+
+        // The mesh's indices are relative to its own vertices, normals are either empty or one per vertex
+        // Returns the mesh's index into meshes
+        int addMesh(const std::vector<Vec3<Real>>& meshVertices, const std::vector<Vec3<Real>>& meshNormals,
+                    const std::vector<int>& indices, int material) {
+            const int base = static_cast<int>(vertices.size());
+            const int first = size();
+            const int smooth = meshNormals.empty() ? 0 : 1;
+            vertices.insert(std::end(vertices), std::begin(meshVertices), std::end(meshVertices));
+            if (smooth) {
+                normals.insert(std::end(normals), std::begin(meshNormals), std::end(meshNormals));
+            } else {
+                normals.resize(vertices.size());
+            }
+            for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+                v0.push_back(base + indices[i]);
+                v1.push_back(base + indices[i + 1]);
+                v2.push_back(base + indices[i + 2]);
+                materials.push_back(material);
+                smoothFlags.push_back(smooth);
+            }
+            meshes.push_back({first, size() - first, base, static_cast<int>(meshVertices.size())});
+            return static_cast<int>(meshes.size()) - 1;
+        }
+
+        // Same number of vertices as the mesh was added with, the triangles keep indexing them the same way
+        // Normals are left as they are if there are none, a flat mesh stays flat either way
+        void setMeshVertices(int mesh, const std::vector<Vec3<Real>>& meshVertices, const std::vector<Vec3<Real>>& meshNormals) {
+            const auto& range = meshes[mesh];
+            // Whether it's smooth is read off its first triangle
+            if (range.numTriangles <= 0) throw std::runtime_error("Mesh has no triangles");
+            std::copy(std::begin(meshVertices), std::end(meshVertices), std::begin(vertices) + range.firstVertex);
+            if (!meshNormals.empty() && smoothFlags[range.firstTriangle]) {
+                std::copy(std::begin(meshNormals), std::end(meshNormals), std::begin(normals) + range.firstVertex);
+            }
+        }
+
+        void setMeshMaterial(int mesh, int material) {
+            const auto& range = meshes[mesh];
+            std::fill(std::begin(materials) + range.firstTriangle, std::begin(materials) + range.firstTriangle + range.numTriangles, material);
+        }
+
+        // The meshes after it move down, their triangles are renumbered to their vertices' new place
+        void removeMesh(int mesh) {
+            const auto range = meshes[mesh];
+            const auto eraseRange = [](auto& values, int first, int count) {
+                values.erase(std::begin(values) + first, std::begin(values) + first + count);
+            };
+            eraseRange(vertices, range.firstVertex, range.numVertices);
+            eraseRange(normals, range.firstVertex, range.numVertices);
+            for (auto* corners : {&v0, &v1, &v2}) {
+                eraseRange(*corners, range.firstTriangle, range.numTriangles);
+                for (auto it = std::begin(*corners) + range.firstTriangle; it != std::end(*corners); ++it) {
+                    *it -= range.numVertices;
+                }
+            }
+            eraseRange(materials, range.firstTriangle, range.numTriangles);
+            eraseRange(smoothFlags, range.firstTriangle, range.numTriangles);
+            meshes.erase(std::begin(meshes) + mesh);
+            for (auto it = std::begin(meshes) + mesh; it != std::end(meshes); ++it) {
+                it->firstTriangle -= range.numTriangles;
+                it->firstVertex -= range.numVertices;
+            }
+        }
+
+        int size() const {
+            return static_cast<int>(materials.size());
+        }
+
+        AABB getBoundingBox(int idx) const {
+            AABB bounds;
+            bounds.expand(vertices[v0[idx]]);
+            bounds.expand(vertices[v1[idx]]);
+            bounds.expand(vertices[v2[idx]]);
+            return bounds;
+        }
+
+        // Takes the ray set up for the watertight test, once for every triangle it's tested against
+        bool onRayCast(int idx, const WatertightRay& ray, RayHit& hit) const {
+            SMURF_COUNT(intersectionTests[Instrumentation::Triangle]);
+            Real t, b1, b2;
+            // Didn't hit, or not closer than what's already been hit
+            if (!intersectTriangle(ray, vertices[v0[idx]], vertices[v1[idx]], vertices[v2[idx]], hit.tMin, t, b1, b2)) {
+                return false;
+            }
+
+            SMURF_COUNT(intersectionHits[Instrumentation::Triangle]);
+            hit.tMin = t;
+            hit.material = materials[idx];
+            return true;
+        }
+
+        std::vector<Vec3<Real>> vertices;
+        std::vector<Vec3<Real>> normals;   // Parallel to vertices, zero for the vertices of flat meshes
+        std::vector<int> v0, v1, v2;
+        std::vector<int> materials;
+        std::vector<int> smoothFlags;
+        std::vector<MeshRange> meshes;
+    };
+
+    enum class ObjectKind { Sphere, Plane, Rectangle, Mesh, NumKinds };
+
+    // What adding an object to a scene hands back to change or remove it later by
+    struct ObjectHandle {
+        ObjectKind kind;
+        int id;
+    };
+
+    // Handle ids of one kind of object to the slots their objects are stored at, slots move as others are removed
+    class HandleTable {
+    public:
+        int add(int slot) {
+            slots.push_back(slot);
+            return static_cast<int>(slots.size()) - 1;
+        }
+
+        int slot(int id) const {
+            if (id < 0 || id >= static_cast<int>(slots.size()) || slots[id] < 0) throw std::runtime_error("Object handle doesn't refer to anything");
+            return slots[id];
+        }
+
+        void remove(int id) {
+            const int removed = slot(id);
+            slots[id] = -1;
+            for (auto& other : slots) {
+                if (other > removed) --other;
+            }
+        }
+
+        // Handle i for slot i, for objects that were never handed out - restored from a cache
+        void reset(int numSlots) {
+            slots.resize(numSlots);
+            std::iota(std::begin(slots), std::end(slots), 0);
+        }
+
+    private:
+        std::vector<int> slots; // -1 once removed
+    };
+
+    // All of a scene's geometry by primitive type
+    // Bounded primitives share one index space for the acceleration structure: spheres first, then rectangles, then
+    // triangles
+    struct GeometryStore {
+        int numBounded() const {
+            return spheres.size() + rectangles.size() + triangles.size();
+        }
+
+        AABB getBoundingBox(int boundedIdx) const {
+            if (boundedIdx < spheres.size()) return spheres.getBoundingBox(boundedIdx);
+            boundedIdx -= spheres.size();
+            return boundedIdx < rectangles.size() ? rectangles.getBoundingBox(boundedIdx)
+                                                  : triangles.getBoundingBox(boundedIdx - rectangles.size());
+        }
+
+        bool onRayCast(int boundedIdx, const Ray& ray, const WatertightRay& watertight, RayHit& hit) const {
+            if (boundedIdx < spheres.size()) return spheres.onRayCast(boundedIdx, ray, hit);
+            boundedIdx -= spheres.size();
+            return boundedIdx < rectangles.size() ? rectangles.onRayCast(boundedIdx, ray, hit)
+                                                  : triangles.onRayCast(boundedIdx - rectangles.size(), watertight, hit);
+        }
+
+        SphereArrays spheres;
+        PlaneArrays planes;
+        RectangleArrays rectangles;
+        TriangleArrays triangles;
+    };
+} // namespace Smurf
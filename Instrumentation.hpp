@@ -0,0 +1,186 @@
+#pragma once
+
+// Hot-path counters for finding out whether a slow render is down to geometry, lights or shading
+// Compiled in with SMURF_INSTRUMENT, and only on the CPU backends - C++ AMP kernels can't reach host memory. Everywhere
+// else the SMURF_COUNT macros expand to nothing, so the hot paths are exactly what they'd be without them.
+#if defined(SMURF_INSTRUMENT) && !defined(USE_AMP)
+#define SMURF_INSTRUMENTED
+#endif
+
+#include "Color.hpp"
+#include "FrameStream.hpp"
+#include "Pixel.hpp"
+#include "Tile.hpp"
+#include "Wheels.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Smurf {
+    namespace Instrumentation {
+        enum PrimitiveType { Sphere, Plane, Rectangle, Triangle, NumPrimitiveTypes };
+        enum LightType { Directional, Point, NumLightTypes };
+        const int NumMaterialTypes = 4; // Indexed by ActiveMaterial
+        const int MaxCountedLights = 8;  // Lights past that share the last slot
+
+        inline int lightSlot(int lightIdx) {
+            return std::min(lightIdx, MaxCountedLights - 1);
+        }
+
+        // Plain zero-initialized counts, one set per thread
+        struct Counters {
+            Counters& operator+=(const Counters& other) {
+                for (int type = 0; type < NumPrimitiveTypes; ++type) {
+                    intersectionTests[type] += other.intersectionTests[type];
+                    intersectionHits[type] += other.intersectionHits[type];
+                }
+                for (int type = 0; type < NumLightTypes; ++type) {
+                    for (int slot = 0; slot < MaxCountedLights; ++slot) {
+                        shadowRays[type][slot] += other.shadowRays[type][slot];
+                        shadowOccluded[type][slot] += other.shadowOccluded[type][slot];
+                    }
+                }
+                for (int material = 0; material < NumMaterialTypes; ++material) {
+                    materialDispatches[material] += other.materialDispatches[material];
+                }
+                bvhLeaves += other.bvhLeaves;
+                shadowBvhLeaves += other.shadowBvhLeaves;
+                lightsFacingAway += other.lightsFacingAway;
+                occluderCacheHits += other.occluderCacheHits;
+                return *this;
+            }
+
+            long long intersectionTests[NumPrimitiveTypes];
+            long long intersectionHits[NumPrimitiveTypes]; // Closer than anything hit before, the rest are misses
+            long long bvhLeaves;                           // Visited by closest-hit queries
+            long long shadowBvhLeaves;                     // Visited by shadow rays before they got an answer
+            long long shadowRays[NumLightTypes][MaxCountedLights];
+            long long shadowOccluded[NumLightTypes][MaxCountedLights]; // Early-outs on the first occluder
+            long long lightsFacingAway;                                // Skipped without a shadow ray
+            long long occluderCacheHits;                               // Occlusion queries answered by the last occluder
+            long long materialDispatches[NumMaterialTypes];
+        };
+
+        struct Registry {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<Counters>> counters;
+        };
+
+        inline Registry& registry() {
+            static Registry registry;
+            return registry;
+        }
+
+        // The calling thread's counters, registered on first use so that they can be merged later on
+        inline Counters& local() {
+            static thread_local Counters* counters = nullptr;
+            if (!counters) {
+                auto& shared = registry();
+                std::lock_guard<std::mutex> lock(shared.mutex);
+                shared.counters.emplace_back(Utils::make_unique<Counters>());
+                counters = shared.counters.back().get();
+            }
+            return *counters;
+        }
+
+        // Both only while nothing is rendering
+        inline void reset() {
+            auto& shared = registry();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            for (auto&& counters : shared.counters) {
+                *counters = Counters();
+            }
+        }
+
+        inline Counters merged() {
+            Counters result = Counters();
+            auto& shared = registry();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            for (auto&& counters : shared.counters) {
+                result += *counters;
+            }
+            return result;
+        }
+
+        inline void print(std::ostream& os, const Counters& counters) {
+            const char* primitiveNames[] = {"Spheres", "Planes", "Rectangles", "Triangles"};
+            const char* lightNames[] = {"Directional light", "Point light"};
+            const char* materialNames[] = {"Matte", "Glossy", "Reflective", "Transparent"};
+
+            os << "Intersection tests (hits / misses):\n";
+            for (int type = 0; type < NumPrimitiveTypes; ++type) {
+                os << "    " << primitiveNames[type] << ": " << counters.intersectionTests[type] << " ("
+                   << counters.intersectionHits[type] << " / " << counters.intersectionTests[type] - counters.intersectionHits[type] << ")\n";
+            }
+            os << "BVH leaves visited: " << counters.bvhLeaves << ", by shadow rays: " << counters.shadowBvhLeaves << "\n"
+               << "Shadow rays (occluded):\n";
+            for (int type = 0; type < NumLightTypes; ++type) {
+                for (int slot = 0; slot < MaxCountedLights; ++slot) {
+                    if (counters.shadowRays[type][slot] == 0) continue;
+                    os << "    " << lightNames[type] << " " << slot << (slot == MaxCountedLights - 1 ? "+" : "") << ": "
+                       << counters.shadowRays[type][slot] << " (" << counters.shadowOccluded[type][slot] << ")\n";
+                }
+            }
+            os << "Lights facing away: " << counters.lightsFacingAway << "\n"
+               << "Occlusion queries answered by the last occluder: " << counters.occluderCacheHits << "\n"
+               << "Material dispatches:\n";
+            for (int material = 0; material < NumMaterialTypes; ++material) {
+                os << "    " << materialNames[material] << ": " << counters.materialDispatches[material] << "\n";
+            }
+            os << std::flush;
+        }
+
+        // Stores the time spent in its scope to seconds[idx], compiles to nothing without instrumentation
+        class ScopeTimer {
+        public:
+            #ifdef SMURF_INSTRUMENTED
+            ScopeTimer(std::vector<double>& seconds, int idx) : seconds(seconds), idx{idx}, start{std::chrono::steady_clock::now()} { }
+
+            ~ScopeTimer() {
+                seconds[idx] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+
+        private:
+            std::vector<double>& seconds;
+            int idx;
+            std::chrono::time_point<std::chrono::steady_clock> start;
+            #else
+            ScopeTimer(std::vector<double>&, int) { }
+            #endif
+        };
+
+        // Every tile in a shade between blue (cheapest) and red (most expensive) by the time it took
+        inline void writeHeatmap(const std::string& fileName, int hRes, int vRes, int tileSize, const std::vector<double>& tileSeconds) {
+            const auto tiles = makeTiles(hRes, vRes, tileSize);
+            const auto range = std::minmax_element(std::begin(tileSeconds), std::end(tileSeconds));
+            const double low = range.first == std::end(tileSeconds) ? 0.0 : *range.first;
+            const double spread = range.first == std::end(tileSeconds) ? 0.0 : *range.second - low;
+
+            std::vector<Pixel> image(hRes * vRes);
+            for (std::size_t tileIdx = 0; tileIdx < tiles.size() && tileIdx < tileSeconds.size(); ++tileIdx) {
+                const auto cost = static_cast<float>(spread > 0.0 ? (tileSeconds[tileIdx] - low) / spread : 0.0);
+                const Pixel shade(Color(cost, 0.0F, 1.0F - cost));
+                const auto& tile = tiles[tileIdx];
+                for (int row = tile.y0; row < tile.y1; ++row) {
+                    std::fill(std::begin(image) + row * hRes + tile.x0, std::begin(image) + row * hRes + tile.x1, shade);
+                }
+            }
+
+            FrameStream stream(fileName, hRes, vRes, tileSize);
+            stream.flush(image);
+        }
+    } // namespace Instrumentation
+} // namespace Smurf
+
+#ifdef SMURF_INSTRUMENTED
+#define SMURF_COUNT(counter) (++::Smurf::Instrumentation::local().counter)
+#define SMURF_COUNT_N(counter, n) (::Smurf::Instrumentation::local().counter += (n))
+#else
+#define SMURF_COUNT(counter) ((void)0)
+#define SMURF_COUNT_N(counter, n) ((void)0)
+#endif
@@ -1,28 +1,29 @@
 #pragma once
 
+#include "Backend.hpp"
 #include "Color.hpp"
 #include "Vec3.hpp"
+#include "Real.hpp"
 
 namespace Smurf {
 
     class DirectionalLight {
     public:
         DirectionalLight() restrict(cpu, amp) : color{1.0F, 1.0F, 1.0F}, radianceScale{1.0F}, whence{0.0F, 1.0F, 0.0F} { }
-        DirectionalLight(const DirectionalLight& other) restrict(cpu, amp) : color{other.color}, radianceScale{other.radianceScale}, whence{other.whence} { }
-        DirectionalLight(Color color, float radianceScale, Vec3<double> whence) restrict(cpu, amp) : color{color}, radianceScale{radianceScale} {
+        DirectionalLight(Color color, float radianceScale, Vec3<Real> whence) restrict(cpu, amp) : color{color}, radianceScale{radianceScale} {
             setWhence(whence);
         }
 
-        void setWhence(double x, double y, double z) restrict(cpu, amp) {
+        void setWhence(Real x, Real y, Real z) restrict(cpu, amp) {
             setWhence({ x, y, z });
         }
 
-        void setWhence(const Vec3<double>& whence) restrict(cpu, amp) {
+        void setWhence(const Vec3<Real>& whence) restrict(cpu, amp) {
             this->whence = whence;
             this->whence.normalize();
         }
 
-        const Vec3<double>& getDirection() const restrict(cpu, amp) {
+        const Vec3<Real>& getDirection() const restrict(cpu, amp) {
             return whence;
         }
 
@@ -33,24 +34,23 @@ namespace Smurf {
         Color color;
         float radianceScale;
     private:
-        Vec3<double> whence;
+        Vec3<Real> whence;
     };
 
     class PointLight {
     public:
         PointLight() restrict(cpu, amp) : color{1.0F, 1.0F, 1.0F}, radianceScale{1.0F}, location{0.0F, 0.0F, 0.0F} { }
-        PointLight(const Color& color, float radianceScale, const Vec3<double>& location) : color{color}, radianceScale{radianceScale}, location{location} { }
-        PointLight(const PointLight& other) restrict(cpu, amp) : color{other.color}, radianceScale{other.radianceScale}, location{other.location} { }
+        PointLight(const Color& color, float radianceScale, const Vec3<Real>& location) : color{color}, radianceScale{radianceScale}, location{location} { }
 
-        void setLocation(double x, double y, double z) restrict(cpu, amp) {
+        void setLocation(Real x, Real y, Real z) restrict(cpu, amp) {
             setLocation({ x, y, z });
         }
 
-        void setLocation(Vec3<double> location) restrict(cpu, amp) {
+        void setLocation(Vec3<Real> location) restrict(cpu, amp) {
             this->location = location;
         }
 
-        Vec3<double> getDirection(const Vec3<double> hitPoint) const restrict(cpu, amp) {
+        Vec3<Real> getDirection(const Vec3<Real> hitPoint) const restrict(cpu, amp) {
             return (location - hitPoint).normalizeAndReturn();
         }
 
@@ -60,15 +60,17 @@ namespace Smurf {
 
         Color color;
         float radianceScale;
-        Vec3<double> location;
+        Vec3<Real> location;
     };
 
+    // Constant light from everywhere, optionally attenuated by ambient occlusion - occlusionSamples rays per shading
+    // point over the hemisphere around the normal, the share of them blocked within occlusionDistance darkens the
+    // ambient term down to minAmount
     class AmbientLight {
     public:
-        AmbientLight() restrict(cpu, amp) : color{1.0F, 1.0F, 1.0F}, radianceScale{1.0F} { }
-        AmbientLight(const AmbientLight& other) restrict(cpu, amp) : color{other.color}, radianceScale{other.radianceScale} { }
+        AmbientLight() restrict(cpu, amp) : color{1.0F, 1.0F, 1.0F}, radianceScale{1.0F}, occlusionSamples{0}, occlusionDistance{100.0F}, minAmount{0.0F} { }
 
-        Vec3<double> getDirection() const restrict(cpu, amp) {
+        Vec3<Real> getDirection() const restrict(cpu, amp) {
             return { 0.0, 0.0, 0.0 };
         }
 
@@ -78,6 +80,9 @@ namespace Smurf {
 
         Color color;
         float radianceScale;
+        int occlusionSamples; // 0 - no occlusion
+        float occlusionDistance;
+        float minAmount;
     };
 
 } // namespace Smurf
\ No newline at end of file
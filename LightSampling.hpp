@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Backend.hpp"
+#include "Light.hpp"
+#include "Random.hpp"
+#include "AdaptiveSampling.hpp"
+
+#include <vector>
+
+namespace Smurf {
+    namespace LightSampling {
+        // Running sum of the point lights' power, normalized to end at 1 - picking by it picks a light with a
+        // probability proportional to its power. Lights that are all dark are picked uniformly.
+        inline std::vector<float> powerCdf(const std::vector<PointLight>& lights) {
+            std::vector<float> cdf(lights.size());
+            double total = 0.0;
+            for (std::size_t lightIdx = 0; lightIdx < lights.size(); ++lightIdx) {
+                total += lights[lightIdx].getRadiance().luminance();
+                cdf[lightIdx] = static_cast<float>(total);
+            }
+            for (std::size_t lightIdx = 0; lightIdx < lights.size(); ++lightIdx) {
+                cdf[lightIdx] = total > 0.0 ? static_cast<float>(cdf[lightIdx] / total) : static_cast<float>(lightIdx + 1) / lights.size();
+            }
+            // Rounding must not leave room past the last light
+            if (!cdf.empty()) cdf.back() = 1.0F;
+            return cdf;
+        }
+
+        // First light whose running sum is past u in [0, 1)
+        template <typename Cdf>
+        int pick(const Cdf& cdf, int numLights, float u) restrict(cpu, amp) {
+            int first = 0;
+            int last = numLights - 1;
+            while (first < last) {
+                const int middle = (first + last) / 2;
+                if (cdf[middle] > u) {
+                    last = middle;
+                } else {
+                    first = middle + 1;
+                }
+            }
+            return first;
+        }
+
+        template <typename Cdf>
+        float probability(const Cdf& cdf, int lightIdx) restrict(cpu, amp) {
+            return lightIdx == 0 ? cdf[0] : cdf[lightIdx] - cdf[lightIdx - 1];
+        }
+
+        // The point lights one shading point traces shadow rays to - every one of them, or with light sampling on and
+        // more lights than samples, that many picked by power. A picked light's contribution is weighted by the odds of
+        // having picked it, which keeps the estimate unbiased.
+        // Every bounce of a path picks from a stream of its own, apart from the one its scattering draws from as well.
+        struct PointLightPicks {
+            PointLightPicks(const ShadingSampling& shadingSampling, int numLights) restrict(cpu, amp)
+                : sampled{shadingSampling.policy.lightSamples > 0 && numLights > shadingSampling.policy.lightSamples},
+                  count{sampled ? shadingSampling.policy.lightSamples : numLights},
+                  numLights{numLights},
+                  rng{shadingSampling.pixelSampler.scramble ^ Random::pcgHash(~static_cast<unsigned>(shadingSampling.depth)),
+                      static_cast<unsigned>(shadingSampling.sampleIdx)} { }
+
+            // The light of the pickIdx-th pick and the weight of its contribution
+            template <typename Cdf>
+            int next(const Cdf& cdf, int pickIdx, float& weight) restrict(cpu, amp) {
+                if (!sampled) {
+                    weight = 1.0F;
+                    return pickIdx;
+                }
+                const int lightIdx = pick(cdf, numLights, rng.nextFloat());
+                weight = 1.0F / (count * probability(cdf, lightIdx));
+                return lightIdx;
+            }
+
+            bool sampled;
+            int count;
+            int numLights;
+            Random::CounterRng rng;
+        };
+    } // namespace LightSampling
+} // namespace Smurf
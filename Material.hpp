@@ -4,10 +4,10 @@
 #include "Color.hpp"
 #include "Light.hpp"
 #include "Ray.hpp"
-
-#include <amp.h>
+#include "Backend.hpp"
 
 namespace Smurf {
+    enum ActiveMaterial { ActiveMatte, ActiveGlossy, ActiveReflective, ActiveTransparent };
 
     class Matte {
     public:
@@ -31,11 +31,11 @@ namespace Smurf {
             brdfDiffuse.color = color;
         }
 
-        const Lambertian& getBrdfAmbient() const restrict(amp) {
+        const Lambertian& getBrdfAmbient() const restrict(cpu, amp) {
             return brdfAmbient;
         }
 
-        const Lambertian& getBrdfDiffuse() const restrict(amp) {
+        const Lambertian& getBrdfDiffuse() const restrict(cpu, amp) {
             return brdfDiffuse;
         }
     private:
@@ -76,15 +76,15 @@ namespace Smurf {
             brdfSpecular.color = color;
         }
         
-        const Lambertian& getBrdfAmbient() const restrict(amp) {
+        const Lambertian& getBrdfAmbient() const restrict(cpu, amp) {
             return brdfAmbient;
         }
         
-        const Lambertian& getBrdfDiffuse() const restrict(amp) {
+        const Lambertian& getBrdfDiffuse() const restrict(cpu, amp) {
             return brdfDiffuse;
         }
 
-        const Specular& getBrdfSpecular() const restrict(amp) {
+        const Specular& getBrdfSpecular() const restrict(cpu, amp) {
             return brdfSpecular;
         }
 
@@ -93,4 +93,88 @@ namespace Smurf {
         Lambertian brdfDiffuse;
         Specular brdfSpecular;
     };
+
+    // Glossy with a mirror on top, the mirrored part only shows on paths that bounce
+    class Reflective : public Glossy {
+    public:
+        Reflective() restrict(cpu, amp) {
+            setReflectiveIntensity(0.75F);
+        }
+
+        void setReflectiveIntensity(float reflectiveIntensity) restrict(cpu, amp) {
+            brdfReflective.intensity = reflectiveIntensity;
+        }
+
+        void setReflectiveColor(Color color) restrict(cpu, amp) {
+            brdfReflective.color = color;
+        }
+
+        const PerfectSpecular& getBrdfReflective() const restrict(cpu, amp) {
+            return brdfReflective;
+        }
+
+    private:
+        PerfectSpecular brdfReflective;
+    };
+
+    // Reflective that also lets light through, bent by the index of refraction
+    class Transparent : public Reflective {
+    public:
+        Transparent() restrict(cpu, amp) {
+            setReflectiveIntensity(0.1F);
+            setTransmissionIntensity(0.9F);
+            setIor(1.5F);
+        }
+
+        void setTransmissionIntensity(float transmissionIntensity) restrict(cpu, amp) {
+            btdf.intensity = transmissionIntensity;
+        }
+
+        void setIor(float ior) restrict(cpu, amp) {
+            btdf.ior = ior;
+        }
+
+        const PerfectTransmitter& getBtdf() const restrict(cpu, amp) {
+            return btdf;
+        }
+
+    private:
+        PerfectTransmitter btdf;
+    };
+
+    // One entry of the kernel-side material table - every material model is the same record, the type only says
+    // which of its BRDF terms take part. Primitives and hits refer to it by index.
+    struct g_Material {
+        g_Material() restrict(cpu, amp) : type{ActiveMaterial::ActiveMatte} { }
+        g_Material(const Matte& matte) restrict(cpu, amp) : type{ActiveMaterial::ActiveMatte},
+                                                            ambient{matte.getBrdfAmbient()},
+                                                            diffuse{matte.getBrdfDiffuse()} { }
+        g_Material(const Glossy& glossy) restrict(cpu, amp) : type{ActiveMaterial::ActiveGlossy},
+                                                              ambient{glossy.getBrdfAmbient()},
+                                                              diffuse{glossy.getBrdfDiffuse()},
+                                                              specular{glossy.getBrdfSpecular()} { }
+        g_Material(const Reflective& reflective) restrict(cpu, amp) : g_Material{static_cast<const Glossy&>(reflective)} {
+            type = ActiveMaterial::ActiveReflective;
+            this->reflective = reflective.getBrdfReflective();
+        }
+        g_Material(const Transparent& transparent) restrict(cpu, amp) : g_Material{static_cast<const Reflective&>(transparent)} {
+            type = ActiveMaterial::ActiveTransparent;
+            transmitter = transparent.getBtdf();
+        }
+
+        // Light arriving along direction and leaving towards origin, the ambient term is separate
+        Color diffuseF(const Vec3<Real>& normal, const Vec3<Real>& origin, const Vec3<Real>& direction) const restrict(amp) {
+            if (type != ActiveMaterial::ActiveMatte) {
+                return specular.diffuseF(normal, origin, direction) + diffuse.diffuseF();
+            }
+            return diffuse.diffuseF();
+        }
+
+        ActiveMaterial type;
+        Lambertian ambient;
+        Lambertian diffuse;
+        Specular specular; // Only read by glossy materials and the ones built on them
+        PerfectSpecular reflective; // Zero intensity unless reflective or transparent
+        PerfectTransmitter transmitter; // Zero intensity unless transparent
+    };
 } // namespace Smurf
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include "Color.hpp"
 
 #include <array>
+#include <algorithm>
+#include <ostream>
 
 #ifdef USE_AMP
 #undef max
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Backend.hpp"
+
+namespace Smurf {
+    namespace Random {
+        // PCG-style integer hash (Jarzynski and Olano, "Hash Functions for GPU Rendering"), 32 bit operations only so
+        // that it runs in AMP kernels too
+        inline unsigned pcgHash(unsigned input) restrict(cpu, amp) {
+            const unsigned state = input * 747796405u + 2891336453u;
+            const unsigned word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+            return (word >> 22u) ^ word;
+        }
+
+        // Counter-based generator - the n-th number of a stream is a pure function of the seed, the stream and n, so
+        // every pixel (or any other unit of work) can own a stream without sharing state and be reproduced on its own
+        class CounterRng {
+        public:
+            CounterRng(unsigned seed, unsigned stream) restrict(cpu, amp) : key{pcgHash(seed ^ pcgHash(stream))}, counter{0} { }
+
+            unsigned nextUInt() restrict(cpu, amp) {
+                return pcgHash(key ^ pcgHash(counter++));
+            }
+
+            // [0, 1) out of the top 24 bits, exactly representable in a float
+            float nextFloat() restrict(cpu, amp) {
+                return (nextUInt() >> 8) * (1.0F / 16777216.0F);
+            }
+
+            double nextDouble() restrict(cpu, amp) {
+                return (nextUInt() >> 8) * (1.0 / 16777216.0);
+            }
+
+            // [0, bound), the modulo bias is negligible for the small bounds it's used with
+            int nextInt(int bound) restrict(cpu, amp) {
+                return static_cast<int>(nextUInt() % static_cast<unsigned>(bound));
+            }
+
+        private:
+            unsigned key;
+            unsigned counter;
+        };
+
+        // Fisher-Yates over [first, last)
+        template <typename RandomAccessIterator>
+        void shuffle(RandomAccessIterator first, RandomAccessIterator last, CounterRng& rng) {
+            for (auto i = static_cast<int>(last - first) - 1; i > 0; --i) {
+                auto j = rng.nextInt(i + 1);
+                auto temp = first[i];
+                first[i] = first[j];
+                first[j] = temp;
+            }
+        }
+    } // namespace Random
+} // namespace Smurf
@@ -1,14 +1,44 @@
 #pragma once
 
+#include "Backend.hpp"
 #include "Vec3.hpp"
+#include "Real.hpp"
 
 namespace Smurf {
     struct Ray {
-        Vec3<double> origin;
-        Vec3<double> direction;
+        Vec3<Real> origin;
+        Vec3<Real> direction;
 
         Ray() restrict(cpu, amp) { }
-        Ray(const Vec3<double>& origin, const Vec3<double>& direction) restrict(cpu, amp) : origin{origin},
+        Ray(const Vec3<Real>& origin, const Vec3<Real>& direction) restrict(cpu, amp) : origin{origin},
                                                                                             direction{direction} { }
     };
+
+    // Where batched ray generation writes to - rays laid out as structure of arrays
+    struct RayArrays {
+        Real* originX;
+        Real* originY;
+        Real* originZ;
+        Real* directionX;
+        Real* directionY;
+        Real* directionZ;
+    };
+
+    // Origin for a ray leaving a surface at point, pushed off along the normal so that it can't hit that surface again
+    // The offset grows with the magnitude of the coordinates as the rounding error of a computed hit point does, a
+    // fixed epsilon is too small far from the origin in single precision and needlessly large close to it
+    inline Vec3<Real> offsetFromSurface(const Vec3<Real>& point, const Vec3<Real>& normal) restrict(cpu, amp) {
+        Real magnitude = point.x < 0 ? -point.x : point.x;
+        magnitude = (point.y < 0 ? -point.y : point.y) > magnitude ? (point.y < 0 ? -point.y : point.y) : magnitude;
+        magnitude = (point.z < 0 ? -point.z : point.z) > magnitude ? (point.z < 0 ? -point.z : point.z) : magnitude;
+        return point + (AbsoluteEpsilon + RelativeEpsilon * magnitude) * normal;
+    }
+
+    // Two unit vectors that make an orthonormal basis with the normal, for turning directions sampled around +z
+    // Taken slightly off the y axis so that the cross product can't vanish for vertical normals
+    inline void tangentFrame(const Vec3<Real>& normal, Vec3<Real>& tangent, Vec3<Real>& bitangent) restrict(cpu, amp) {
+        tangent = normal.crossProduct(Vec3<Real>(static_cast<Real>(0.0072), 1, static_cast<Real>(0.0034)));
+        tangent.normalize();
+        bitangent = tangent.crossProduct(normal);
+    }
 } // namespace Smurf
\ No newline at end of file
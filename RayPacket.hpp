@@ -0,0 +1,387 @@
+#pragma once
+
+#include "GeometricObject.hpp"
+#include "BVH.hpp"
+#include "Triangle.hpp"
+#include "Ray.hpp"
+#include "Vec3.hpp"
+#include "Real.hpp"
+#include "Instrumentation.hpp"
+
+#include <cmath>
+
+namespace Smurf {
+    // N coherent rays in structure-of-arrays layout, every loop over lanes is meant to end up as vector code
+    template <int N>
+    struct RayPacket {
+        void set(int lane, const Ray& ray) {
+            originX[lane] = ray.origin.x;
+            originY[lane] = ray.origin.y;
+            originZ[lane] = ray.origin.z;
+            directionX[lane] = ray.direction.x;
+            directionY[lane] = ray.direction.y;
+            directionZ[lane] = ray.direction.z;
+            inverseX[lane] = 1 / ray.direction.x;
+            inverseY[lane] = 1 / ray.direction.y;
+            inverseZ[lane] = 1 / ray.direction.z;
+        }
+
+        // For filling origins and directions in bulk, updateInverses() has to follow
+        RayArrays arrays() {
+            return {originX, originY, originZ, directionX, directionY, directionZ};
+        }
+
+        void updateInverses() {
+            for (int lane = 0; lane < N; ++lane) {
+                inverseX[lane] = 1 / directionX[lane];
+                inverseY[lane] = 1 / directionY[lane];
+                inverseZ[lane] = 1 / directionZ[lane];
+            }
+        }
+
+        Ray get(int lane) const {
+            return {{originX[lane], originY[lane], originZ[lane]}, {directionX[lane], directionY[lane], directionZ[lane]}};
+        }
+
+        alignas(64) Real originX[N];
+        alignas(64) Real originY[N];
+        alignas(64) Real originZ[N];
+        alignas(64) Real directionX[N];
+        alignas(64) Real directionY[N];
+        alignas(64) Real directionZ[N];
+        alignas(64) Real inverseX[N];
+        alignas(64) Real inverseY[N];
+        alignas(64) Real inverseZ[N];
+    };
+
+    // The per-ray half of the watertight triangle test for a whole packet, set up the first time the packet reaches a
+    // triangle. Coherent rays nearly always share their dominant axis, then the axes are permuted the same way for
+    // every lane and the test runs across lanes in lockstep. Packets that don't share it fall back on one lane at a time.
+    template <int N>
+    struct PacketWatertight {
+        void setup(const RayPacket<N>& rays) {
+            shared = true;
+            for (int lane = 0; lane < N; ++lane) {
+                lanes[lane] = WatertightRay(rays.get(lane));
+                shearX[lane] = lanes[lane].shearX;
+                shearY[lane] = lanes[lane].shearY;
+                shearZ[lane] = lanes[lane].shearZ;
+                shared &= lanes[lane].kx == lanes[0].kx && lanes[lane].ky == lanes[0].ky && lanes[lane].kz == lanes[0].kz;
+            }
+            const Real* origins[3] = {rays.originX, rays.originY, rays.originZ};
+            originKx = origins[lanes[0].kx];
+            originKy = origins[lanes[0].ky];
+            originKz = origins[lanes[0].kz];
+        }
+
+        bool shared;
+        const Real* originKx;   // The packet's origins along the permuted axes, only if shared
+        const Real* originKy;
+        const Real* originKz;
+        alignas(64) Real shearX[N];
+        alignas(64) Real shearY[N];
+        alignas(64) Real shearZ[N];
+        WatertightRay lanes[N];
+    };
+
+    enum class PacketPrimitive { None, Sphere, Plane, Rectangle, Triangle };
+
+    // Closest hit per lane, the active mask retires lanes that have nothing left to do
+    template <int N>
+    struct PacketHit {
+        void reset() {
+            for (int lane = 0; lane < N; ++lane) {
+                tMin[lane] = RealMax;
+                primitive[lane] = -1;
+                type[lane] = PacketPrimitive::None;
+                active[lane] = true;
+            }
+        }
+
+        bool anyActive() const {
+            bool result = false;
+            for (int lane = 0; lane < N; ++lane) {
+                result |= active[lane];
+            }
+            return result;
+        }
+
+        // Records a hit for every lane that has one, selects rather than branches so that it stays vector code
+        void update(int lane, bool isHit, Real t, int primitiveIdx, PacketPrimitive primitiveType) {
+            tMin[lane] = isHit ? t : tMin[lane];
+            primitive[lane] = isHit ? primitiveIdx : primitive[lane];
+            type[lane] = isHit ? primitiveType : type[lane];
+        }
+
+        alignas(64) Real tMin[N];
+        alignas(64) int primitive[N];
+        alignas(64) PacketPrimitive type[N];
+        bool active[N];
+    };
+
+    // The tests below don't look at the active mask. hitAllObjects pulls the tMin of inactive lanes below any distance
+    // first, so nothing can be nearer for them, and every lane goes through the same arithmetic the scalar tests do.
+    namespace PacketAspect {
+        // In three passes - std::sqrt may set errno, which keeps the loop it's in from being vectorized, so the roots
+        // are taken on their own and only if any lane's ray meets the sphere's surface at all
+        template <int N>
+        void onRayCast(const g_Sphere& sphere, int primitiveIdx, const RayPacket<N>& rays, PacketHit<N>& hit) {
+            const Real radiusSquared = sphere.radius * sphere.radius;
+            alignas(64) Real a[N];
+            alignas(64) Real b[N];
+            alignas(64) Real discriminant[N];
+            int anyMet = 0;
+            for (int lane = 0; lane < N; ++lane) {
+                const Real tempX = rays.originX[lane] - sphere.center.x;
+                const Real tempY = rays.originY[lane] - sphere.center.y;
+                const Real tempZ = rays.originZ[lane] - sphere.center.z;
+                a[lane] = rays.directionX[lane] * rays.directionX[lane]
+                          + rays.directionY[lane] * rays.directionY[lane]
+                          + rays.directionZ[lane] * rays.directionZ[lane];
+                b[lane] = 2 * (rays.directionX[lane] * tempX + rays.directionY[lane] * tempY + rays.directionZ[lane] * tempZ);
+                const Real c = tempX * tempX + tempY * tempY + tempZ * tempZ - radiusSquared;
+                discriminant[lane] = b[lane] * b[lane] - 4 * a[lane] * c;
+                anyMet |= discriminant[lane] >= 0;
+            }
+            SMURF_COUNT_N(intersectionTests[Instrumentation::Sphere], N);
+            if (!anyMet) return;
+
+            alignas(64) Real e[N];
+            for (int lane = 0; lane < N; ++lane) {
+                e[lane] = std::sqrt(discriminant[lane] > 0 ? discriminant[lane] : Real(0));
+            }
+
+            int lanesHit = 0;
+            for (int lane = 0; lane < N; ++lane) {
+                const Real reciprocalDenominator = Real(0.5) / a[lane];
+                const Real tNear = (-b[lane] - e[lane]) * reciprocalDenominator;
+                const Real tFar = (-b[lane] + e[lane]) * reciprocalDenominator;
+                const Real t = tNear > OnRayCastAspect::GetEpsilon() ? tNear : tFar;
+                const bool isHit = (discriminant[lane] >= 0) & (t > OnRayCastAspect::GetEpsilon()) & (t < hit.tMin[lane]);
+                hit.update(lane, isHit, t, primitiveIdx, PacketPrimitive::Sphere);
+                lanesHit += isHit;
+            }
+            SMURF_COUNT_N(intersectionHits[Instrumentation::Sphere], lanesHit);
+        }
+
+        template <int N>
+        void onRayCast(const g_Plane& plane, int primitiveIdx, const RayPacket<N>& rays, PacketHit<N>& hit) {
+            int lanesHit = 0;
+            for (int lane = 0; lane < N; ++lane) {
+                const Real numerator = (plane.point.x - rays.originX[lane]) * plane.normal.x
+                                       + (plane.point.y - rays.originY[lane]) * plane.normal.y
+                                       + (plane.point.z - rays.originZ[lane]) * plane.normal.z;
+                const Real denominator = rays.directionX[lane] * plane.normal.x
+                                         + rays.directionY[lane] * plane.normal.y
+                                         + rays.directionZ[lane] * plane.normal.z;
+                const Real t = numerator / denominator;
+                const bool isHit = (t > OnRayCastAspect::GetEpsilon()) & (t < hit.tMin[lane]);
+                hit.update(lane, isHit, t, primitiveIdx, PacketPrimitive::Plane);
+                lanesHit += isHit;
+            }
+            SMURF_COUNT_N(intersectionTests[Instrumentation::Plane], N);
+            SMURF_COUNT_N(intersectionHits[Instrumentation::Plane], lanesHit);
+        }
+
+        template <int N>
+        void onRayCast(const g_Rectangle& rect, int primitiveIdx, const RayPacket<N>& rays, PacketHit<N>& hit) {
+            const Real aLengthSquared = rect.a.lengthSquared();
+            const Real bLengthSquared = rect.b.lengthSquared();
+            int lanesHit = 0;
+            for (int lane = 0; lane < N; ++lane) {
+                const Real numerator = (rect.point.x - rays.originX[lane]) * rect.normal.x
+                                       + (rect.point.y - rays.originY[lane]) * rect.normal.y
+                                       + (rect.point.z - rays.originZ[lane]) * rect.normal.z;
+                const Real denominator = rays.directionX[lane] * rect.normal.x
+                                         + rays.directionY[lane] * rect.normal.y
+                                         + rays.directionZ[lane] * rect.normal.z;
+                const Real t = numerator / denominator;
+                const Real tempDirX = rays.originX[lane] + t * rays.directionX[lane] - rect.point.x;
+                const Real tempDirY = rays.originY[lane] + t * rays.directionY[lane] - rect.point.y;
+                const Real tempDirZ = rays.originZ[lane] + t * rays.directionZ[lane] - rect.point.z;
+                const Real alongA = tempDirX * rect.a.x + tempDirY * rect.a.y + tempDirZ * rect.a.z;
+                const Real alongB = tempDirX * rect.b.x + tempDirY * rect.b.y + tempDirZ * rect.b.z;
+                const bool isHit = (t > 0) & (t < hit.tMin[lane])
+                                 & (alongA >= 0) & (alongA <= aLengthSquared)
+                                 & (alongB >= 0) & (alongB <= bLengthSquared);
+                hit.update(lane, isHit, t, primitiveIdx, PacketPrimitive::Rectangle);
+                lanesHit += isHit;
+            }
+            SMURF_COUNT_N(intersectionTests[Instrumentation::Rectangle], N);
+            SMURF_COUNT_N(intersectionHits[Instrumentation::Rectangle], lanesHit);
+        }
+
+        // intersectTriangle across lanes - the corners are the same for all of them, so with shared axes only the
+        // origins and shears differ
+        template <int N, typename Vertices>
+        void onRayCast(const g_Triangle& triangle, const Vertices& vertices, int primitiveIdx,
+                       const PacketWatertight<N>& watertight, PacketHit<N>& hit) {
+            const auto& v0 = vertices[triangle.v0];
+            const auto& v1 = vertices[triangle.v1];
+            const auto& v2 = vertices[triangle.v2];
+            int lanesHit = 0;
+            if (!watertight.shared) {
+                for (int lane = 0; lane < N; ++lane) {
+                    Real t, b1, b2;
+                    const bool isHit = intersectTriangle(watertight.lanes[lane], v0, v1, v2, hit.tMin[lane], t, b1, b2);
+                    hit.update(lane, isHit, t, primitiveIdx, PacketPrimitive::Triangle);
+                    lanesHit += isHit;
+                }
+                SMURF_COUNT_N(intersectionTests[Instrumentation::Triangle], N);
+                SMURF_COUNT_N(intersectionHits[Instrumentation::Triangle], lanesHit);
+                return;
+            }
+
+            const auto& axes = watertight.lanes[0];
+            const Real v0x = component(v0, axes.kx), v0y = component(v0, axes.ky), v0z = component(v0, axes.kz);
+            const Real v1x = component(v1, axes.kx), v1y = component(v1, axes.ky), v1z = component(v1, axes.kz);
+            const Real v2x = component(v2, axes.kx), v2y = component(v2, axes.ky), v2z = component(v2, axes.kz);
+            for (int lane = 0; lane < N; ++lane) {
+                const Real aZ = v0z - watertight.originKz[lane];
+                const Real bZ = v1z - watertight.originKz[lane];
+                const Real cZ = v2z - watertight.originKz[lane];
+                const Real ax = (v0x - watertight.originKx[lane]) - watertight.shearX[lane] * aZ;
+                const Real ay = (v0y - watertight.originKy[lane]) - watertight.shearY[lane] * aZ;
+                const Real bx = (v1x - watertight.originKx[lane]) - watertight.shearX[lane] * bZ;
+                const Real by = (v1y - watertight.originKy[lane]) - watertight.shearY[lane] * bZ;
+                const Real cx = (v2x - watertight.originKx[lane]) - watertight.shearX[lane] * cZ;
+                const Real cy = (v2y - watertight.originKy[lane]) - watertight.shearY[lane] * cZ;
+
+                Real u = cx * by - cy * bx;
+                Real v = ax * cy - ay * cx;
+                Real w = bx * ay - by * ax;
+                if (sizeof(Real) < sizeof(double)) {
+                    const bool onEdge = (u == 0) | (v == 0) | (w == 0);
+                    u = onEdge ? static_cast<Real>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx) : u;
+                    v = onEdge ? static_cast<Real>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx) : v;
+                    w = onEdge ? static_cast<Real>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax) : w;
+                }
+                const bool inside = !(((u < 0) | (v < 0) | (w < 0)) & ((u > 0) | (v > 0) | (w > 0)));
+                const Real determinant = u + v + w;
+                const Real scaledT = u * watertight.shearZ[lane] * aZ + v * watertight.shearZ[lane] * bZ + w * watertight.shearZ[lane] * cZ;
+                const Real t = scaledT / determinant;
+                const bool isHit = inside & (determinant != 0) & !((t <= 0) | (t >= hit.tMin[lane]));
+                hit.update(lane, isHit, t, primitiveIdx, PacketPrimitive::Triangle);
+                lanesHit += isHit;
+            }
+            SMURF_COUNT_N(intersectionTests[Instrumentation::Triangle], N);
+            SMURF_COUNT_N(intersectionHits[Instrumentation::Triangle], lanesHit);
+        }
+
+        // AABB::intersect for every lane against its own closest hit so far, true if any lane enters the box
+        // The nearest entry of those lanes is written out
+        template <int N>
+        bool intersect(const AABB& bounds, const RayPacket<N>& rays, const PacketHit<N>& hit, Real& tNear) {
+            // The nearest entry is picked out after the loop, a floating point minimum across it wouldn't vectorize
+            alignas(64) Real entries[N];
+            int entered = 0;
+            for (int lane = 0; lane < N; ++lane) {
+                const Real tx1 = (bounds.min.x - rays.originX[lane]) * rays.inverseX[lane];
+                const Real tx2 = (bounds.max.x - rays.originX[lane]) * rays.inverseX[lane];
+                const Real ty1 = (bounds.min.y - rays.originY[lane]) * rays.inverseY[lane];
+                const Real ty2 = (bounds.max.y - rays.originY[lane]) * rays.inverseY[lane];
+                const Real tz1 = (bounds.min.z - rays.originZ[lane]) * rays.inverseZ[lane];
+                const Real tz2 = (bounds.max.z - rays.originZ[lane]) * rays.inverseZ[lane];
+                Real tEnter = tx1 < tx2 ? tx1 : tx2;
+                Real tExit = tx1 < tx2 ? tx2 : tx1;
+                tEnter = (ty1 < ty2 ? ty1 : ty2) > tEnter ? (ty1 < ty2 ? ty1 : ty2) : tEnter;
+                tExit = (ty1 < ty2 ? ty2 : ty1) < tExit ? (ty1 < ty2 ? ty2 : ty1) : tExit;
+                tEnter = (tz1 < tz2 ? tz1 : tz2) > tEnter ? (tz1 < tz2 ? tz1 : tz2) : tEnter;
+                tExit = (tz1 < tz2 ? tz2 : tz1) < tExit ? (tz1 < tz2 ? tz2 : tz1) : tExit;
+                const bool enters = (tExit >= tEnter) & (tExit > 0) & (tEnter < hit.tMin[lane]);
+                entered |= enters;
+                entries[lane] = enters ? tEnter : RealMax;
+            }
+            if (!entered) return false;
+            tNear = entries[0];
+            for (int lane = 1; lane < N; ++lane) {
+                tNear = entries[lane] < tNear ? entries[lane] : tNear;
+            }
+            return true;
+        }
+
+        // Closest hit for the whole packet - planes linearly, spheres, rectangles and triangles through the BVH
+        // A subtree is entered as soon as a single lane needs it, the lanes that don't are masked by their own tMin.
+        // It's skipped once no lane could still find anything nearer in it.
+        template <int N, typename Spheres, typename Planes, typename Rectangles, typename Triangles, typename Vertices, typename Nodes, typename Indices>
+        void hitAllObjects(const RayPacket<N>& rays, PacketHit<N>& hit,
+                           const Spheres& spheres, const Planes& planes, const Rectangles& rectangles,
+                           const Triangles& triangles, const Vertices& vertices,
+                           const Nodes& bvhNodes, const Indices& bvhIndices,
+                           int numSpheres, int numPlanes, int numRects) {
+            for (int lane = 0; lane < N; ++lane) {
+                hit.tMin[lane] = hit.active[lane] ? hit.tMin[lane] : -RealMax;
+            }
+
+            for (int i = 0; i < numPlanes; ++i) {
+                onRayCast(planes[i], i, rays, hit);
+            }
+
+            int nodeStack[BVH::StackSize];
+            Real nearStack[BVH::StackSize];
+            int stackSize = 0;
+            Real tNear;
+            if (!bvhNodes[0].isEmptyRoot() && intersect(bvhNodes[0].bounds, rays, hit, tNear)) {
+                nodeStack[stackSize] = 0;
+                nearStack[stackSize++] = tNear;
+            }
+
+            // Children get visited near-to-far along the direction most of the packet's rays go in on each axis
+            int positiveX = 0;
+            int positiveY = 0;
+            int positiveZ = 0;
+            for (int lane = 0; lane < N; ++lane) {
+                positiveX += rays.directionX[lane] >= 0;
+                positiveY += rays.directionY[lane] >= 0;
+                positiveZ += rays.directionZ[lane] >= 0;
+            }
+            const Vec3<Real> majorityDirection{Real(2 * positiveX >= N ? 1 : -1), Real(2 * positiveY >= N ? 1 : -1), Real(2 * positiveZ >= N ? 1 : -1)};
+
+            PacketWatertight<N> watertight;
+            bool watertightReady = false;
+            while (stackSize > 0) {
+                --stackSize;
+                // Every lane has found something nearer than the node since it was pushed
+                Real farthestHit = -RealMax;
+                for (int lane = 0; lane < N; ++lane) {
+                    farthestHit = hit.tMin[lane] > farthestHit ? hit.tMin[lane] : farthestHit;
+                }
+                if (nearStack[stackSize] >= farthestHit) continue;
+
+                const auto& node = bvhNodes[nodeStack[stackSize]];
+                if (node.isLeaf()) {
+                    SMURF_COUNT(bvhLeaves);
+                    for (int slot = node.leftOrFirst; slot < node.leftOrFirst + node.primitiveCount; ++slot) {
+                        const int primitiveIdx = bvhIndices[slot];
+                        if (primitiveIdx < numSpheres) {
+                            onRayCast(spheres[primitiveIdx], primitiveIdx, rays, hit);
+                        } else if (primitiveIdx < numSpheres + numRects) {
+                            onRayCast(rectangles[primitiveIdx - numSpheres], primitiveIdx - numSpheres, rays, hit);
+                        } else {
+                            if (!watertightReady) {
+                                watertight.setup(rays);
+                                watertightReady = true;
+                            }
+                            const int triangleIdx = primitiveIdx - numSpheres - numRects;
+                            onRayCast(triangles[triangleIdx], vertices, triangleIdx, watertight, hit);
+                        }
+                    }
+                    continue;
+                }
+
+                const int left = node.leftOrFirst;
+                const bool leftFirst = bvhNodes[left].bounds.centroid() * majorityDirection <= bvhNodes[left + 1].bounds.centroid() * majorityDirection;
+                const int nearChild = leftFirst ? left : left + 1;
+                const int farChild = leftFirst ? left + 1 : left;
+                if (intersect(bvhNodes[farChild].bounds, rays, hit, tNear)) {
+                    nodeStack[stackSize] = farChild;
+                    nearStack[stackSize++] = tNear;
+                }
+                if (intersect(bvhNodes[nearChild].bounds, rays, hit, tNear)) {
+                    nodeStack[stackSize] = nearChild;
+                    nearStack[stackSize++] = tNear;
+                }
+            }
+        }
+    } // namespace PacketAspect
+} // namespace Smurf
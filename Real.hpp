@@ -0,0 +1,22 @@
+#pragma once
+
+#include <limits>
+
+namespace Smurf {
+    // Scalar type of everything geometric - rays, the camera, primitives, bounding volumes
+    // SMURF_SINGLE_PRECISION switches it to float, which halves the size of geometry and rays and doubles the number
+    // of lanes per SIMD register. Colors are float either way.
+    #ifdef SMURF_SINGLE_PRECISION
+    typedef float Real;
+
+    const Real AbsoluteEpsilon = 1e-4F;
+    const Real RelativeEpsilon = 4e-6F; // ~32 ulps
+    #else
+    typedef double Real;
+
+    const Real AbsoluteEpsilon = 1e-9;
+    const Real RelativeEpsilon = 7e-15; // ~32 ulps
+    #endif
+
+    const Real RealMax = std::numeric_limits<Real>::max();
+} // namespace Smurf
@@ -0,0 +1,265 @@
+#pragma once
+
+#include "Settings.hpp"
+#include "AdaptiveSampling.hpp"
+#include "Camera.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Smurf {
+    enum class RenderPath { Tiles, Packets, Kernel, Wavefront };
+
+    // Everything that used to take a rebuild to change - resolution, samples, tiling, threads and the render path
+    // Starts out as the compiled-in Settings and gets overridden by presets, config files and command line flags, the
+    // latter in the order they appear:
+    //     smurf --preset preview --config studio.cfg --spp 64
+    // A config file holds one "key = value" per line with the same keys as the flags, # starts a comment.
+    // A preset only changes the defaults, keys set before it are applied again on top - --spp 64 --preset preview
+    // renders the preview at 64 samples per pixel.
+    struct RenderConfig {
+        RenderConfig() : hRes{Settings::HRes},
+                         vRes{Settings::VRes},
+                         numSamples{Settings::NumSamples},
+                         numSampleGroups{Settings::Internal::NumSampleGroups},
+                         tileSize{Settings::TileSize},
+                         numThreads{0},
+                         #ifdef USE_AMP
+                         path{RenderPath::Kernel},
+                         #else
+                         path{RenderPath::Packets},
+                         #endif
+                         adaptive{Settings::Adaptive::Enabled},
+                         initialSamples{Settings::Adaptive::InitialSamples},
+                         maxSamples{Settings::Adaptive::MaxSamples},
+                         errorThreshold{Settings::Adaptive::ErrorThreshold},
+                         seed{0},
+                         pattern{SamplePattern::Sobol},
+                         projection{Projection::Perspective},
+                         lensRadius{0.0F},
+                         focalDistance{0.0F},
+                         occlusionSamples{0},
+                         occlusionDistance{100.0F},
+                         lightSamples{0},
+                         maxDepth{5},
+                         scene{"gpu0"} { }
+
+        // thumbnail and preview trade quality for turnaround, final is the compiled-in Settings
+        // They are plain runtime values, there are no code paths specialized on them. Sampler tables sized at compile
+        // time for a preset's sample count measured the same as runtime sized ones, they're read a couple of times per
+        // sample next to tracing its rays.
+        static RenderConfig preset(const std::string& name) {
+            RenderConfig config;
+            if (name == "thumbnail") {
+                config.hRes = 320;
+                config.vRes = 200;
+                config.numSamples = 4;
+                config.adaptive = false;
+            } else if (name == "preview") {
+                config.hRes = Settings::HRes / 2;
+                config.vRes = Settings::VRes / 2;
+                config.numSamples = 4;
+                config.maxSamples = 16;
+            } else if (name != "final") {
+                throw std::runtime_error("Unknown preset: " + name);
+            }
+            return config;
+        }
+
+        static RenderConfig fromCommandLine(int argc, char** argv) {
+            RenderConfig config;
+            for (int i = 1; i < argc; ++i) {
+                std::string flag = argv[i];
+                if (flag.compare(0, 2, "--") != 0 || i + 1 >= argc) {
+                    throw std::runtime_error("Expected --flag value, got: " + flag);
+                }
+                config.set(flag.substr(2), argv[++i]);
+            }
+            config.validate();
+            return config;
+        }
+
+        void loadFile(const std::string& fileName) {
+            std::ifstream file(fileName);
+            if (!file) throw std::runtime_error("Cannot open config file: " + fileName);
+
+            std::string line;
+            while (std::getline(file, line)) {
+                line = line.substr(0, line.find('#'));
+                auto separator = line.find('=');
+                if (separator == std::string::npos) {
+                    if (trim(line).empty()) continue;
+                    throw std::runtime_error("Expected key = value in " + fileName + ", got: " + line);
+                }
+                set(trim(line.substr(0, separator)), trim(line.substr(separator + 1)));
+            }
+        }
+
+        void set(const std::string& key, const std::string& value) {
+            if (key == "preset") {
+                const auto earlier = std::move(applied);
+                *this = preset(value);
+                for (auto&& setting : earlier) {
+                    set(setting.first, setting.second);
+                }
+                return;
+            }
+            if (key == "config") {
+                loadFile(value);
+                return;
+            }
+
+            if (key == "width") hRes = parseInt(key, value);
+            else if (key == "height") vRes = parseInt(key, value);
+            else if (key == "spp") numSamples = parseInt(key, value);
+            else if (key == "sample-groups") numSampleGroups = parseInt(key, value);
+            else if (key == "tile") tileSize = parseInt(key, value);
+            else if (key == "threads") numThreads = parseInt(key, value);
+            else if (key == "path") path = parsePath(value);
+            else if (key == "adaptive") adaptive = parseBool(key, value);
+            else if (key == "initial-spp") initialSamples = parseInt(key, value);
+            else if (key == "max-spp") maxSamples = parseInt(key, value);
+            else if (key == "threshold") errorThreshold = parseFloat(key, value);
+            else if (key == "seed") seed = static_cast<unsigned>(parseInt(key, value));
+            else if (key == "sampler") pattern = parsePattern(value);
+            else if (key == "projection") projection = parseProjection(value);
+            else if (key == "lens-radius") lensRadius = parseFloat(key, value);
+            else if (key == "focal-distance") focalDistance = parseFloat(key, value);
+            else if (key == "ao-samples") occlusionSamples = parseInt(key, value);
+            else if (key == "ao-distance") occlusionDistance = parseFloat(key, value);
+            else if (key == "light-samples") lightSamples = parseInt(key, value);
+            else if (key == "max-depth") maxDepth = parseInt(key, value);
+            else if (key == "scene") scene = value;
+            else if (key == "scene-cache") sceneCache = value;
+            else if (key == "batch") batch = value;
+            else throw std::runtime_error("Unknown setting: " + key);
+            applied.emplace_back(key, value);
+        }
+
+        void validate() const {
+            if (hRes <= 0 || vRes <= 0) throw std::runtime_error("Resolution has to be positive.");
+            if (tileSize <= 0) throw std::runtime_error("Tile size has to be positive.");
+            if (numThreads < 0) throw std::runtime_error("Thread count can't be negative.");
+            if (numSampleGroups <= 0) throw std::runtime_error("There has to be at least one sample-group.");
+            if (numSamples <= 0) throw std::runtime_error("There has to be at least one sample per pixel.");
+            // The jittered sampler lays samples out on a square grid, the others take any count
+            auto gridSize = static_cast<int>(std::lround(std::sqrt(numSamples)));
+            if (pattern == SamplePattern::Jittered && gridSize * gridSize != numSamples) {
+                throw std::runtime_error("Samples per pixel have to be a perfect square, got: " + std::to_string(numSamples));
+            }
+            if (lensRadius < 0.0F || focalDistance < 0.0F) throw std::runtime_error("Lens radius and focal distance can't be negative.");
+            if (occlusionSamples < 0 || occlusionDistance <= 0.0F) throw std::runtime_error("Ambient occlusion needs ao-samples >= 0 and ao-distance > 0.");
+            if (lightSamples < 0) throw std::runtime_error("Light samples can't be negative.");
+            if (maxDepth <= 0) throw std::runtime_error("Paths need a max-depth of at least 1.");
+            if (adaptive && (initialSamples <= 0 || maxSamples < initialSamples)) {
+                throw std::runtime_error("Adaptive sampling needs 0 < initial-spp <= max-spp.");
+            }
+            #ifdef USE_AMP
+            if (path == RenderPath::Packets || path == RenderPath::Wavefront) throw std::runtime_error("The packet and wavefront paths are CPU-only.");
+            #endif
+        }
+
+        // Whether other's sample tables come out the same as these
+        bool sharesSamples(const RenderConfig& other) const {
+            return numSamples == other.numSamples && numSampleGroups == other.numSampleGroups && seed == other.seed && pattern == other.pattern;
+        }
+
+        SamplingPolicy getSamplingPolicy() const {
+            return {numSamples, numSampleGroups, adaptive, initialSamples, maxSamples, errorThreshold, seed, pattern, lightSamples};
+        }
+
+        int hRes;
+        int vRes;
+        int numSamples;
+        int numSampleGroups;
+        int tileSize;
+        int numThreads; // 0 - one per hardware thread
+        RenderPath path;
+        bool adaptive;
+        int initialSamples;
+        int maxSamples;
+        float errorThreshold;
+        unsigned seed; // Same seed, same image
+        SamplePattern pattern;
+        Projection projection;
+        float lensRadius;       // 0 - pinhole camera
+        float focalDistance;    // 0 - focused on the camera's lookAt
+        int occlusionSamples;   // Ambient occlusion rays per shading point, 0 - off
+        float occlusionDistance;
+        int lightSamples;       // Point lights picked by power per shading point, 0 - all of them
+        int maxDepth;           // Surfaces a wavefront path can hit, 1 - direct lighting only
+        std::string scene;      // A sample scene's name, or a .scene file to load
+        std::string sceneCache; // File the scene is loaded from, or saved to if it holds anything else, empty - no cache
+        std::string batch;      // Job file of frames to render over the scene, empty - a single frame
+
+    private:
+        std::vector<std::pair<std::string, std::string>> applied; // Every key set so far, for a preset to apply again
+
+        static std::string trim(const std::string& text) {
+            auto first = text.find_first_not_of(" \t\r");
+            if (first == std::string::npos) return {};
+            return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+        }
+
+        static int parseInt(const std::string& key, const std::string& value) {
+            std::size_t parsed = 0;
+            int result = 0;
+            try {
+                result = std::stoi(value, &parsed);
+            } catch (const std::logic_error&) { }
+            if (parsed == 0 || parsed != value.size()) throw std::runtime_error("Expected a number for " + key + ", got: " + value);
+            return result;
+        }
+
+        static float parseFloat(const std::string& key, const std::string& value) {
+            std::size_t parsed = 0;
+            float result = 0.0F;
+            try {
+                result = std::stof(value, &parsed);
+            } catch (const std::logic_error&) { }
+            if (parsed == 0 || parsed != value.size()) throw std::runtime_error("Expected a number for " + key + ", got: " + value);
+            return result;
+        }
+
+        static bool parseBool(const std::string& key, const std::string& value) {
+            if (value == "on" || value == "true" || value == "1") return true;
+            if (value == "off" || value == "false" || value == "0") return false;
+            throw std::runtime_error("Expected on/off for " + key + ", got: " + value);
+        }
+
+        static RenderPath parsePath(const std::string& value) {
+            if (value == "tiles") return RenderPath::Tiles;
+            if (value == "packets") return RenderPath::Packets;
+            if (value == "kernel") return RenderPath::Kernel;
+            if (value == "wavefront") return RenderPath::Wavefront;
+            throw std::runtime_error("Unknown render path: " + value);
+        }
+
+        static Projection parseProjection(const std::string& value) {
+            if (value == "perspective") return Projection::Perspective;
+            if (value == "orthographic") return Projection::Orthographic;
+            throw std::runtime_error("Unknown projection: " + value);
+        }
+
+        static SamplePattern parsePattern(const std::string& value) {
+            if (value == "jittered") return SamplePattern::Jittered;
+            if (value == "halton") return SamplePattern::Halton;
+            if (value == "sobol") return SamplePattern::Sobol;
+            if (value == "cmj") return SamplePattern::CorrelatedMultiJitter;
+            throw std::runtime_error("Unknown sampler: " + value);
+        }
+    };
+
+    inline const char* name(RenderPath path) {
+        switch (path) {
+            case RenderPath::Tiles: return "tiles";
+            case RenderPath::Packets: return "packets";
+            case RenderPath::Wavefront: return "wavefront";
+            default: return "kernel";
+        }
+    }
+} // namespace Smurf
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Backend.hpp"
+
+#include <vector>
+
+namespace Smurf {
+    // Rays cast for one pixel or tile, kept per work item so that kernels never have to share a counter
+    struct RayCounts {
+        RayCounts() restrict(cpu, amp) : primary{0}, secondary{0}, shadow{0} { }
+
+        int primary;
+        int secondary; // Bounces past the camera ray, only the wavefront path casts them
+        int shadow;
+    };
+
+    // What the last render did and how long it took
+    struct RenderStats {
+        RenderStats() : samples{0}, primaryRays{0}, secondaryRays{0}, shadowRays{0}, setupSeconds{0.0}, traceSeconds{0.0} { }
+
+        void add(const std::vector<RayCounts>& counts) {
+            for (auto&& count : counts) {
+                samples += count.primary;
+                primaryRays += count.primary;
+                secondaryRays += count.secondary;
+                shadowRays += count.shadow;
+            }
+        }
+
+        long long samples;
+        long long primaryRays;
+        long long secondaryRays;
+        long long shadowRays;
+        double setupSeconds; // Sample-groups, kernel-side copies of the scene, tiling
+        double traceSeconds;
+        std::vector<double> tileSeconds; // Per tile of the tiled paths, only filled in with SMURF_INSTRUMENT
+    };
+} // namespace Smurf
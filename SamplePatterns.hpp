@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Backend.hpp"
+#include "Random.hpp"
+#include "Vec2.hpp"
+
+namespace Smurf {
+    // Jittered comes out of the sampler's precomputed tables, the others are generated on the fly for every pixel and
+    // sample, need no tables and take any sample count
+    enum class SamplePattern { Jittered, Halton, Sobol, CorrelatedMultiJitter };
+
+    inline const char* name(SamplePattern pattern) {
+        switch (pattern) {
+            case SamplePattern::Halton: return "halton";
+            case SamplePattern::Sobol: return "sobol";
+            case SamplePattern::CorrelatedMultiJitter: return "cmj";
+            default: return "jittered";
+        }
+    }
+
+    namespace SamplePatterns {
+        inline unsigned reverseBits(unsigned bits) restrict(cpu, amp) {
+            bits = (bits << 16) | (bits >> 16);
+            bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+            bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+            bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+            bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+            return bits;
+        }
+
+        // [0, 1) out of a 32 bit fixed point fraction
+        inline double toUnit(unsigned bits) restrict(cpu, amp) {
+            return bits * (1.0 / 4294967296.0);
+        }
+
+        // First two dimensions of the Sobol' sequence, a (0, 2)-sequence - every power of two prefix is stratified
+        // in every elementary interval. The per pixel scramble is a random digital shift, which keeps that property.
+        inline Vec2<double> sobol(unsigned index, unsigned scramble) restrict(cpu, amp) {
+            const unsigned x = reverseBits(index);
+            unsigned y = 0;
+            for (unsigned direction = 1u << 31; index != 0; index >>= 1, direction ^= direction >> 1) {
+                if (index & 1) y ^= direction;
+            }
+            return {toUnit(x ^ scramble), toUnit(y ^ Random::pcgHash(scramble))};
+        }
+
+        inline double radicalInverseBase3(unsigned index) restrict(cpu, amp) {
+            double result = 0.0;
+            double digitWeight = 1.0 / 3.0;
+            for (; index != 0; index /= 3, digitWeight /= 3.0) {
+                result += (index % 3) * digitWeight;
+            }
+            return result;
+        }
+
+        // Halton in bases 2 and 3, decorrelated between pixels by a Cranley-Patterson rotation
+        inline Vec2<double> halton(unsigned index, unsigned scramble) restrict(cpu, amp) {
+            auto x = toUnit(reverseBits(index)) + toUnit(scramble);
+            auto y = radicalInverseBase3(index) + toUnit(Random::pcgHash(scramble));
+            return {x < 1.0 ? x : x - 1.0, y < 1.0 ? y : y - 1.0};
+        }
+
+        // Kensler's hashed permutation of [0, length) - "Correlated Multi-Jittered Sampling", Pixar 2013
+        inline unsigned permute(unsigned i, unsigned length, unsigned pattern) restrict(cpu, amp) {
+            unsigned w = length - 1;
+            w |= w >> 1;
+            w |= w >> 2;
+            w |= w >> 4;
+            w |= w >> 8;
+            w |= w >> 16;
+            do {
+                i ^= pattern;
+                i *= 0xe170893du;
+                i ^= pattern >> 16;
+                i ^= (i & w) >> 4;
+                i ^= pattern >> 8;
+                i *= 0x0929eb3fu;
+                i ^= pattern >> 23;
+                i ^= (i & w) >> 1;
+                i *= 1 | pattern >> 27;
+                i *= 0x6935fa69u;
+                i ^= (i & w) >> 11;
+                i *= 0x74dcb303u;
+                i ^= (i & w) >> 2;
+                i *= 0x9e501cc3u;
+                i ^= (i & w) >> 2;
+                i *= 0xc860a3dfu;
+                i &= w;
+                i ^= i >> 5;
+            } while (i >= length);
+            return (i + pattern) % length;
+        }
+
+        inline double randomUnit(unsigned i, unsigned pattern) restrict(cpu, amp) {
+            i ^= pattern;
+            i ^= i >> 17;
+            i ^= i >> 10;
+            i *= 0xb36534e5u;
+            i ^= i >> 12;
+            i ^= i >> 21;
+            i *= 0x93fc4795u;
+            i ^= 0xdf6e307fu;
+            i ^= i >> 17;
+            i *= 1 | pattern >> 18;
+            return toUnit(i);
+        }
+
+        // Sample index of numSamples, stratified both as an m * n grid and along each axis - any sample count works,
+        // the grid is as square as it gets. Every further batch of numSamples gets a pattern of its own.
+        inline Vec2<double> correlatedMultiJitter(unsigned index, unsigned numSamples, unsigned scramble) restrict(cpu, amp) {
+            const unsigned pattern = Random::pcgHash(scramble + index / numSamples);
+            index %= numSamples;
+            unsigned m = 1;
+            while ((m + 1) * (m + 1) <= numSamples) ++m;
+            const unsigned n = (numSamples + m - 1) / m;
+
+            index = permute(index, numSamples, pattern * 0x51633e2du);
+            const unsigned column = permute(index % m, m, pattern * 0x68bc21ebu);
+            const unsigned row = permute(index / m, n, pattern * 0x02e5be93u);
+            const double jitterX = randomUnit(index, pattern * 0x967a889bu);
+            const double jitterY = randomUnit(index, pattern * 0x368cc8b7u);
+            return {(column + (row + jitterX) / n) / m, (index + jitterY) / numSamples};
+        }
+
+        // Any pattern but Jittered
+        inline Vec2<double> generate(SamplePattern pattern, unsigned index, unsigned numSamples, unsigned scramble) restrict(cpu, amp) {
+            switch (pattern) {
+                case SamplePattern::Halton: return halton(index, scramble);
+                case SamplePattern::CorrelatedMultiJitter: return correlatedMultiJitter(index, numSamples, scramble);
+                default: return sobol(index, scramble);
+            }
+        }
+    } // namespace SamplePatterns
+} // namespace Smurf
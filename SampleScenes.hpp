@@ -5,8 +5,14 @@
 #include "GeometricObject.hpp"
 #include "Material.hpp"
 #include "Light.hpp"
+#include "SceneFile.hpp"
 
+#include <cmath>
+#include <fstream>
+#include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <string>
 
 using Smurf::Utils::make_unique;
 
@@ -20,16 +26,16 @@ namespace Smurf {
             1000.0};
             auto scene = make_unique<Scene>(camera, Color{0.0, 0.0, 0.0});
 
-            scene->addToScene(make_unique<Rectangle>(Vec3<double>{ -25, 25, 0 + 10 }, Vec3<double>{ 50, 0, 0 }, Vec3<double>{ 0, -50, 0 }, Vec3<double>{ 0, 0, 1 })); // Front
-            scene->addToScene(make_unique<Rectangle>(Vec3<double>{ -25 - 10, 25, 0 }, Vec3<double>{ 0, 0, -50 }, Vec3<double>{ 0, -50, 0 }, Vec3<double>{ 1, 0, 0 })); // Left
-            scene->addToScene(make_unique<Rectangle>(Vec3<double>{ -25, 25 + 10, 0 }, Vec3<double>{ 0, 0, -50 }, Vec3<double>{ 50, 0, 0 }, Vec3<double>{ 0, -1, 0 })); // Top
+            scene->addToScene(make_unique<Rectangle>(Vec3<Real>{ -25, 25, 0 + 10 }, Vec3<Real>{ 50, 0, 0 }, Vec3<Real>{ 0, -50, 0 }, Vec3<Real>{ 0, 0, 1 })); // Front
+            scene->addToScene(make_unique<Rectangle>(Vec3<Real>{ -25 - 10, 25, 0 }, Vec3<Real>{ 0, 0, -50 }, Vec3<Real>{ 0, -50, 0 }, Vec3<Real>{ 1, 0, 0 })); // Left
+            scene->addToScene(make_unique<Rectangle>(Vec3<Real>{ -25, 25 + 10, 0 }, Vec3<Real>{ 0, 0, -50 }, Vec3<Real>{ 50, 0, 0 }, Vec3<Real>{ 0, -1, 0 })); // Top
 
-            scene->addToScene(make_unique<Rectangle>(Vec3<double>{ 25, -25, -50 - 10 }, Vec3<double>{ -50, 0, 0 }, Vec3<double>{ 0, 50, 0 }, Vec3<double>{ 0, 0, -1 })); // Back
-            scene->addToScene(make_unique<Rectangle>(Vec3<double>{ 25 + 10, -25, -50 }, Vec3<double>{ 0, 50, 0 }, Vec3<double>{ 0, 0, 50 }, Vec3<double>{ -1, 0, 0 })); // Right
-            scene->addToScene(make_unique<Rectangle>(Vec3<double>{ 25, -25 - 10, -50 }, Vec3<double>{ -50, 0, 0 }, Vec3<double>{ 0, 0, 50 }, Vec3<double>{ 0, 1, 0 })); // Bottom
+            scene->addToScene(make_unique<Rectangle>(Vec3<Real>{ 25, -25, -50 - 10 }, Vec3<Real>{ -50, 0, 0 }, Vec3<Real>{ 0, 50, 0 }, Vec3<Real>{ 0, 0, -1 })); // Back
+            scene->addToScene(make_unique<Rectangle>(Vec3<Real>{ 25 + 10, -25, -50 }, Vec3<Real>{ 0, 50, 0 }, Vec3<Real>{ 0, 0, 50 }, Vec3<Real>{ -1, 0, 0 })); // Right
+            scene->addToScene(make_unique<Rectangle>(Vec3<Real>{ 25, -25 - 10, -50 }, Vec3<Real>{ -50, 0, 0 }, Vec3<Real>{ 0, 0, 50 }, Vec3<Real>{ 0, 1, 0 })); // Bottom
 
-            scene->addToScene(make_unique<Sphere>(Vec3<double>(177, 0, -150), 50));
-            scene->addToScene(make_unique<Plane>(Vec3<double>(0, -10, 0), Vec3<double>(0, 1, 0), Color(1.0, 1.0, 0.0)));
+            scene->addToScene(make_unique<Sphere>(Vec3<Real>(177, 0, -150), 50));
+            scene->addToScene(make_unique<Plane>(Vec3<Real>(0, -10, 0), Vec3<Real>(0, 1, 0), Color(1.0, 1.0, 0.0)));
 
             return scene;
         }
@@ -41,9 +47,9 @@ namespace Smurf {
             400};
             auto scene = make_unique<Scene>(camera, Color{0.0, 0.0, 0.0});
 
-            scene->addToScene(make_unique<Sphere>(Vec3<double>(0, 0, 0), 100));
-            scene->addToScene(make_unique<Sphere>(Vec3<double>(177, 0, -150), 50));
-            scene->addToScene(make_unique<Plane>(Vec3<double>(0, -10, 0), Vec3<double>(0, 1, 0), Color(1.0, 1.0, 0.0)));
+            scene->addToScene(make_unique<Sphere>(Vec3<Real>(0, 0, 0), 100));
+            scene->addToScene(make_unique<Sphere>(Vec3<Real>(177, 0, -150), 50));
+            scene->addToScene(make_unique<Plane>(Vec3<Real>(0, -10, 0), Vec3<Real>(0, 1, 0), Color(1.0, 1.0, 0.0)));
             
             return scene;
         }
@@ -70,13 +76,13 @@ namespace Smurf {
 
 
 
-            scene->addToScene(make_unique<Rectangle>(Vec3<double>{ -25, 25, 0 }, Vec3<double>{ 50, 0, 0 }, Vec3<double>{ 0, -50, 0 }, Vec3<double>{ 0, 0, 1 }, invisible)); // Front
-            scene->addToScene(make_unique<Rectangle>(Vec3<double>{ -25, 25, 0 }, Vec3<double>{ 0, 0, -50 }, Vec3<double>{ 0, -50, 0 }, Vec3<double>{ 1, 0, 0 }, invisible)); // Left
-            scene->addToScene(make_unique<Rectangle>(Vec3<double>{ -25, 25, 0 }, Vec3<double>{ 0, 0, -50 }, Vec3<double>{ 50, 0, 0 }, Vec3<double>{ 0, -1, 0 }, invisible)); // Top
+            scene->addToScene(make_unique<Rectangle>(Vec3<Real>{ -25, 25, 0 }, Vec3<Real>{ 50, 0, 0 }, Vec3<Real>{ 0, -50, 0 }, Vec3<Real>{ 0, 0, 1 }, invisible)); // Front
+            scene->addToScene(make_unique<Rectangle>(Vec3<Real>{ -25, 25, 0 }, Vec3<Real>{ 0, 0, -50 }, Vec3<Real>{ 0, -50, 0 }, Vec3<Real>{ 1, 0, 0 }, invisible)); // Left
+            scene->addToScene(make_unique<Rectangle>(Vec3<Real>{ -25, 25, 0 }, Vec3<Real>{ 0, 0, -50 }, Vec3<Real>{ 50, 0, 0 }, Vec3<Real>{ 0, -1, 0 }, invisible)); // Top
 
-            scene->addToScene(make_unique<Rectangle>(Vec3<double>{ 25, -25, -50}, Vec3<double>{ -50, 0, 0 }, Vec3<double>{ 0, 50, 0 }, Vec3<double>{ 0, 0, -1 }, invisible)); // Back
-            scene->addToScene(make_unique<Rectangle>(Vec3<double>{ 25, -25, -50 }, Vec3<double>{ 0, 50, 0 }, Vec3<double>{ 0, 0, 50 }, Vec3<double>{ -1, 0, 0 }, invisible)); // Right
-            scene->addToScene(make_unique<Rectangle>(Vec3<double>{ 25, -25, -50 }, Vec3<double>{ -50, 0, 0 }, Vec3<double>{ 0, 0, 50 }, Vec3<double>{ 0, 1, 0 }, invisible)); // Bottom
+            scene->addToScene(make_unique<Rectangle>(Vec3<Real>{ 25, -25, -50}, Vec3<Real>{ -50, 0, 0 }, Vec3<Real>{ 0, 50, 0 }, Vec3<Real>{ 0, 0, -1 }, invisible)); // Back
+            scene->addToScene(make_unique<Rectangle>(Vec3<Real>{ 25, -25, -50 }, Vec3<Real>{ 0, 50, 0 }, Vec3<Real>{ 0, 0, 50 }, Vec3<Real>{ -1, 0, 0 }, invisible)); // Right
+            scene->addToScene(make_unique<Rectangle>(Vec3<Real>{ 25, -25, -50 }, Vec3<Real>{ -50, 0, 0 }, Vec3<Real>{ 0, 0, 50 }, Vec3<Real>{ 0, 1, 0 }, invisible)); // Bottom
 
             Matte greenMaterial;
             greenMaterial.setAmbientIntensity(0.0F);
@@ -93,12 +99,12 @@ namespace Smurf {
             yellow.setDiffuseIntensity(1.0F);
             yellow.setColor({ 1.0F, 1.0F, 1.0F });
 
-            scene->addToScene(make_unique<Sphere>(Vec3<double>(100000, 0, 0), 50, blueMaterial));
-            //scene->addToScene(make_unique<Sphere>(Vec3<double>(-300, 105, 0), 100, greenMaterial));
-            //scene->addToScene(make_unique<Plane>(Vec3<double>(0, -10, 0), Vec3<double>(0, 1, 0), Color(1.0, 1.0, 0.0), greenMaterial));
-            scene->addToScene(make_unique<Plane>(Vec3<double>(-100000, 0, 0), Vec3<double>(1, 0, 0), Color(1.0, 1.0, 0.0), yellow));
+            scene->addToScene(make_unique<Sphere>(Vec3<Real>(100000, 0, 0), 50, blueMaterial));
+            //scene->addToScene(make_unique<Sphere>(Vec3<Real>(-300, 105, 0), 100, greenMaterial));
+            //scene->addToScene(make_unique<Plane>(Vec3<Real>(0, -10, 0), Vec3<Real>(0, 1, 0), Color(1.0, 1.0, 0.0), greenMaterial));
+            scene->addToScene(make_unique<Plane>(Vec3<Real>(-100000, 0, 0), Vec3<Real>(1, 0, 0), Color(1.0, 1.0, 0.0), yellow));
 
-            //scene->addToScene(make_unique<Sphere>(Vec3<double>(-250, 0, 0), 4, blueMaterial));
+            //scene->addToScene(make_unique<Sphere>(Vec3<Real>(-250, 0, 0), 4, blueMaterial));
             //scene->addLight(PointLight{ { 1.0F, 0.0F, 0.0F }, 1.0F, { -250, 0, 0 } });
             scene->addLight(PointLight{ { 1.0F, 1.0F, 1.0F }, 1.0F, { -250, 250, 250 } });
             /*scene->addLight(PointLight{ { 0.0F, 1.0F, 0.0F }, 1.0F, { -211, 240, 40 } });
@@ -129,7 +135,7 @@ namespace Smurf {
             invisible.setDiffuseIntensity(1.0F);
             invisible.setColor({ 0.5F, 0.2F, 0.0F });
 
-            scene->addToScene(make_unique<Rectangle>(Vec3<double>{ -5000, 0, 0 }, Vec3<double>{ 0.1, 0, 0 }, Vec3<double>{ 0, 0.1, 0 }, Vec3<double>{ 0, 0, 1 }, invisible)); // Front
+            scene->addToScene(make_unique<Rectangle>(Vec3<Real>{ -5000, 0, 0 }, Vec3<Real>{ 0.1, 0, 0 }, Vec3<Real>{ 0, 0.1, 0 }, Vec3<Real>{ 0, 0, 1 }, invisible)); // Front
 
             Matte greenMaterial;
             greenMaterial.setAmbientIntensity(0.6F);
@@ -169,12 +175,12 @@ namespace Smurf {
             mMaterial.setSpecularExponent(15.0F);
             mMaterial.setSpecularIntensity(1.0F);
 
-            scene->addToScene(make_unique<Sphere>(Vec3<double>(-200, 100, -50), 110, blueMaterial));
-            scene->addToScene(make_unique<Sphere>(Vec3<double>(0, 100, 0), 110, yellow));
-            scene->addToScene(make_unique<Sphere>(Vec3<double>(200, 100, 50), 110, mMaterial));
-            scene->addToScene(make_unique<Sphere>(Vec3<double>(200, 100, 250), 110, nMaterial));
-            //scene->addToScene(make_unique<Plane>(Vec3<double>(0, -10, 0), Vec3<double>(0, 1, 0), Color(1.0, 1.0, 0.0), greenMatGlossy));
-            scene->addToScene(make_unique<Plane>(Vec3<double>(0, -10, 0), Vec3<double>(0, 1, 0), Color(1.0, 1.0, 0.0), greenMatGlossy));
+            scene->addToScene(make_unique<Sphere>(Vec3<Real>(-200, 100, -50), 110, blueMaterial));
+            scene->addToScene(make_unique<Sphere>(Vec3<Real>(0, 100, 0), 110, yellow));
+            scene->addToScene(make_unique<Sphere>(Vec3<Real>(200, 100, 50), 110, mMaterial));
+            scene->addToScene(make_unique<Sphere>(Vec3<Real>(200, 100, 250), 110, nMaterial));
+            //scene->addToScene(make_unique<Plane>(Vec3<Real>(0, -10, 0), Vec3<Real>(0, 1, 0), Color(1.0, 1.0, 0.0), greenMatGlossy));
+            scene->addToScene(make_unique<Plane>(Vec3<Real>(0, -10, 0), Vec3<Real>(0, 1, 0), Color(1.0, 1.0, 0.0), greenMatGlossy));
 
             scene->addLight(PointLight{ { 1.0F, 1.0F, 1.0F }, 1.0F, { -250, 250, 250 } });
             scene->addLight(PointLight{ { 1.0F, 1.0F, 1.0F }, 1.0F, { 250, 150, -250 } });
@@ -185,5 +191,228 @@ namespace Smurf {
             return scene;
         }
 
+        // Spheres on a floor under a ceiling of 256 dim point lights, brighter towards the middle - a stand-in for
+        // scenes with many lights
+        std::unique_ptr<Scene> constructManyLights() {
+            Camera camera{ {0.0, 300.0, 1000.0},
+            { 0.0, 50.0, 0.0 },
+            { 0, 1, 0 },
+            1000.0 };
+            auto scene = make_unique<Scene>(camera, Color{ 0.0F, 0.0F, 0.0F });
+
+            Matte white;
+            white.setAmbientIntensity(0.1F);
+            white.setDiffuseIntensity(1.0F);
+            white.setColor({ 1.0F, 1.0F, 1.0F });
+
+            Glossy red;
+            red.setAmbientIntensity(0.1F);
+            red.setDiffuseIntensity(0.7F);
+            red.setColor({ 0.75F, 0.1F, 0.1F });
+            red.setSpecularExponent(20.0F);
+            red.setSpecularIntensity(0.7F);
+
+            for (int i = 0; i < 5; ++i) {
+                const Vec3<Real> center(-400 + 200 * i, 60, -100 + 50 * (i % 2));
+                if (i % 2) {
+                    scene->addToScene(make_unique<Sphere>(center, 70, red));
+                } else {
+                    scene->addToScene(make_unique<Sphere>(center, 70, white));
+                }
+            }
+            scene->addToScene(make_unique<Plane>(Vec3<Real>(0, -10, 0), Vec3<Real>(0, 1, 0), Color(1.0, 1.0, 1.0), white));
+
+            const int gridSize = 16;
+            for (int row = 0; row < gridSize; ++row) {
+                for (int col = 0; col < gridSize; ++col) {
+                    const float x = -600.0F + 1200.0F * col / (gridSize - 1);
+                    const float z = -600.0F + 1200.0F * row / (gridSize - 1);
+                    const float falloff = 1.0F - (x * x + z * z) / (2 * 600.0F * 600.0F);
+                    const Color color{ 0.5F + 0.5F * col / gridSize, 0.8F, 0.5F + 0.5F * row / gridSize };
+                    scene->addLight(PointLight{ color, 4.0F * falloff / (gridSize * gridSize), { x, 400.0F, z } });
+                }
+            }
+            scene->ambientLight = AmbientLight{};
+
+            return scene;
+        }
+
+        // Nothing but planes, which the BVH leaves out - every path has to cope with a tree over no primitives at all
+        std::unique_ptr<Scene> constructPlanes() {
+            Camera camera{ { 0.0, 120.0, 500.0 },
+            { 0.0, 40.0, 0.0 },
+            { 0, 1, 0 },
+            500.0 };
+            auto scene = make_unique<Scene>(camera, Color{ 0.12F, 0.15F, 0.22F });
+
+            Matte floor;
+            floor.setAmbientIntensity(0.15F);
+            floor.setDiffuseIntensity(0.8F);
+            floor.setColor({ 0.9F, 0.9F, 0.85F });
+
+            Matte wall;
+            wall.setAmbientIntensity(0.15F);
+            wall.setDiffuseIntensity(0.8F);
+            wall.setColor({ 0.8F, 0.25F, 0.2F });
+
+            scene->addPlane({ 0, 0, 0 }, { 0, 1, 0 }, scene->addMaterial({ 0.9F, 0.9F, 0.85F }, floor));
+            scene->addPlane({ 0, 0, -250 }, { 0, 0, 1 }, scene->addMaterial({ 0.8F, 0.25F, 0.2F }, wall));
+
+            scene->addLight(PointLight{ { 1.0F, 0.95F, 0.9F }, 2.0F, { 150.0, 450.0, 300.0 } });
+
+            return scene;
+        }
+
+        // A mirror and a glass sphere between matte walls, the wavefront path's bounces are what makes them look the part
+        std::unique_ptr<Scene> constructMirrors() {
+            Camera camera{ { 0.0, 120.0, 500.0 },
+            { 0.0, 40.0, 0.0 },
+            { 0, 1, 0 },
+            500.0 };
+            auto scene = make_unique<Scene>(camera, Color{ 0.12F, 0.15F, 0.22F });
+
+            Matte floor;
+            floor.setAmbientIntensity(0.15F);
+            floor.setDiffuseIntensity(0.8F);
+            floor.setColor({ 0.9F, 0.9F, 0.85F });
+
+            Matte wall;
+            wall.setAmbientIntensity(0.15F);
+            wall.setDiffuseIntensity(0.8F);
+            wall.setColor({ 0.8F, 0.25F, 0.2F });
+
+            Reflective mirror;
+            mirror.setAmbientIntensity(0.05F);
+            mirror.setDiffuseIntensity(0.1F);
+            mirror.setColor({ 0.9F, 0.9F, 1.0F });
+            mirror.setSpecularIntensity(0.5F);
+            mirror.setSpecularExponent(100.0F);
+            mirror.setReflectiveIntensity(0.85F);
+
+            Transparent glass;
+            glass.setAmbientIntensity(0.0F);
+            glass.setDiffuseIntensity(0.0F);
+            glass.setSpecularIntensity(0.8F);
+            glass.setSpecularExponent(200.0F);
+            glass.setIor(1.5F);
+
+            Glossy green;
+            green.setAmbientIntensity(0.15F);
+            green.setDiffuseIntensity(0.8F);
+            green.setColor({ 0.2F, 0.7F, 0.3F });
+            green.setSpecularIntensity(0.4F);
+            green.setSpecularExponent(30.0F);
+
+            scene->addPlane({ 0, 0, 0 }, { 0, 1, 0 }, scene->addMaterial({ 0.9F, 0.9F, 0.85F }, floor));
+            scene->addRectangle({ -400, 0, -250 }, { 800, 0, 0 }, { 0, 400, 0 }, { 0, 0, 1 }, scene->addMaterial({ 0.8F, 0.25F, 0.2F }, wall));
+            scene->addSphere({ -130, 80, -60 }, 80, scene->addMaterial({ 0.9F, 0.9F, 1.0F }, mirror));
+            scene->addSphere({ 60, 60, 80 }, 60, scene->addMaterial({ 1.0F, 1.0F, 1.0F }, glass));
+            scene->addSphere({ 170, 45, -80 }, 45, scene->addMaterial({ 0.2F, 0.7F, 0.3F }, green));
+
+            scene->addLight(PointLight{ { 1.0F, 0.95F, 0.9F }, 2.0F, { 150.0, 450.0, 300.0 } });
+            scene->addLight(DirectionalLight{ { 0.6F, 0.7F, 1.0F }, 0.4F, { -1.0, 2.0, 1.0 } });
+            scene->ambientLight = AmbientLight{};
+
+            return scene;
+        }
+
+        // Torus around the y axis, lying flat - shared vertices on a rings * sides grid that wraps around both ways
+        void makeTorus(const Vec3<Real>& center, Real majorRadius, Real minorRadius, int rings, int sides,
+                       std::vector<Vec3<Real>>& vertices, std::vector<Vec3<Real>>& normals, std::vector<int>& indices) {
+            const Real twoPi = static_cast<Real>(6.283185307179586);
+            for (int ring = 0; ring < rings; ++ring) {
+                const Real u = twoPi * ring / rings;
+                for (int side = 0; side < sides; ++side) {
+                    const Real v = twoPi * side / sides;
+                    const Vec3<Real> normal{std::cos(v) * std::cos(u), std::sin(v), std::cos(v) * std::sin(u)};
+                    vertices.push_back(center + Vec3<Real>{majorRadius * std::cos(u), 0, majorRadius * std::sin(u)} + minorRadius * normal);
+                    normals.push_back(normal);
+                }
+            }
+            for (int ring = 0; ring < rings; ++ring) {
+                for (int side = 0; side < sides; ++side) {
+                    const int corner = ring * sides + side;
+                    const int nextSide = ring * sides + (side + 1) % sides;
+                    const int nextRing = ((ring + 1) % rings) * sides + side;
+                    const int nextBoth = ((ring + 1) % rings) * sides + (side + 1) % sides;
+                    indices.insert(std::end(indices), {corner, nextSide, nextRing, nextRing, nextSide, nextBoth});
+                }
+            }
+        }
+
+        // Triangle meshes - a smooth-shaded torus of some ten thousand triangles next to a flat-shaded pyramid
+        std::unique_ptr<Scene> constructMesh() {
+            Camera camera{ { 60.0, 260.0, 560.0 },
+            { 60.0, 30.0, 0.0 },
+            { 0, 1, 0 },
+            380.0 };
+            auto scene = make_unique<Scene>(camera, Color{ 0.12F, 0.15F, 0.22F });
+
+            Matte floor;
+            floor.setAmbientIntensity(0.15F);
+            floor.setDiffuseIntensity(0.8F);
+            floor.setColor({ 0.9F, 0.9F, 0.85F });
+
+            Glossy copper;
+            copper.setAmbientIntensity(0.1F);
+            copper.setDiffuseIntensity(0.7F);
+            copper.setColor({ 0.85F, 0.45F, 0.25F });
+            copper.setSpecularIntensity(0.5F);
+            copper.setSpecularExponent(40.0F);
+
+            Matte stone;
+            stone.setAmbientIntensity(0.15F);
+            stone.setDiffuseIntensity(0.8F);
+            stone.setColor({ 0.5F, 0.55F, 0.7F });
+
+            scene->addPlane({ 0, 0, 0 }, { 0, 1, 0 }, scene->addMaterial({ 0.9F, 0.9F, 0.85F }, floor));
+
+            std::vector<Vec3<Real>> vertices;
+            std::vector<Vec3<Real>> normals;
+            std::vector<int> indices;
+            makeTorus({ -40, 35, 0 }, 100, 35, 96, 48, vertices, normals, indices);
+            scene->addMesh(vertices, normals, indices, scene->addMaterial({ 0.85F, 0.45F, 0.25F }, copper));
+
+            // No normals, every face is shaded flat
+            scene->addToScene(Utils::make_unique<TriangleMesh>(std::vector<Vec3<Real>>{ { 130, 0, 40 }, { 230, 0, 40 }, { 230, 0, -60 }, { 130, 0, -60 }, { 180, 110, -10 } },
+                                                        std::vector<Vec3<Real>>{},
+                                                        std::vector<int>{ 0, 1, 4, 1, 2, 4, 2, 3, 4, 3, 0, 4 },
+                                                        stone));
+
+            scene->addLight(PointLight{ { 1.0F, 0.95F, 0.9F }, 2.0F, { 150.0, 450.0, 300.0 } });
+            scene->addLight(DirectionalLight{ { 0.6F, 0.7F, 1.0F }, 0.4F, { -1.0, 2.0, 1.0 } });
+            scene->ambientLight = AmbientLight{};
+
+            return scene;
+        }
+
+        // Sample scene by the name a render config refers to it with, or a scene file if the name ends in .scene
+        std::unique_ptr<Scene> construct(const std::string& name) {
+            if (SceneFile::isSceneFile(name)) return SceneFile::load(name);
+            if (name == "quasicube") return constructQuasiCube();
+            if (name == "spheres") return constructSampleSpheres();
+            if (name == "gpu0") return constructSceneGPU0();
+            if (name == "gpu2") return constructSceneGPU2();
+            if (name == "lights") return constructManyLights();
+            if (name == "mirrors") return constructMirrors();
+            if (name == "mesh") return constructMesh();
+            if (name == "planes") return constructPlanes();
+            throw std::runtime_error("Unknown scene: " + name);
+        }
+
+        // Mapped in from the cache file if that holds this scene, constructed and written to it otherwise
+        std::unique_ptr<Scene> constructCached(const std::string& name, const std::string& cacheFile) {
+            const qword sourceStamp = SceneFile::isSceneFile(name) ? SceneCache::sourceStamp(name) : 0;
+            if (std::ifstream(cacheFile)) {
+                try {
+                    return Scene::loadCache(cacheFile, name, sourceStamp);
+                } catch (const SceneCache::StaleCache& e) {
+                    std::cout << e.what() << ", rebuilding it." << std::endl;
+                }
+            }
+            auto scene = construct(name);
+            scene->saveCache(cacheFile, name, sourceStamp);
+            return scene;
+        }
     } // namespace Scenes
 } // namespace Smurf
\ No newline at end of file
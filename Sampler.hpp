@@ -1,121 +1,149 @@
 #pragma once
 
 #include "Vec2.hpp"
+#include "Vec3.hpp"
 #include "Wheels.hpp"
 #include "Settings.hpp"
+#include "Random.hpp"
+#include "SamplePatterns.hpp"
+#include "Simd.hpp"
 
-#include <array>
 #include <algorithm>
 #include <numeric>
 #include <vector>
+#include <cmath>
 
 namespace Smurf {
     class Sampler {
     public:
-        Sampler() : counter{0}, offset{0}, randomEngineLocalRef{Utils::RandomEngine::instance()} {
+        // For the jittered pattern numSamples has to be a perfect square, the samples are laid out on a grid
+        // The same seed always gives the same samples
+        explicit Sampler(int numSamples = Settings::NumSamples,
+                         int numSampleGroups = Settings::Internal::NumSampleGroups,
+                         unsigned seed = 0,
+                         SamplePattern pattern = SamplePattern::Jittered) : numSamples{numSamples},
+                                                                                     numSampleGroups{numSampleGroups},
+                                                                                     indices(numSamples * numSampleGroups),
+                                                                                     samples(numSamples * numSampleGroups),
+                                                                                     shirleyDiscSamples(numSamples * numSampleGroups),
+                                                                                     hemisphereSamples(numSamples * numSampleGroups),
+                                                                                     counter{0},
+                                                                                     offset{0},
+                                                                                     rng{seed, 0} {
             // Indices could be const but for the time being, it's too much of a hassle to random_shufle iota into initializer list
-            std::array<int, Settings::NumSamples> temp;
+            std::vector<int> temp(numSamples);
             std::iota(std::begin(temp), std::end(temp), 0);
-            for (int group = 0; group < Settings::Internal::NumSampleGroups; ++group) {
-                std::random_shuffle(std::begin(temp), std::end(temp));
-                for (int i = 0; i < Settings::NumSamples; ++i) {
-                    indices[group * Settings::NumSamples + i] = temp[i];
+            for (int group = 0; group < numSampleGroups; ++group) {
+                Random::shuffle(std::begin(temp), std::end(temp), rng);
+                for (int i = 0; i < numSamples; ++i) {
+                    indices[group * numSamples + i] = temp[i];
                 }
             }
-            generateJitteredSamples();
-            randomEngineLocalRef.setIntegralCustomRange(0, Settings::Internal::NumSampleGroups - 1);
+            if (pattern == SamplePattern::Jittered) {
+                generateJitteredSamples();
+            } else {
+                generatePatternSamples(pattern);
+            }
+            mapSamplesToDisc();
+            mapSamplesToHemisphere();
         }
 
         // Distribute samples over a unit suare
         Vec2<double> sampleAtomicSquare() {
-            if (counter % Settings::NumSamples == 0) {
-                offset = randomEngineLocalRef.randIntCustom() * Settings::NumSamples;
+            if (counter % numSamples == 0) {
+                offset = rng.nextInt(numSampleGroups) * numSamples;
             }
-            return samples[offset + indices[offset + counter++ % Settings::NumSamples]];
+            return samples[offset + indices[offset + counter++ % numSamples]];
         }
 
-        // Shirley's square to disc mapping
-        void sampleAtomicCircle() {
-            Vec2<double> samplePoint;
-            double radius;
-            double angle;
-            int idx = 0;
-            for (auto&& sample : samples) {
-                samplePoint.x = 2.0 * sample.x - 1.0;
-                samplePoint.y = 2.0 * sample.y - 1.0;
-                if (samplePoint.x > -samplePoint.y) {
-                    if (samplePoint.x > samplePoint.y) {
-                        radius = samplePoint.x;
-                        angle = samplePoint.y / samplePoint.x;
-                    } else {
-                        radius = samplePoint.y;
-                        angle = 2 - samplePoint.x / samplePoint.y;
-                    }
-                } else {
-                    if (samplePoint.x < samplePoint.y) {
-                        radius = -samplePoint.x;
-                        angle = 4 + samplePoint.y / samplePoint.x;
-                    } else {
-                        radius = -samplePoint.y;
-                        if (samplePoint.y == 0) {
-                            angle = 0;
-                        } else {
-                            angle = 6 - samplePoint.x / samplePoint.y;
-                        }
-                    }
-                }
-                angle *= PiQuarter;
-                shirleyDiscSamples[idx].x = cos(angle) * radius;
-                shirleyDiscSamples[idx].x = sin(angle) * radius;
-                ++idx;
-            }
+        const std::vector<Vec2<double>>& getSamples() const {
+            return samples;
         }
 
-        // Square to hemisphere mapping
-        void sampleAtomicHemisphere() {
-            int idx = 0;
-            const auto e = 1.0 / (1.0 + Settings::Internal::HemisphereMapFactor);
-            for (auto&& sample : samples) {
-                auto twoPiPhi = TwoPi * sample.x;
-                double cosAngle = cos(twoPiPhi);
-                double sinAngle = sin(twoPiPhi);
-                double cosPhi = pow((1.0 - samples[idx].y), e);
-                double sinPhi = sqrt(1.0 - cosPhi * cosPhi);
-                hemisphereSamples[idx] = Vec3<double>(sinPhi * cosAngle, sinPhi * sinAngle, cosPhi);
-                ++idx;
-            }
+        // Same layout as the square samples, so that the same indices pick them
+        const std::vector<Vec2<double>>& getDiscSamples() const {
+            return shirleyDiscSamples;
         }
 
-        const std::array<Vec2<double>, Settings::NumSamples * Settings::Internal::NumSampleGroups>& getSamples() const {
-            return samples;
+        const std::vector<Vec3<double>>& getHemisphereSamples() const {
+            return hemisphereSamples;
         }
 
-        const std::array<int, Settings::NumSamples * Settings::Internal::NumSampleGroups>& getIndices() const {
+        const std::vector<int>& getIndices() const {
             return indices;
         }
+
+        int getNumSamples() const {
+            return numSamples;
+        }
+
+        int getNumSampleGroups() const {
+            return numSampleGroups;
+        }
     private:
         // Jittered sampler
          void generateJitteredSamples() {
-            for (int group = 0; group < Settings::Internal::NumSampleGroups; ++group) {
-                for (int pRow = 0; pRow < CompileTime::SimpleSquareRoot<Settings::NumSamples>::value; ++pRow) {
-                    for (int pCol = 0; pCol < CompileTime::SimpleSquareRoot<Settings::NumSamples>::value; ++pCol) {
-                        samples[group * Settings::NumSamples
-                               + pRow * CompileTime::SimpleSquareRoot<Settings::NumSamples>::value
-                               + pCol] = {
-                                   (pCol + randomEngineLocalRef.randReal()) / CompileTime::SimpleSquareRoot<Settings::NumSamples>::value,
-                                   (pRow + randomEngineLocalRef.randReal()) / CompileTime::SimpleSquareRoot<Settings::NumSamples>::value
-                               };
+            const auto gridSize = static_cast<int>(std::lround(std::sqrt(numSamples)));
+            for (int group = 0; group < numSampleGroups; ++group) {
+                for (int pRow = 0; pRow < gridSize; ++pRow) {
+                    for (int pCol = 0; pCol < gridSize; ++pCol) {
+                        samples[group * numSamples + pRow * gridSize + pCol] = {
+                            (pCol + rng.nextDouble()) / gridSize,
+                            (pRow + rng.nextDouble()) / gridSize
+                        };
                     }
                 }
             }
         }
+
+        // Shirley's concentric square to disc mapping, in the form that needs one angle of at most pi/4 per sample
+        // Every loop in here runs over all samples at once without calls or branches, so that it vectorizes
+        void mapSamplesToDisc() {
+            for (std::size_t idx = 0; idx < samples.size(); ++idx) {
+                const double a = 2.0 * samples[idx].x - 1.0;
+                const double b = 2.0 * samples[idx].y - 1.0;
+                const bool horizontal = std::abs(a) > std::abs(b);
+                const double radius = horizontal ? a : b;
+                const double ratio = (horizontal ? b : a) / (radius != 0.0 ? radius : 1.0);
+                double sine;
+                double cosine;
+                Simd::sinCosQuarter(PiQuarter * ratio, sine, cosine);
+                shirleyDiscSamples[idx].x = radius * (horizontal ? cosine : sine);
+                shirleyDiscSamples[idx].y = radius * (horizontal ? sine : cosine);
+            }
+        }
+
+        // Square to hemisphere mapping, cosine weighted for the default HemisphereMapFactor of 1
+        void mapSamplesToHemisphere() {
+            const auto e = 1.0 / (1.0 + Settings::Internal::HemisphereMapFactor);
+            for (std::size_t idx = 0; idx < samples.size(); ++idx) {
+                double sinAngle;
+                double cosAngle;
+                Simd::sinCosTurns(samples[idx].x, sinAngle, cosAngle);
+                const double cosPhi = e == 0.5 ? std::sqrt(1.0 - samples[idx].y) : std::pow(1.0 - samples[idx].y, e);
+                const double sinPhi = std::sqrt(1.0 - cosPhi * cosPhi);
+                hemisphereSamples[idx] = Vec3<double>(sinPhi * cosAngle, sinPhi * sinAngle, cosPhi);
+            }
+        }
+
+        // Every sample-group a differently scrambled run of the pattern
+        void generatePatternSamples(SamplePattern pattern) {
+            for (int group = 0; group < numSampleGroups; ++group) {
+                const auto scramble = rng.nextUInt();
+                for (int i = 0; i < numSamples; ++i) {
+                    samples[group * numSamples + i] = SamplePatterns::generate(pattern, i, numSamples, scramble);
+                }
+            }
+        }
     private:
-        std::array<int, Settings::NumSamples * Settings::Internal::NumSampleGroups> indices;
-        std::array<Vec2<double>, Settings::NumSamples * Settings::Internal::NumSampleGroups> samples;
-        std::array<Vec2<double>, Settings::NumSamples * Settings::Internal::NumSampleGroups> shirleyDiscSamples;
-        std::array<Vec3<double>, Settings::NumSamples * Settings::Internal::NumSampleGroups> hemisphereSamples;
+        int numSamples;
+        int numSampleGroups;
+        std::vector<int> indices;
+        std::vector<Vec2<double>> samples;
+        std::vector<Vec2<double>> shirleyDiscSamples;
+        std::vector<Vec3<double>> hemisphereSamples;
         int counter;
         int offset;
-        Utils::RandomEngine& randomEngineLocalRef;
+        Random::CounterRng rng;
     };
 } // namespace Smurf
\ No newline at end of file
@@ -1,11 +1,12 @@
 #pragma once
 
 #include "GeometricObject.hpp"
+#include "GeometryStore.hpp"
 #include "Material.hpp"
 #include "Color.hpp"
 #include "Ray.hpp"
 #include "Pixel.hpp"
-#include "Bitmap.hpp"
+#include "FrameStream.hpp"
 #include "Timer.hpp"
 #include "Vec2.hpp"
 #include "Vec3.hpp"
@@ -14,486 +15,1823 @@
 #include "Camera.hpp"
 #include "BRDF.hpp"
 #include "Light.hpp"
-
-#ifdef USE_AMP
-#include <amp.h>
-#include <amp_math.h>
-#undef max
-#undef min
-#endif
+#include "BVH.hpp"
+#include "ThreadPool.hpp"
+#include "Tile.hpp"
+#include "Backend.hpp"
+#include "RayPacket.hpp"
+#include "Simd.hpp"
+#include "AdaptiveSampling.hpp"
+#include "LightSampling.hpp"
+#include "Wavefront.hpp"
+#include "RenderConfig.hpp"
+#include "RenderStats.hpp"
+#include "SceneCache.hpp"
+#include "Instrumentation.hpp"
 
 #include <vector>
+#include <limits>
 #include <memory>
 #include <fstream>
+#include <initializer_list>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 
 namespace Smurf {
     static const double PixelSize = 1.0;
     static const double HalfPixelSize = 0.5;
 
+    // The primitive that blocked each light's last shadow ray, tested first on the next one - neighbouring shading
+    // points tend to be shadowed by the same thing. Kept per thread of work, it's only a hint, so lights past
+    // MaxLights can share the last slot.
+    struct OcclusionCache {
+        static const int MaxLights = 8;
+        static const int None = -1;
+
+        OcclusionCache() restrict(cpu, amp) : ambient{None} {
+            for (int slot = 0; slot < MaxLights; ++slot) {
+                directional[slot] = None;
+                point[slot] = None;
+            }
+        }
+
+        int& forDirectional(int lightIdx) restrict(cpu, amp) {
+            return directional[lightIdx < MaxLights ? lightIdx : MaxLights - 1];
+        }
+
+        int& forPoint(int lightIdx) restrict(cpu, amp) {
+            return point[lightIdx < MaxLights ? lightIdx : MaxLights - 1];
+        }
+
+        // Ids are the BVH's primitive indices, spheres then rectangles then triangles, and -2 - i for plane i
+        int directional[MaxLights];
+        int point[MaxLights];
+        int ambient; // Shared by all ambient occlusion rays
+    };
+
+    // Kernel-side copies of a scene's materials, geometry, BVH and lights, everything a render reads but the sample
+    // tables and the camera. Made on the first render and kept until something is added or removed, frames of a batch
+    // share one. Objects changed in place are copied over slot by slot.
+    struct KernelScene {
+        KernelScene(const std::vector<g_Material>& materials, const std::vector<g_Sphere>& spheres, const std::vector<g_Plane>& planes,
+                    const std::vector<g_Rectangle>& rectangles, const std::vector<g_Triangle>& triangles,
+                    const std::vector<Vec3<Real>>& meshVertices, const std::vector<Vec3<Real>>& meshNormals,
+                    const std::vector<BVHNode>& bvhNodes, const std::vector<int>& bvhIndices,
+                    const std::vector<DirectionalLight>& directionalLights, const std::vector<PointLight>& pointLights,
+                    const std::vector<float>& pointLightCdf) :
+            numMaterials{static_cast<int>(materials.size())},
+            numSpheres{static_cast<int>(spheres.size())},
+            numPlanes{static_cast<int>(planes.size())},
+            numRects{static_cast<int>(rectangles.size())},
+            numTriangles{static_cast<int>(triangles.size())},
+            numMeshVertices{static_cast<int>(meshVertices.size())},
+            numBVHNodes{static_cast<int>(bvhNodes.size())},
+            numBVHIndices{static_cast<int>(bvhIndices.size())},
+            numDirLights{static_cast<int>(directionalLights.size())},
+            numPointLights{static_cast<int>(pointLights.size())},
+            materials{numMaterials, std::begin(materials), std::end(materials)},
+            spheres{numSpheres, std::begin(spheres), std::end(spheres)},
+            planes{numPlanes, std::begin(planes), std::end(planes)},
+            rectangles{numRects, std::begin(rectangles), std::end(rectangles)},
+            triangles{numTriangles, std::begin(triangles), std::end(triangles)},
+            meshVertices{numMeshVertices, std::begin(meshVertices), std::end(meshVertices)},
+            meshNormals{numMeshVertices, std::begin(meshNormals), std::end(meshNormals)},
+            bvhNodes{numBVHNodes, std::begin(bvhNodes), std::end(bvhNodes)},
+            bvhIndices{numBVHIndices, std::begin(bvhIndices), std::end(bvhIndices)},
+            directionalLights{numDirLights, std::begin(directionalLights), std::end(directionalLights)},
+            pointLights{numPointLights, std::begin(pointLights), std::end(pointLights)},
+            pointLightCdf{numPointLights, std::begin(pointLightCdf), std::end(pointLightCdf)} { }
+
+        const int numMaterials;
+        const int numSpheres;
+        const int numPlanes;
+        const int numRects;
+        const int numTriangles;
+        const int numMeshVertices;
+        const int numBVHNodes;
+        const int numBVHIndices;
+        const int numDirLights;
+        const int numPointLights;
+        Backend::array<g_Material, 1> materials;
+        Backend::array<g_Sphere, 1> spheres;
+        Backend::array<g_Plane, 1> planes;
+        Backend::array<g_Rectangle, 1> rectangles;
+        Backend::array<g_Triangle, 1> triangles;
+        Backend::array<Vec3<Real>, 1> meshVertices;
+        Backend::array<Vec3<Real>, 1> meshNormals;
+        Backend::array<BVHNode, 1> bvhNodes;
+        Backend::array<int, 1> bvhIndices;
+        Backend::array<DirectionalLight, 1> directionalLights;
+        Backend::array<PointLight, 1> pointLights;
+        Backend::array<float, 1> pointLightCdf;
+    };
+
     class Scene {
         Camera camera;
-        std::vector<std::unique_ptr<GeometricObject>> objects;
+        GeometryStore geometry;
+        MaterialTable materials;
         Color background;
         std::unique_ptr<Sampler> sampler;
         std::vector<PointLight> pointLights; // Void of inheritance for the time being, AMP's fault
         std::vector<DirectionalLight> directionalLights;
+        BVH objectBVH; // Spheres, rectangles and triangles in the geometry store's bounded index space
+        bool accelerationStructureDirty;
+        std::unique_ptr<KernelScene> kernelScene; // Dropped by anything that changes what it holds
+        HandleTable handles[static_cast<int>(ObjectKind::NumKinds)];
+        // Slots changed in place since the kernel-side copy was made, and the BVH nodes refit since
+        std::vector<int> changedSpheres;
+        std::vector<int> changedPlanes;
+        std::vector<int> changedRectangles;
+        std::vector<int> changedMeshes;
+        std::pair<int, int> changedNodes;
+        std::vector<int> movedPrimitives; // Bounded indices, refit into the BVH on its next build
+        RenderConfig config;
+        bool configured;
+        RenderStats lastStats;
     public:
         AmbientLight ambientLight;
 
-        Scene() : background{Color(0.0F, 0.0F, 0.0F)}, sampler{Utils::make_unique<Sampler>()} { }
-        Scene(Camera camera, Color bgColor) : camera{camera}, background{bgColor}, sampler{Utils::make_unique<Sampler>()} { }
-        
-        std::vector<Pixel> rayTraceScene() {
+        Scene() : background{Color(0.0F, 0.0F, 0.0F)}, sampler{Utils::make_unique<Sampler>()}, accelerationStructureDirty{true},
+                  changedNodes{0, -1}, configured{false} { }
+        Scene(Camera camera, Color bgColor) : camera{camera}, background{bgColor}, sampler{Utils::make_unique<Sampler>()}, accelerationStructureDirty{true},
+                                              changedNodes{0, -1}, configured{false} { }
+
+        // Takes effect from the next render on, the sampler is regenerated if the sampling settings changed
+        void configure(const RenderConfig& renderConfig) {
+            configure(renderConfig, !configured || !config.sharesSamples(renderConfig) ? makeSampler(renderConfig) : nullptr);
+        }
+
+        // With a sampler made ahead of time by makeSampler, null keeps the current one
+        void configure(const RenderConfig& renderConfig, std::unique_ptr<Sampler> preparedSampler) {
+            config = renderConfig;
+            configured = true;
+            if (preparedSampler) sampler = std::move(preparedSampler);
+            camera.setProjection(config.projection);
+            camera.setLens(config.lensRadius, config.focalDistance);
+            ambientLight.occlusionSamples = config.occlusionSamples;
+            ambientLight.occlusionDistance = config.occlusionDistance;
+        }
+
+        const RenderConfig& getConfig() const {
+            return config;
+        }
+
+        // The sample tables configure would make for renderConfig, safe to call from another thread while rendering
+        static std::unique_ptr<Sampler> makeSampler(const RenderConfig& renderConfig) {
+            return Utils::make_unique<Sampler>(renderConfig.numSamples, renderConfig.numSampleGroups, renderConfig.seed, renderConfig.pattern);
+        }
+
+        // The lens and projection come from the config, configure has to follow to apply them to a new camera
+        void setCamera(const Camera& newCamera) {
+            camera = newCamera;
+        }
+
+        const Camera& getCamera() const {
+            return camera;
+        }
+
+        // Ray counts and timings of the most recent render
+        const RenderStats& getLastStats() const {
+            return lastStats;
+        }
+
+        // Renders through whichever path the config asks for
+        // With a stream, the tiled paths write finished bands of the image out while the rest is still rendering
+        std::vector<Pixel> render(FrameStream* stream = nullptr) {
             std::vector<Pixel> result;
-            Ray ray;
-            ray.origin = camera.getEye();
-            Color resultColor = background;
-            Vec2<double> samplePoint;
-            Vec2<double> pixel;
+            switch (config.path) {
+                case RenderPath::Tiles:
+                    result = rayTraceScene(stream);
+                    break;
+                #ifndef USE_AMP
+                case RenderPath::Packets:
+                case RenderPath::Wavefront:
+                    result = rayTraceScenePackets(stream);
+                    break;
+                #endif
+                default:
+                    result = rayTraceSceneGPU();
+                    break;
+            }
+            if (stream) stream->flush(result);
+            return result;
+        }
+
+        // Renders straight into a bitmap file
+        std::vector<Pixel> renderToFile(const std::string& fileName) {
+            FrameStream stream(fileName, config.hRes, config.vRes, config.tileSize);
+            return render(&stream);
+        }
+
+        std::vector<Pixel> rayTraceScene(FrameStream* stream = nullptr) {
+            Timer setupTimer;
+            setupTimer.start();
+
+            // Preallocated framebuffer, every tile writes its own disjoint set of pixels
+            std::vector<Pixel> result(config.hRes * config.vRes);
+
+            // The sampler's running counter can't be shared between threads, every pixel picks its own sample-groups
+            const auto& samples = sampler->getSamples();
+            const auto& discSamples = sampler->getDiscSamples();
+            const auto& indices = sampler->getIndices();
+
+            const auto policy = config.getSamplingPolicy();
+
+            const auto tiles = makeTiles(config.hRes, config.vRes, config.tileSize);
 
-            std::cout << "Settings: \n" <<
-                         "Resolution: " << Settings::HRes << " * " << Settings::VRes << "\n" <<
-                         "Number of samples: " << Settings::NumSamples << std::endl;
+            buildAccelerationStructure();
+
+            std::vector<RayCounts> tileCounts(tiles.size());
+            std::vector<double> tileSeconds(tiles.size());
+            setupTimer.end();
 
             std::cout << "Raytracing (CPU)." << std::endl;
             Timer timer;
             timer.start();
 
-            for (int row = 0; row < Settings::VRes; ++row) {
-                for (int col = 0; col < Settings::HRes; ++col) {
-                    for (int sample = 0; sample < Settings::NumSamples; ++sample) {
-                        samplePoint = sampler->sampleAtomicSquare();
-                        pixel.x = col - HalfPixelSize * Settings::HRes + samplePoint.x;
-                        pixel.y = row - HalfPixelSize * Settings::VRes + samplePoint.y;
-                        ray.direction = camera.inferRayDirection(pixel);
-                        auto hit = hitAllObjects(ray);
-                        resultColor += hit ? hit->second : background;
+            Utils::ThreadPool::instance().parallelFor(static_cast<int>(tiles.size()), [&](int tileIdx) {
+                const auto& tile = tiles[tileIdx];
+                {
+                    Instrumentation::ScopeTimer tileTimer(tileSeconds, tileIdx);
+                    Ray ray;
+                    Vec2<double> pixel;
+                    RayHit hit;
+                    for (int row = tile.y0; row < tile.y1; ++row) {
+                        for (int col = tile.x0; col < tile.x1; ++col) {
+                            const int pixelIdx = row * config.hRes + col;
+                            const PixelSampler pixelSampler(policy, pixelIdx);
+                            const double cornerX = col - HalfPixelSize * config.hRes;
+                            const double cornerY = row - HalfPixelSize * config.vRes;
+                            PixelEstimate estimate;
+                            do {
+                                const auto samplePoint = pixelSampler.sample(samples, indices, policy, estimate.count);
+                                pixel.x = cornerX + samplePoint.x;
+                                pixel.y = cornerY + samplePoint.y;
+                                ray = camera.inferRay(pixel, pixelSampler.lensSample(discSamples, indices, policy, estimate.count));
+                                hit.tMin = RealMax;
+                                estimate.add(hitAllObjects(ray, hit) ? materials.getColor(hit.material) : background);
+                            } while (!estimate.isConverged(policy));
+                            tileCounts[tileIdx].primary += estimate.count;
+                            result[pixelIdx] = Pixel(estimate.average());
+                        }
                     }
-                    resultColor /= Settings::NumSamples;
-                    result.emplace_back(resultColor);
-                    resultColor = background;
                 }
-            }
+                if (stream) stream->tileFinished(tile, result);
+            });
 
             timer.end();
+            recordStats(setupTimer, timer, tileCounts);
+            #ifdef SMURF_INSTRUMENTED
+            lastStats.tileSeconds = std::move(tileSeconds);
+            #endif
 
-            std::cout << "Raytracing finished.\n" << "Time elapsed: " << timer.elapsed() << std::endl;  
+            std::cout << "Raytracing finished.\n" << timer.elapsed() << std::endl;
             return result;
         }
 
         std::vector<Pixel> rayTraceSceneGPU() {
-            // AMP-specific initialization
+            Timer setupTimer;
+            setupTimer.start();
+
+            // Backend-specific initialization
 
             // Ready-up the sampler and prepare indices
             const auto& samples = sampler->getSamples();
+            const auto& discSamples = sampler->getDiscSamples();
+            const auto& hemisphereSamples = sampler->getHemisphereSamples();
             const auto& indices = sampler->getIndices();
 
-            std::vector<int> offsets;
-            offsets.reserve(Settings::HRes * Settings::VRes);
-
-            // Randomize sample-groups used before launching the kernel
-            auto& randEngineRef = Utils::RandomEngine::instance();
-            randEngineRef.setIntegralCustomRange(0, Settings::Internal::NumSampleGroups - 1);
-            for (int i = 0; i < Settings::HRes * Settings::VRes; ++i) {
-                offsets.push_back(randEngineRef.randIntCustom());
-            }
-
             // Initialize pixels to black
-            std::vector<Color> initialScene(Settings::HRes * Settings::VRes);
-            
-            // De-virtualize objects
-            // TODO - Replace with emplace_back(std::move()) -> add proper rvalue ctors
-            std::vector<g_Sphere> spheres;
-            std::vector<g_Plane> planes;
-            std::vector<g_Rectangle> rectangles;
-            for (auto&& object: objects) {
-                if (dynamic_cast<Sphere*>(object.get())) {
-                    auto center = dynamic_cast<Sphere*>(object.get())->getCenter();
-                    auto radius = dynamic_cast<Sphere*>(object.get())->getRadius();
-                    auto temp = object.get();
-                    Matte matte;
-                    Glossy glossy;
-                    switch (temp->active) {
-                        case ActiveMaterial::ActiveMatte:
-                            matte = dynamic_cast<Sphere*>(temp)->matte;
-                            spheres.push_back(g_Sphere(center, radius, matte));
-                            break;
-                        case ActiveMaterial::ActiveGlossy:
-                            glossy = dynamic_cast<Sphere*>(temp)->glossy;
-                            spheres.push_back(g_Sphere(center, radius, glossy));
-                            break;
-                    } 
-                } else if (dynamic_cast<Plane*>(object.get())) {
-                    auto point = dynamic_cast<Plane*>(object.get())->getPoint();
-                    auto normal = dynamic_cast<Plane*>(object.get())->getNormal();
-                    auto temp = object.get();
-                    Matte matte;
-                    Glossy glossy;
-                    switch (temp->active) {
-                    case ActiveMaterial::ActiveMatte:
-                        matte = dynamic_cast<Plane*>(temp)->matte;
-                        planes.push_back(g_Plane(point, normal, matte));
-                        break;
-                    case ActiveMaterial::ActiveGlossy:
-                        glossy = dynamic_cast<Plane*>(temp)->glossy;
-                        planes.push_back(g_Plane(point, normal, glossy));
-                        break;
-                    }
-                } else {
-                    auto point = dynamic_cast<Rectangle*>(object.get())->getPoint();
-                    auto a = dynamic_cast<Rectangle*>(object.get())->getA();
-                    auto b = dynamic_cast<Rectangle*>(object.get())->getB();
-                    auto normal = dynamic_cast<Rectangle*>(object.get())->getNormal();
-                    auto temp = object.get();
-                    Matte matte;
-                    Glossy glossy;
-                    switch (temp->active) {
-                    case ActiveMaterial::ActiveMatte:
-                        matte = dynamic_cast<Rectangle*>(temp)->matte;
-                        rectangles.emplace_back(std::move(g_Rectangle(point, a, b, normal, matte)));
-                        break;
-                    case ActiveMaterial::ActiveGlossy:
-                        glossy = dynamic_cast<Rectangle*>(temp)->glossy;
-                        rectangles.emplace_back(std::move(g_Rectangle(point, a, b, normal, glossy)));
-                        break;
-                    }
-                }
-            }
+            std::vector<Color> initialScene(config.hRes * config.vRes);
+
+            // Scene data stays on the GPU between renders, only the sample tables are copied every time
+            const auto& kernelScene = getKernelScene();
+            const int numSpheres = kernelScene.numSpheres;
+            const int numPlanes = kernelScene.numPlanes;
+            const int numRects = kernelScene.numRects;
+            const int numDirLights = kernelScene.numDirLights;
+            const int numPointLights = kernelScene.numPointLights;
+            const auto& g_Materials = kernelScene.materials;
+            const auto& g_Spheres = kernelScene.spheres;
+            const auto& g_Planes = kernelScene.planes;
+            const auto& g_Rectangles = kernelScene.rectangles;
+            const auto& g_Triangles = kernelScene.triangles;
+            const auto& g_MeshVertices = kernelScene.meshVertices;
+            const auto& g_MeshNormals = kernelScene.meshNormals;
+            const auto& g_BVHNodes = kernelScene.bvhNodes;
+            const auto& g_BVHIndices = kernelScene.bvhIndices;
+            const auto& g_DirectionalLights = kernelScene.directionalLights;
+            const auto& g_PointLights = kernelScene.pointLights;
+            const auto& g_PointLightCdf = kernelScene.pointLightCdf;
 
-            const int numSpheres = spheres.size();
-            const int numPlanes = planes.size();
-            const int numRects = rectangles.size();
-            const int numDirLights = directionalLights.size();
-            const int numPointLights = pointLights.size();
-            
             // Copy to GPU
-            const Concurrency::array<int, 1> g_Offsets{Settings::HRes * Settings::VRes, std::begin(offsets), std::end(offsets)};
-            const Concurrency::array<int, 1> g_Indices{ Settings::NumSamples * Settings::Internal::NumSampleGroups, indices.data() };
-            const Concurrency::array<Vec2<double>, 1> g_Samples{Settings::NumSamples * Settings::Internal::NumSampleGroups, samples.data()};
-            const Concurrency::array<g_Sphere, 1> g_Spheres{numSpheres, std::begin(spheres), std::end(spheres)};
-            const Concurrency::array<g_Plane, 1> g_Planes{numPlanes, std::begin(planes), std::end(planes)};
-            const Concurrency::array<g_Rectangle, 1> g_Rectangles{numRects, std::begin(rectangles), std::end(rectangles)};
-            const Concurrency::array<DirectionalLight, 1> g_DirectionalLights{numDirLights, std::begin(directionalLights), std::end(directionalLights)};
-            const Concurrency::array<PointLight, 1> g_PointLights{numPointLights, std::begin(pointLights), std::end(pointLights)};
-            Concurrency::array_view<Color, 1> g_Result{Settings::HRes * Settings::VRes, initialScene};
-
-            // Pull out the camera settings
+            const Backend::array<int, 1> g_Indices{static_cast<int>(indices.size()), indices.data()};
+            const Backend::array<Vec2<double>, 1> g_Samples{static_cast<int>(samples.size()), samples.data()};
+            const Backend::array<Vec2<double>, 1> g_DiscSamples{static_cast<int>(discSamples.size()), discSamples.data()};
+            const Backend::array<Vec3<double>, 1> g_HemisphereSamples{static_cast<int>(hemisphereSamples.size()), hemisphereSamples.data()};
+            Backend::array_view<Color, 1> g_Result{config.hRes * config.vRes, initialScene};
+            std::vector<RayCounts> pixelCounts(config.hRes * config.vRes);
+            Backend::array_view<RayCounts, 1> g_RayCounts{config.hRes * config.vRes, pixelCounts};
+
+            // Pull out the camera and render settings
             const auto camera = this->camera;
+            const int hRes = config.hRes;
+            const int vRes = config.vRes;
+            const auto policy = config.getSamplingPolicy();
 
             // Pull out background and ambient light
             const auto bg = background;
             auto ambientLight = this->ambientLight;
 
-            // Compute reciprocal of NumSamples
-            const float oneOverNumSamples = 1.0F / Settings::NumSamples;
+            setupTimer.end();
 
-            std::cout << "Raytracing (GPU)." << std::endl;
+            std::cout << "Raytracing (" << Backend::name() << ")." << std::endl;
             Timer timer;
             timer.start();
 
-            // Raytrace
-            Concurrency::parallel_for_each(g_Result.extent, [=, &g_Samples,
-                                                                &g_Offsets,
+            // Raytrace - each work item takes a run of neighbouring pixels along a row, so the occlusion cache carries over
+            // from one to the next
+            const int RunLength = 8;
+            const int runsPerRow = (hRes + RunLength - 1) / RunLength;
+            Backend::parallel_for_each(Backend::extent<1>(runsPerRow * vRes), [=, &g_Samples,
+                                                                &g_DiscSamples,
+                                                                &g_HemisphereSamples,
                                                                 &g_Indices,
+                                                                &g_Materials,
                                                                 &g_Spheres,
                                                                 &g_Planes,
                                                                 &g_Rectangles,
+                                                                &g_Triangles,
+                                                                &g_MeshVertices,
+                                                                &g_MeshNormals,
+                                                                &g_BVHNodes,
+                                                                &g_BVHIndices,
                                                                 &g_DirectionalLights,
-                                                                &g_PointLights]
-            (Concurrency::index<1> idx) restrict(amp) {
-                Ray ray;
-                ray.origin = camera.getEye();
-                Color resultColor{bg};
-                Vec2<double> pixel;
-                for (int sample = 0; sample < Settings::NumSamples; ++sample) {
-                    auto samplePoint = g_Samples[g_Offsets[idx] * Settings::NumSamples + g_Indices[sample + g_Offsets[idx] * Settings::NumSamples]];
-                    pixel.x = (idx[0] % Settings::HRes) - 0.5 * Settings::HRes + samplePoint.x;                    
-                    pixel.y = (idx[0] / Settings::HRes) - 0.5 * Settings::VRes + samplePoint.y;
-                    ray.direction = camera.inferRayDirection(pixel);
-                    auto hit = g_hitAllObjects(ray, g_Spheres, g_Planes, g_Rectangles, numSpheres, numPlanes, numRects);
-                    resultColor += hit.hasHit ? dispatchMaterial(hit, ray,
-                                                                 ambientLight, g_Spheres, g_Planes, g_Rectangles, g_DirectionalLights,
-                                                                 g_PointLights, numSpheres, numPlanes, numRects, numDirLights, numPointLights)
-                                              : bg;
+                                                                &g_PointLights,
+                                                                &g_PointLightCdf]
+            (Backend::index<1> idx) restrict(amp) {
+                OcclusionCache occlusionCache;
+                const int row = idx[0] / runsPerRow;
+                const int firstCol = (idx[0] % runsPerRow) * RunLength;
+                const int endCol = firstCol + RunLength < hRes ? firstCol + RunLength : hRes;
+                for (int col = firstCol; col < endCol; ++col) {
+                    const int pixelIdx = row * hRes + col;
+                    Ray ray;
+                    const PixelSampler pixelSampler(policy, pixelIdx);
+                    PixelEstimate estimate;
+                    RayCounts counts;
+                    Vec2<double> pixel;
+                    const double cornerX = col - 0.5 * hRes;
+                    const double cornerY = row - 0.5 * vRes;
+                    do {
+                        auto samplePoint = pixelSampler.sample(g_Samples, g_Indices, policy, estimate.count);
+                        pixel.x = cornerX + samplePoint.x;
+                        pixel.y = cornerY + samplePoint.y;
+                        ray = camera.inferRay(pixel, pixelSampler.lensSample(g_DiscSamples, g_Indices, policy, estimate.count));
+                        ++counts.primary;
+                        auto hit = g_hitAllObjects(ray, g_Spheres, g_Planes, g_Rectangles, g_Triangles, g_MeshVertices, g_MeshNormals, g_BVHNodes, g_BVHIndices, numSpheres, numPlanes, numRects);
+                        const ShadingSampling shadingSampling{policy, pixelSampler, estimate.count, 0};
+                        estimate.add(hit.hasHit ? dispatchMaterial(hit, ray,
+                                                                   ambientLight, shadingSampling, g_Materials, g_HemisphereSamples, g_Indices,
+                                                                   g_Spheres, g_Planes, g_Rectangles, g_Triangles, g_MeshVertices, g_BVHNodes, g_BVHIndices, g_DirectionalLights,
+                                                                   g_PointLights, g_PointLightCdf, numSpheres, numPlanes, numRects, numDirLights, numPointLights,
+                                                                   occlusionCache, counts)
+                                                : bg);
+                    } while (!estimate.isConverged(policy));
+                    g_Result[pixelIdx] = estimate.average();
+                    g_RayCounts[pixelIdx] = counts;
                 }
-                resultColor *= oneOverNumSamples;
-                g_Result[idx] = resultColor;
             });
 
         timer.end();
         
         g_Result.synchronize();
-        std::cout << "Raytracing finished.\n" << "Time elapsed: " << timer.elapsed() << std::endl;
-        std::vector<Pixel> finalScene(std::begin(initialScene), std::end(initialScene));
-        return finalScene;
+        g_RayCounts.synchronize();
+        recordStats(setupTimer, timer, pixelCounts);
+        std::cout << "Raytracing finished.\n" << timer.elapsed() << std::endl;
+        // Colors to pixels is the only pass over the whole frame, the result is moved out from here on
+        return std::vector<Pixel>(std::begin(initialScene), std::end(initialScene));
+        }
+
+        #ifndef USE_AMP
+        // CPU-only - primary rays are traced in packets of adjacent pixels, shading stays per ray
+        // The wavefront path shares the setup, it runs whole paths through per-stage queues and intersects those in packets
+        // The tile kernels are compiled once per instruction set and the best one the machine supports is picked at runtime
+        std::vector<Pixel> rayTraceScenePackets(FrameStream* stream = nullptr) {
+            Timer setupTimer;
+            setupTimer.start();
+
+            const auto instructionSet = Simd::detectInstructionSet();
+
+            const auto& samples = sampler->getSamples();
+            const auto& discSamples = sampler->getDiscSamples();
+            const auto& hemisphereSamples = sampler->getHemisphereSamples();
+            const auto& indices = sampler->getIndices();
+
+            const auto& kernelScene = getKernelScene();
+            // Shading reads through arrays on every path
+            const Backend::array<Vec3<double>, 1> g_HemisphereSamples{static_cast<int>(hemisphereSamples.size()), hemisphereSamples.data()};
+            const Backend::array<int, 1> g_Indices{static_cast<int>(indices.size()), indices.data()};
+
+            const PacketContext context{camera, background, ambientLight, config.hRes, config.vRes, config.getSamplingPolicy(),
+                                        samples.data(), discSamples.data(), indices.data(), g_HemisphereSamples, g_Indices, kernelScene.materials,
+                                        kernelScene.spheres, kernelScene.planes, kernelScene.rectangles, kernelScene.triangles,
+                                        kernelScene.meshVertices, kernelScene.meshNormals, kernelScene.bvhNodes, kernelScene.bvhIndices,
+                                        kernelScene.directionalLights, kernelScene.pointLights, kernelScene.pointLightCdf,
+                                        kernelScene.numMaterials, kernelScene.numSpheres, kernelScene.numPlanes, kernelScene.numRects,
+                                        kernelScene.numDirLights, kernelScene.numPointLights, config.maxDepth};
+            const auto traceTile = pickTileTracer(config.path, instructionSet);
+
+            std::vector<Pixel> result(config.hRes * config.vRes);
+            const auto tiles = makeTiles(config.hRes, config.vRes, config.tileSize);
+
+            std::vector<RayCounts> tileCounts(tiles.size());
+            std::vector<double> tileSeconds(tiles.size());
+            setupTimer.end();
+
+            std::cout << "Raytracing (CPU " << (config.path == RenderPath::Wavefront ? "wavefront" : "packets") << ", "
+                      << Simd::name(instructionSet) << ", " << Simd::packetWidth(instructionSet) << " rays per packet)." << std::endl;
+            Timer timer;
+            timer.start();
+
+            Utils::ThreadPool::instance().parallelFor(static_cast<int>(tiles.size()), [&](int tileIdx) {
+                {
+                    Instrumentation::ScopeTimer tileTimer(tileSeconds, tileIdx);
+                    traceTile(context, tiles[tileIdx], result, tileCounts[tileIdx]);
+                }
+                if (stream) stream->tileFinished(tiles[tileIdx], result);
+            });
+
+            timer.end();
+            recordStats(setupTimer, timer, tileCounts);
+            #ifdef SMURF_INSTRUMENTED
+            lastStats.tileSeconds = std::move(tileSeconds);
+            #endif
+
+            std::cout << "Raytracing finished.\n" << timer.elapsed() << std::endl;
+            return result;
+        }
+        #endif
+
+        // Tile timings are only kept with instrumentation, the tiled paths hand them over after this
+        void recordStats(const Timer& setupTimer, const Timer& traceTimer, const std::vector<RayCounts>& counts) {
+            lastStats = RenderStats();
+            lastStats.add(counts);
+            lastStats.setupSeconds = setupTimer.seconds();
+            lastStats.traceSeconds = traceTimer.seconds();
         }
 
         void renderScene(const std::vector<Pixel>& scene) const {
-            std::ofstream bitmap;
-            bitmap.open(Utils::getTimestamp() + ".bmp", std::ios::binary);
-            bitmap << FileFormat::Bitmap(Settings::HRes, Settings::VRes, scene);
-            bitmap.close();
+            FrameStream stream(Utils::getTimestamp() + ".bmp", config.hRes, config.vRes, config.tileSize);
+            stream.flush(scene);
         }
 
-        boost::optional<std::pair<RayHit, Color>> hitAllObjects(const Ray& ray) const {
-            double closestObjectT = std::numeric_limits<double>::max();
-            int closestObjectIndex; // Cannot use to tell whether something's been hit as infinity as an option
+        // (Re)builds the BVH over spheres, rectangles and triangles if any have been added or removed since the last
+        // build. If they've only moved they're refit into it, unless more than a quarter did - then a build is about as
+        // cheap and makes a better tree.
+        void buildAccelerationStructure() {
+            std::sort(std::begin(movedPrimitives), std::end(movedPrimitives));
+            movedPrimitives.erase(std::unique(std::begin(movedPrimitives), std::end(movedPrimitives)), std::end(movedPrimitives));
+            if (!accelerationStructureDirty && 4 * static_cast<int>(movedPrimitives.size()) <= geometry.numBounded()) {
+                if (movedPrimitives.empty()) return;
+                const auto refit = objectBVH.refit(movedPrimitives, [this](int primitiveIdx) { return geometry.getBoundingBox(primitiveIdx); });
+                changedNodes = changedNodes.first <= changedNodes.second
+                             ? std::make_pair(std::min(changedNodes.first, refit.first), std::max(changedNodes.second, refit.second))
+                             : refit;
+                movedPrimitives.clear();
+                return;
+            }
+
+            std::vector<AABB> bounds;
+            bounds.reserve(geometry.numBounded());
+            for (int primitiveIdx = 0; primitiveIdx < geometry.numBounded(); ++primitiveIdx) {
+                bounds.push_back(geometry.getBoundingBox(primitiveIdx));
+            }
+            objectBVH.build(bounds);
+            accelerationStructureDirty = false;
+            movedPrimitives.clear();
+            kernelScene.reset();
+        }
+
+        // Closest hit nearer than hit.tMin, the caller's record is only touched if there is one
+        bool hitAllObjects(const Ray& ray, RayHit& hit) const {
             bool hasHit = false;
 
-            for (unsigned objectIdx = 0; objectIdx < objects.size(); ++objectIdx) {
-                auto hit = objects[objectIdx]->onRayCast(ray);
-                if (hit && hit->tMin < closestObjectT) {
-                    closestObjectT = hit->tMin;
-                    closestObjectIndex = objectIdx;
-                    hasHit = true;
-                }
+            // Planes are unbounded, streamed through linearly
+            const auto& planes = geometry.planes;
+            for (int planeIdx = 0; planeIdx < planes.size(); ++planeIdx) {
+                hasHit |= planes.onRayCast(planeIdx, ray, hit);
             }
 
-            if (!hasHit) return {};
+            // The traversal skips every node behind the closest hit so far
+            const auto& primitiveIndices = objectBVH.getPrimitiveIndices();
+            const WatertightRay watertight(ray);
+            BVHTraversal traversal(ray);
+            int first;
+            int count;
+            while (traversal.nextLeaf(objectBVH.getNodes(), ray, hit.tMin, first, count)) {
+                SMURF_COUNT(bvhLeaves);
+                for (int i = first; i < first + count; ++i) {
+                    hasHit |= geometry.onRayCast(primitiveIndices[i], ray, watertight, hit);
+                }
+            }
 
-            return {
-                std::make_pair(RayHit(closestObjectT), Color(objects[closestObjectIndex]->color))
-            };
+            return hasHit;
         }
 
-        friend g_RayHit g_hitAllObjects(const Ray ray, const Concurrency::array<g_Sphere>& spheres,
-                                        const Concurrency::array<g_Plane>& planes,
-                                        const Concurrency::array<g_Rectangle>& rectangles,
+        static g_RayHit g_hitAllObjects(const Ray ray, const Backend::array<g_Sphere>& spheres,
+                                        const Backend::array<g_Plane>& planes,
+                                        const Backend::array<g_Rectangle>& rectangles,
+                                        const Backend::array<g_Triangle>& triangles,
+                                        const Backend::array<Vec3<Real>>& vertices,
+                                        const Backend::array<Vec3<Real>>& normals,
+                                        const Backend::array<BVHNode>& bvhNodes,
+                                        const Backend::array<int>& bvhIndices,
                                         int numSpheres,
                                         int numPlanes,
                                         int numRects) restrict(amp) {       
             g_RayHit result;
-            result.tMin = 1.79769e+308;
+            result.tMin = RealMax;
             result.hasHit = false;
-            enum class PrimitiveHit { Sphere, Plane, Rectangle } lastHitType;
+            enum class PrimitiveHit { Sphere, Plane, Rectangle, Triangle } lastHitType;
             unsigned lastHitIdx;
 
-            // horrible - difficult to work with Concurrency::arrays, begin and end can't really be taken
-            #define REGISTER_PRIMITIVE(container, primitiveFullEnumName, size) \
+            // horrible - difficult to work with Backend::arrays, begin and end can't really be taken
+            // Only result.tMin is narrowed down on the way, normal and material are filled in for the winner at the end
+            #define REGISTER_PRIMITIVE(container, primitiveFullEnumName, counted, size) \
                 for (int i = 0; i < size; ++i) { \
-                    auto hit = OnRayCastAspect::onRayCast(container[i], ray); \
-                        if (hit && hit.tMin < result.tMin) { \
-                            result.tMin = hit.tMin; \
-                            lastHitType = primitiveFullEnumName; \
-                            lastHitIdx = i; \
-                            result.hasHit = true; \
-                            result.active = hit.active; \
-                            result.hitPoint = ray.origin + hit.tMin * ray.direction; \
-                            result.normal = hit.normal; \
-                        } \
-                    }
+                    SMURF_COUNT(intersectionTests[counted]); \
+                    if (OnRayCastAspect::onRayCast(container[i], ray, result.tMin)) { \
+                        SMURF_COUNT(intersectionHits[counted]); \
+                        lastHitType = primitiveFullEnumName; \
+                        lastHitIdx = i; \
+                        result.hasHit = true; \
+                    } \
+                }
 
-            REGISTER_PRIMITIVE(spheres, PrimitiveHit::Sphere, numSpheres);
-            REGISTER_PRIMITIVE(planes, PrimitiveHit::Plane, numPlanes);
-            REGISTER_PRIMITIVE(rectangles, PrimitiveHit::Rectangle, numRects);
+            REGISTER_PRIMITIVE(planes, PrimitiveHit::Plane, Instrumentation::Plane, numPlanes);
 
             #undef REGISTER_PRIMITIVE
 
+            // Spheres, rectangles and triangles live in the BVH, in that order
+            #define REGISTER_BVH_PRIMITIVE(container, primitiveFullEnumName, counted, i) \
+                SMURF_COUNT(intersectionTests[counted]); \
+                if (OnRayCastAspect::onRayCast(container[i], ray, result.tMin)) { \
+                    SMURF_COUNT(intersectionHits[counted]); \
+                    lastHitType = primitiveFullEnumName; \
+                    lastHitIdx = i; \
+                    result.hasHit = true; \
+                }
+
+            const WatertightRay watertight(ray);
+            BVHTraversal traversal(ray);
+            int first;
+            int count;
+            while (traversal.nextLeaf(bvhNodes, ray, result.tMin, first, count)) {
+                SMURF_COUNT(bvhLeaves);
+                for (int slot = first; slot < first + count; ++slot) {
+                    int primitiveIdx = bvhIndices[slot];
+                    if (primitiveIdx < numSpheres) {
+                        REGISTER_BVH_PRIMITIVE(spheres, PrimitiveHit::Sphere, Instrumentation::Sphere, primitiveIdx);
+                    } else if (primitiveIdx < numSpheres + numRects) {
+                        REGISTER_BVH_PRIMITIVE(rectangles, PrimitiveHit::Rectangle, Instrumentation::Rectangle, primitiveIdx - numSpheres);
+                    } else {
+                        // Triangles read their corners from the vertex buffer, the ray's watertight setup is shared
+                        const int triangleIdx = primitiveIdx - numSpheres - numRects;
+                        SMURF_COUNT(intersectionTests[Instrumentation::Triangle]);
+                        if (OnRayCastAspect::onRayCast(triangles[triangleIdx], vertices, watertight, result.tMin)) {
+                            SMURF_COUNT(intersectionHits[Instrumentation::Triangle]);
+                            lastHitType = PrimitiveHit::Triangle;
+                            lastHitIdx = triangleIdx;
+                            result.hasHit = true;
+                        }
+                    }
+                }
+            }
+
+            #undef REGISTER_BVH_PRIMITIVE
+
             if (!result.hasHit) return result;
 
             switch (lastHitType) {
                 case PrimitiveHit::Sphere:
-                    switch (result.active) {
-                        case ActiveMaterial::ActiveMatte:
-                            result.matte = spheres[lastHitIdx].matte;
-                            break;
-                        case ActiveMaterial::ActiveGlossy:
-                            result.glossy = spheres[lastHitIdx].glossy;
-                            break;
-                    }
+                    resolveHit(spheres[lastHitIdx], ray, result);
                     break;
                 case PrimitiveHit::Plane:
-                    switch (result.active) {
-                        case ActiveMaterial::ActiveMatte:
-                            result.matte = planes[lastHitIdx].matte;
-                            break;
-                        case ActiveMaterial::ActiveGlossy:
-                            result.glossy = planes[lastHitIdx].glossy;
-                            break;
-                    }
+                    resolveHit(planes[lastHitIdx], ray, result);
                     break;
                 case PrimitiveHit::Rectangle:
-                    switch (result.active) {
-                        case ActiveMaterial::ActiveMatte:
-                            result.matte = rectangles[lastHitIdx].matte;
-                            break;
-                        case ActiveMaterial::ActiveGlossy:
-                            result.glossy = rectangles[lastHitIdx].glossy;
-                            break;
-                    }
+                    resolveHit(rectangles[lastHitIdx], ray, result);
+                    break;
+                case PrimitiveHit::Triangle:
+                    resolveHit(triangles[lastHitIdx], vertices, normals, ray, result);
                     break;
             }
 
             return result;
         }
 
-        friend Color shade(const Matte material,
+        // Fills in everything but the distance once the closest primitive is known
+        template <typename Primitive>
+        static void resolveHit(const Primitive& primitive, const Ray& ray, g_RayHit& hit) restrict(amp) {
+            hit.hitPoint = ray.origin + hit.tMin * ray.direction;
+            hit.normal = OnRayCastAspect::getNormal(primitive, hit.hitPoint);
+            hit.material = primitive.material;
+        }
+
+        // Triangles need the mesh buffers for their corners and, if smooth, their vertex normals
+        static void resolveHit(const g_Triangle& triangle, const Backend::array<Vec3<Real>>& vertices,
+                               const Backend::array<Vec3<Real>>& normals, const Ray& ray, g_RayHit& hit) restrict(amp) {
+            hit.hitPoint = ray.origin + hit.tMin * ray.direction;
+            hit.normal = OnRayCastAspect::getNormal(triangle, vertices, normals, ray);
+            hit.material = triangle.material;
+        }
+
+        // Every material model goes through here, the record's type decides which BRDF terms it evaluates
+        static Color shade(const g_Material& material,
                            const Ray ray,
-                           const Vec3<double> normal,
-                           const Vec3<double> hitPoint,
+                           const Vec3<Real> normal,
+                           const Vec3<Real> hitPoint,
                            const AmbientLight ambientLight,
-                           const Concurrency::array<g_Sphere>& spheres,
-                           const Concurrency::array<g_Plane>& planes,
-                           const Concurrency::array<g_Rectangle>& rectangles,
-                           const Concurrency::array<DirectionalLight>& directionalLights,
-                           const Concurrency::array<PointLight>& pointLights,
+                           const ShadingSampling& shadingSampling,
+                           const Backend::array<Vec3<double>>& hemisphereSamples,
+                           const Backend::array<int>& sampleIndices,
+                           const Backend::array<g_Sphere>& spheres,
+                           const Backend::array<g_Plane>& planes,
+                           const Backend::array<g_Rectangle>& rectangles,
+                           const Backend::array<g_Triangle>& triangles,
+                           const Backend::array<Vec3<Real>>& vertices,
+                           const Backend::array<BVHNode>& bvhNodes,
+                           const Backend::array<int>& bvhIndices,
+                           const Backend::array<DirectionalLight>& directionalLights,
+                           const Backend::array<PointLight>& pointLights,
+                           const Backend::array<float>& pointLightCdf,
                            const int numSpheres,
                            const int numPlanes,
                            const int numRects,
                            const int numDirectionalLights,
-                           const int numPointLights) restrict(amp) {
+                           const int numPointLights,
+                           OcclusionCache& occlusionCache,
+                           RayCounts& counts) restrict(amp) {
             auto flippedDirection = -ray.direction;
-            auto result = material.getBrdfAmbient().rho() * ambientLight.getRadiance();
+            auto result = material.ambient.rho() * ambientLight.getRadiance()
+                        * ambientVisibility(normal, hitPoint, ambientLight, shadingSampling, hemisphereSamples, sampleIndices,
+                                            spheres, planes, rectangles, triangles, vertices, bvhNodes, bvhIndices, numSpheres, numPlanes, numRects,
+                                            occlusionCache.ambient, counts);
 
             for (int dirLight = 0; dirLight < numDirectionalLights; ++dirLight) {
                 auto direction = directionalLights[dirLight].getDirection();
                 auto normalDotDirection = normal * direction;
                 if (normalDotDirection > 0.0) {
-                    Ray shadowRay(hitPoint, direction);
-                    if (inShadow(spheres, planes, rectangles, shadowRay, directionalLights[dirLight], numSpheres, numPlanes, numRects)) {
+                    Ray shadowRay(offsetFromSurface(hitPoint, normal), direction);
+                    ++counts.shadow;
+                    SMURF_COUNT(shadowRays[Instrumentation::Directional][Instrumentation::lightSlot(dirLight)]);
+                    if (inShadow(spheres, planes, rectangles, triangles, vertices, bvhNodes, bvhIndices, shadowRay, directionalLights[dirLight],
+                                 occlusionCache.forDirectional(dirLight), numSpheres, numPlanes, numRects)) {
+                        SMURF_COUNT(shadowOccluded[Instrumentation::Directional][Instrumentation::lightSlot(dirLight)]);
                         continue;
                     }
-                    result += material.getBrdfDiffuse().diffuseF() * directionalLights[dirLight].getRadiance() * static_cast<float>(normalDotDirection);
+                    result += material.diffuseF(normal, flippedDirection, direction) * directionalLights[dirLight].getRadiance()
+                        * static_cast<float>(normalDotDirection);
+                } else {
+                    SMURF_COUNT(lightsFacingAway);
                 }
             }
 
-            for (int pointLight = 0; pointLight < numPointLights; ++pointLight) {
+            LightSampling::PointLightPicks picks(shadingSampling, numPointLights);
+            for (int pickIdx = 0; pickIdx < picks.count; ++pickIdx) {
+                float weight;
+                const int pointLight = picks.next(pointLightCdf, pickIdx, weight);
                 auto direction = pointLights[pointLight].getDirection(hitPoint);
                 auto normalDotDirection = normal * direction;
-                    Ray shadowRay(hitPoint, direction);
-                    if (inShadow(spheres, planes, rectangles, shadowRay, pointLights[pointLight], numSpheres, numPlanes, numRects)) {
+                if (normalDotDirection > 0.0) {
+                    Ray shadowRay(offsetFromSurface(hitPoint, normal), direction);
+                    ++counts.shadow;
+                    SMURF_COUNT(shadowRays[Instrumentation::Point][Instrumentation::lightSlot(pointLight)]);
+                    if (inShadow(spheres, planes, rectangles, triangles, vertices, bvhNodes, bvhIndices, shadowRay, pointLights[pointLight],
+                                 occlusionCache.forPoint(pointLight), numSpheres, numPlanes, numRects)) {
+                        SMURF_COUNT(shadowOccluded[Instrumentation::Point][Instrumentation::lightSlot(pointLight)]);
                         continue;
                     }
-                if (normalDotDirection > 0.0) {
-                    result += material.getBrdfDiffuse().diffuseF() * pointLights[pointLight].getRadiance() * static_cast<float>(normalDotDirection);
+                    result += material.diffuseF(normal, flippedDirection, direction) * pointLights[pointLight].getRadiance()
+                        * (weight * static_cast<float>(normalDotDirection));
+                } else {
+                    SMURF_COUNT(lightsFacingAway);
                 }
             }
 
             return result;
         }
 
-        friend Color shade(const Glossy glossy,
-                           const Ray ray,
-                           const Vec3<double> normal,
-                           const Vec3<double> hitPoint,
-                           const AmbientLight ambientLight,
-                           const Concurrency::array<g_Sphere>& spheres,
-                           const Concurrency::array<g_Plane>& planes,
-                           const Concurrency::array<g_Rectangle>& rectangles,
-                           const Concurrency::array<DirectionalLight>& directionalLights,
-                           const Concurrency::array<PointLight>& pointLights,
-                           const int numSpheres,
-                           const int numPlanes,
-                           const int numRects,
-                           const int numDirectionalLights,
-                           const int numPointLights) restrict(amp) {
-            auto flippedDirection = -ray.direction;
-            auto result = glossy.getBrdfAmbient().rho() * ambientLight.getRadiance();
+        // The hit's material id picks the record out of the material table
+        static Color dispatchMaterial(const g_RayHit& hit, Ray ray,
+                                      AmbientLight ambientLight,
+                                      const ShadingSampling& shadingSampling,
+                                      const Backend::array<g_Material>& materials,
+                                      const Backend::array<Vec3<double>>& hemisphereSamples,
+                                      const Backend::array<int>& sampleIndices,
+                                      const Backend::array<g_Sphere>& spheres,
+                                      const Backend::array<g_Plane>& planes,
+                                      const Backend::array<g_Rectangle>& rectangles,
+                                      const Backend::array<g_Triangle>& triangles,
+                                      const Backend::array<Vec3<Real>>& vertices,
+                                      const Backend::array<BVHNode>& bvhNodes,
+                                      const Backend::array<int>& bvhIndices,
+                                      const Backend::array<DirectionalLight>& g_DirectionalLights,
+                                      const Backend::array<PointLight>& g_PointLights,
+                                      const Backend::array<float>& pointLightCdf,
+                                      int numSpheres, int numPlanes, int numRects,
+                                      int numDirLights, int numPointLights,
+                                      OcclusionCache& occlusionCache,
+                                      RayCounts& counts) restrict(amp) {
+            const auto& material = materials[hit.material];
+            SMURF_COUNT(materialDispatches[material.type]);
+            return shade(material, ray, hit.normal, hit.hitPoint,
+                         ambientLight, shadingSampling, hemisphereSamples, sampleIndices,
+                         spheres, planes, rectangles, triangles, vertices, bvhNodes, bvhIndices, g_DirectionalLights, g_PointLights, pointLightCdf,
+                         numSpheres, numPlanes, numRects, numDirLights, numPointLights, occlusionCache, counts);
+        }
 
-            for (int dirLight = 0; dirLight < numDirectionalLights; ++dirLight) {
-                const auto& direction = directionalLights[dirLight].getDirection();
+        // Shadow rays are occlusion queries up to the light, point lights are as far away as they are
+        static bool inShadow(const Backend::array<g_Sphere>& spheres,
+                             const Backend::array<g_Plane>& planes,
+                             const Backend::array<g_Rectangle>& rectangles,
+                             const Backend::array<g_Triangle>& triangles,
+                             const Backend::array<Vec3<Real>>& vertices,
+                             const Backend::array<BVHNode>& bvhNodes,
+                             const Backend::array<int>& bvhIndices,
+                             Ray ray,
+                             const PointLight& light,
+                             int& lastOccluder,
+                             const int numSpheres, const int numPlanes, const int numRects) restrict(amp) {
+            return occluded(spheres, planes, rectangles, triangles, vertices, bvhNodes, bvhIndices, ray, light.location.distance(ray.origin), lastOccluder, numSpheres, numPlanes, numRects);
+        }
+
+        // Directional lights are infinitely far away
+        static bool inShadow(const Backend::array<g_Sphere>& spheres,
+                             const Backend::array<g_Plane>& planes,
+                             const Backend::array<g_Rectangle>& rectangles,
+                             const Backend::array<g_Triangle>& triangles,
+                             const Backend::array<Vec3<Real>>& vertices,
+                             const Backend::array<BVHNode>& bvhNodes,
+                             const Backend::array<int>& bvhIndices,
+                             Ray ray,
+                             const DirectionalLight&,
+                             int& lastOccluder,
+                             const int numSpheres, const int numPlanes, const int numRects) restrict(amp) {
+            return occluded(spheres, planes, rectangles, triangles, vertices, bvhNodes, bvhIndices, ray, RealMax, lastOccluder, numSpheres, numPlanes, numRects);
+        }
+
+        // Share of the ambient light reaching a shading point, 1 unless the ambient light is set to occlude
+        // The occlusion rays go along the premapped hemisphere samples, turned from around +z to around the normal
+        static float ambientVisibility(const Vec3<Real> normal,
+                                       const Vec3<Real> hitPoint,
+                                       const AmbientLight ambientLight,
+                                       const ShadingSampling& shadingSampling,
+                                       const Backend::array<Vec3<double>>& hemisphereSamples,
+                                       const Backend::array<int>& sampleIndices,
+                                       const Backend::array<g_Sphere>& spheres,
+                                       const Backend::array<g_Plane>& planes,
+                                       const Backend::array<g_Rectangle>& rectangles,
+                                       const Backend::array<g_Triangle>& triangles,
+                                       const Backend::array<Vec3<Real>>& vertices,
+                                       const Backend::array<BVHNode>& bvhNodes,
+                                       const Backend::array<int>& bvhIndices,
+                                       const int numSpheres,
+                                       const int numPlanes,
+                                       const int numRects,
+                                       int& lastOccluder,
+                                       RayCounts& counts) restrict(amp) {
+            const int numRays = ambientLight.occlusionSamples;
+            if (numRays == 0) return 1.0F;
+
+            Vec3<Real> tangent;
+            Vec3<Real> bitangent;
+            tangentFrame(normal, tangent, bitangent);
+            const auto origin = offsetFromSurface(hitPoint, normal);
+
+            int unoccluded = 0;
+            for (int rayIdx = 0; rayIdx < numRays; ++rayIdx) {
+                const auto sample = shadingSampling.pixelSampler.occlusionSample(hemisphereSamples, sampleIndices, shadingSampling.policy,
+                                                                                 shadingSampling.sampleIdx, rayIdx, numRays);
+                const Ray ray(origin, static_cast<Real>(sample.x) * bitangent + static_cast<Real>(sample.y) * tangent
+                                             + static_cast<Real>(sample.z) * normal);
+                ++counts.shadow;
+                if (!occluded(spheres, planes, rectangles, triangles, vertices, bvhNodes, bvhIndices, ray, ambientLight.occlusionDistance, lastOccluder, numSpheres, numPlanes, numRects)) {
+                    ++unoccluded;
+                }
+            }
+            return ambientLight.minAmount + (1.0F - ambientLight.minAmount) * unoccluded / numRays;
+        }
+
+        // Any-hit query - is anything at all closer than tMax along the ray
+        // lastOccluder goes first and is updated to whatever blocked the ray, it's left alone when nothing did
+        static bool occluded(const Backend::array<g_Sphere>& spheres,
+                             const Backend::array<g_Plane>& planes,
+                             const Backend::array<g_Rectangle>& rectangles,
+                             const Backend::array<g_Triangle>& triangles,
+                             const Backend::array<Vec3<Real>>& vertices,
+                             const Backend::array<BVHNode>& bvhNodes,
+                             const Backend::array<int>& bvhIndices,
+                             Ray ray,
+                             Real tMax,
+                             int& lastOccluder,
+                             const int numSpheres, const int numPlanes, const int numRects) restrict(amp) {
+            if (lastOccluder != OcclusionCache::None && blocks(spheres, planes, rectangles, triangles, vertices, lastOccluder, ray, tMax, numSpheres, numRects)) {
+                SMURF_COUNT(occluderCacheHits);
+                return true;
+            }
+
+            for (int i = 0; i < numPlanes; ++i) {
+                SMURF_COUNT(intersectionTests[Instrumentation::Plane]);
+                auto hit = OnRayCastAspect::onShadowRayCast(planes[i], ray);
+                if (hit && hit.t < tMax) {
+                    SMURF_COUNT(intersectionHits[Instrumentation::Plane]);
+                    lastOccluder = -2 - i;
+                    return true;
+                }
+            }
+            return anyHitBVH(spheres, rectangles, triangles, vertices, bvhNodes, bvhIndices, ray, tMax, lastOccluder, numSpheres, numRects);
+        }
+
+        // Whether a single primitive, by OcclusionCache id, is closer than tMax along the ray
+        static bool blocks(const Backend::array<g_Sphere>& spheres,
+                           const Backend::array<g_Plane>& planes,
+                           const Backend::array<g_Rectangle>& rectangles,
+                           const Backend::array<g_Triangle>& triangles,
+                           const Backend::array<Vec3<Real>>& vertices,
+                           int occluder, Ray ray, Real tMax, const int numSpheres, const int numRects) restrict(amp) {
+            auto hit = occluder < 0 ? OnRayCastAspect::onShadowRayCast(planes[-2 - occluder], ray)
+                     : occluder < numSpheres ? OnRayCastAspect::onShadowRayCast(spheres[occluder], ray)
+                     : occluder < numSpheres + numRects ? OnRayCastAspect::onShadowRayCast(rectangles[occluder - numSpheres], ray)
+                                                        : OnRayCastAspect::onShadowRayCast(triangles[occluder - numSpheres - numRects], vertices, WatertightRay(ray));
+            return hit && hit.t < tMax;
+        }
+
+        // Any-hit query, bails out on the first sphere, rectangle or triangle closer than tMax and leaves it in occluder
+        static bool anyHitBVH(const Backend::array<g_Sphere>& spheres,
+                              const Backend::array<g_Rectangle>& rectangles,
+                              const Backend::array<g_Triangle>& triangles,
+                              const Backend::array<Vec3<Real>>& vertices,
+                              const Backend::array<BVHNode>& bvhNodes,
+                              const Backend::array<int>& bvhIndices,
+                              Ray ray,
+                              Real tMax,
+                              int& occluder,
+                              const int numSpheres,
+                              const int numRects) restrict(amp) {
+            if (bvhNodes[0].isEmptyRoot()) return false;
+
+            const WatertightRay watertight(ray);
+            BVHTraversal traversal(ray);
+            int first;
+            int count;
+            while (traversal.nextLeaf(bvhNodes, ray, tMax, first, count)) {
+                SMURF_COUNT(shadowBvhLeaves);
+                for (int slot = first; slot < first + count; ++slot) {
+                    int primitiveIdx = bvhIndices[slot];
+                    const auto type = primitiveIdx < numSpheres ? Instrumentation::Sphere
+                                    : primitiveIdx < numSpheres + numRects ? Instrumentation::Rectangle : Instrumentation::Triangle;
+                    auto hit = type == Instrumentation::Sphere ? OnRayCastAspect::onShadowRayCast(spheres[primitiveIdx], ray)
+                             : type == Instrumentation::Rectangle ? OnRayCastAspect::onShadowRayCast(rectangles[primitiveIdx - numSpheres], ray)
+                                                                  : OnRayCastAspect::onShadowRayCast(triangles[primitiveIdx - numSpheres - numRects], vertices, watertight);
+                    SMURF_COUNT(intersectionTests[type]);
+                    if (hit && hit.t < tMax) {
+                        SMURF_COUNT(intersectionHits[type]);
+                        occluder = primitiveIdx;
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+    private:
+        // Kernel-side copies of the geometry store, materials stay indices into materials.getKernelMaterials()
+        // Triangles keep indexing into the store's vertex and normal buffers, those go to the kernels as they are
+        void devirtualizeObjects(std::vector<g_Sphere>& spheres, std::vector<g_Plane>& planes, std::vector<g_Rectangle>& rectangles,
+                                 std::vector<g_Triangle>& triangles) const {
+            spheres.reserve(geometry.spheres.size());
+            for (int i = 0; i < geometry.spheres.size(); ++i) {
+                spheres.push_back(kernelSphere(i));
+            }
+            planes.reserve(geometry.planes.size());
+            for (int i = 0; i < geometry.planes.size(); ++i) {
+                planes.push_back(kernelPlane(i));
+            }
+            rectangles.reserve(geometry.rectangles.size());
+            for (int i = 0; i < geometry.rectangles.size(); ++i) {
+                rectangles.push_back(kernelRectangle(i));
+            }
+            triangles.reserve(geometry.triangles.size());
+            for (int i = 0; i < geometry.triangles.size(); ++i) {
+                triangles.push_back(kernelTriangle(i));
+            }
+        }
+
+        g_Sphere kernelSphere(int idx) const {
+            const auto& spheres = geometry.spheres;
+            return {spheres.getCenter(idx), spheres.radii[idx], spheres.materials[idx]};
+        }
+
+        g_Plane kernelPlane(int idx) const {
+            const auto& planes = geometry.planes;
+            return {planes.getPoint(idx), planes.getNormal(idx), planes.materials[idx]};
+        }
+
+        g_Rectangle kernelRectangle(int idx) const {
+            const auto& rectangles = geometry.rectangles;
+            return {rectangles.getPoint(idx), rectangles.getA(idx), rectangles.getB(idx), rectangles.getNormal(idx), rectangles.materials[idx]};
+        }
+
+        g_Triangle kernelTriangle(int idx) const {
+            const auto& triangles = geometry.triangles;
+            return {triangles.v0[idx], triangles.v1[idx], triangles.v2[idx], triangles.materials[idx], triangles.smoothFlags[idx]};
+        }
+
+        // Copies the scene over for the kernels, unless the copy from an earlier render is still current - then only
+        // what changed in place since is copied into it
+        const KernelScene& getKernelScene() {
+            buildAccelerationStructure();
+            if (kernelScene) {
+                uploadChanges();
+                return *kernelScene;
+            }
+            std::vector<g_Sphere> spheres;
+            std::vector<g_Plane> planes;
+            std::vector<g_Rectangle> rectangles;
+            std::vector<g_Triangle> triangles;
+            devirtualizeObjects(spheres, planes, rectangles, triangles);
+            kernelScene = Utils::make_unique<KernelScene>(materials.getKernelMaterials(), spheres, planes, rectangles, triangles,
+                                                          geometry.triangles.vertices, geometry.triangles.normals,
+                                                          objectBVH.getNodes(), getKernelBVHIndices(),
+                                                          directionalLights, pointLights, LightSampling::powerCdf(pointLights));
+            clearChanges();
+            return *kernelScene;
+        }
+
+        void uploadChanges() {
+            auto& kernel = *kernelScene;
+            uploadSlots(changedSpheres, kernel.spheres, [this](int idx) { return kernelSphere(idx); });
+            uploadSlots(changedPlanes, kernel.planes, [this](int idx) { return kernelPlane(idx); });
+            uploadSlots(changedRectangles, kernel.rectangles, [this](int idx) { return kernelRectangle(idx); });
+            for (const int mesh : changedMeshes) {
+                const auto& range = geometry.triangles.meshes[mesh];
+                Backend::copyInto(std::begin(geometry.triangles.vertices) + range.firstVertex, range.numVertices, kernel.meshVertices, range.firstVertex);
+                Backend::copyInto(std::begin(geometry.triangles.normals) + range.firstVertex, range.numVertices, kernel.meshNormals, range.firstVertex);
+                std::vector<g_Triangle> triangles;
+                triangles.reserve(range.numTriangles);
+                for (int i = range.firstTriangle; i < range.firstTriangle + range.numTriangles; ++i) {
+                    triangles.push_back(kernelTriangle(i));
+                }
+                Backend::copyInto(std::begin(triangles), range.numTriangles, kernel.triangles, range.firstTriangle);
+            }
+            if (changedNodes.first <= changedNodes.second) {
+                Backend::copyInto(std::begin(objectBVH.getNodes()) + changedNodes.first, changedNodes.second - changedNodes.first + 1,
+                                  kernel.bvhNodes, changedNodes.first);
+            }
+            clearChanges();
+        }
+
+        // One copy per run of neighbouring slots
+        template <typename Record, typename MakeRecord>
+        static void uploadSlots(std::vector<int>& slots, Backend::array<Record, 1>& kernelArray, const MakeRecord& makeRecord) {
+            std::sort(std::begin(slots), std::end(slots));
+            slots.erase(std::unique(std::begin(slots), std::end(slots)), std::end(slots));
+            std::vector<Record> run;
+            for (std::size_t i = 0; i < slots.size(); ) {
+                const int first = slots[i];
+                run.clear();
+                while (i < slots.size() && slots[i] == first + static_cast<int>(run.size())) {
+                    run.push_back(makeRecord(slots[i++]));
+                }
+                Backend::copyInto(std::begin(run), static_cast<int>(run.size()), kernelArray, first);
+            }
+        }
+
+        void clearChanges() {
+            changedSpheres.clear();
+            changedPlanes.clear();
+            changedRectangles.clear();
+            changedMeshes.clear();
+            changedNodes = {0, -1};
+        }
+
+        // The BVH's primitive index list, padded as AMP doesn't do empty arrays - the dummy is never reached as
+        // traversal stops right at an empty tree's root
+        std::vector<int> getKernelBVHIndices() const {
+            auto bvhIndices = objectBVH.getPrimitiveIndices();
+            if (bvhIndices.empty()) bvhIndices.push_back(0);
+            return bvhIndices;
+        }
+
+        // Handles to slots and back stay in here, callers go through the add, update and remove functions that check them
+        HandleTable& handlesOf(ObjectKind kind) {
+            return handles[static_cast<int>(kind)];
+        }
+
+        int slotOf(ObjectHandle handle, ObjectKind kind) const {
+            if (handle.kind != kind) throw std::runtime_error("Object handle refers to another kind of object");
+            return handles[static_cast<int>(kind)].slot(handle.id);
+        }
+
+        // The sections of a loaded cache have to agree with each other before any index in them is trusted
+        void checkRestored() const {
+            const auto sameSize = [](std::size_t expected, std::initializer_list<std::size_t> sizes) {
+                for (auto size : sizes) {
+                    if (size != expected) throw SceneCache::StaleCache("Scene cache sections disagree on their sizes");
+                }
+            };
+            const auto& spheres = geometry.spheres;
+            sameSize(spheres.radii.size(), {spheres.centerX.size(), spheres.centerY.size(), spheres.centerZ.size(), spheres.materials.size()});
+            const auto& planes = geometry.planes;
+            sameSize(planes.materials.size(), {planes.pointX.size(), planes.pointY.size(), planes.pointZ.size(),
+                                               planes.normalX.size(), planes.normalY.size(), planes.normalZ.size()});
+            const auto& rectangles = geometry.rectangles;
+            sameSize(rectangles.materials.size(), {rectangles.pointX.size(), rectangles.pointY.size(), rectangles.pointZ.size(),
+                                                   rectangles.aX.size(), rectangles.aY.size(), rectangles.aZ.size(),
+                                                   rectangles.bX.size(), rectangles.bY.size(), rectangles.bZ.size(),
+                                                   rectangles.normalX.size(), rectangles.normalY.size(), rectangles.normalZ.size(),
+                                                   rectangles.aLengthSquared.size(), rectangles.bLengthSquared.size()});
+            const auto& triangles = geometry.triangles;
+            sameSize(triangles.materials.size(), {triangles.v0.size(), triangles.v1.size(), triangles.v2.size(), triangles.smoothFlags.size()});
+            sameSize(triangles.vertices.size(), {triangles.normals.size()});
+            sameSize(static_cast<std::size_t>(materials.size()), {materials.getColors().size()});
+            sameSize(static_cast<std::size_t>(geometry.numBounded()), {objectBVH.getPrimitiveIndices().size()});
+            if (objectBVH.getNodes().empty()) throw SceneCache::StaleCache("Scene cache has no BVH");
+
+            const auto inRange = [](const std::vector<int>& indices, int size) {
+                for (int index : indices) {
+                    if (index < 0 || index >= size) throw SceneCache::StaleCache("Scene cache refers past the end of a section");
+                }
+            };
+            inRange(spheres.materials, materials.size());
+            inRange(planes.materials, materials.size());
+            inRange(rectangles.materials, materials.size());
+            inRange(triangles.materials, materials.size());
+            const int numVertices = static_cast<int>(triangles.vertices.size());
+            inRange(triangles.v0, numVertices);
+            inRange(triangles.v1, numVertices);
+            inRange(triangles.v2, numVertices);
+            // Meshes follow one another without gaps, covering every triangle and vertex
+            int nextTriangle = 0;
+            int nextVertex = 0;
+            for (const auto& mesh : triangles.meshes) {
+                if (mesh.firstTriangle != nextTriangle || mesh.firstVertex != nextVertex || mesh.numTriangles <= 0 || mesh.numVertices < 0) {
+                    throw SceneCache::StaleCache("Scene cache has broken mesh ranges");
+                }
+                nextTriangle += mesh.numTriangles;
+                nextVertex += mesh.numVertices;
+            }
+            if (nextTriangle != triangles.size() || nextVertex != numVertices) throw SceneCache::StaleCache("Scene cache has broken mesh ranges");
+            inRange(objectBVH.getPrimitiveIndices(), geometry.numBounded());
+            // A tree over nothing is just its childless root
+            const int numNodes = static_cast<int>(objectBVH.getNodes().size());
+            if (numNodes == 0) throw SceneCache::StaleCache("Scene cache has a broken BVH");
+            for (const auto& node : objectBVH.getNodes()) {
+                const bool valid = node.isLeaf() ? node.leftOrFirst >= 0 && node.leftOrFirst + node.primitiveCount <= geometry.numBounded()
+                                 : node.isEmptyRoot() ? numNodes == 1 && geometry.numBounded() == 0
+                                                      : node.leftOrFirst > 0 && node.leftOrFirst + 1 < numNodes;
+                if (!valid) throw SceneCache::StaleCache("Scene cache has a broken BVH");
+            }
+        }
+
+        #ifndef USE_AMP
+        // Everything the packet kernels read, bundled so the per instruction set entry points stay short
+        struct PacketContext {
+            const Camera& camera;
+            const Color background;
+            const AmbientLight ambientLight;
+            const int hRes;
+            const int vRes;
+            const SamplingPolicy policy;
+            const Vec2<double>* samples;
+            const Vec2<double>* discSamples;
+            const int* indices;
+            const Backend::array<Vec3<double>>& hemisphereSamples;
+            const Backend::array<int>& sampleIndices;
+            const Backend::array<g_Material>& materials;
+            const Backend::array<g_Sphere>& spheres;
+            const Backend::array<g_Plane>& planes;
+            const Backend::array<g_Rectangle>& rectangles;
+            const Backend::array<g_Triangle>& triangles;
+            const Backend::array<Vec3<Real>>& meshVertices;
+            const Backend::array<Vec3<Real>>& meshNormals;
+            const Backend::array<BVHNode>& bvhNodes;
+            const Backend::array<int>& bvhIndices;
+            const Backend::array<DirectionalLight>& directionalLights;
+            const Backend::array<PointLight>& pointLights;
+            const Backend::array<float>& pointLightCdf;
+            const int numMaterials;
+            const int numSpheres;
+            const int numPlanes;
+            const int numRects;
+            const int numDirLights;
+            const int numPointLights;
+            const int maxDepth;
+        };
+
+        using TileTracer = void (*)(const PacketContext&, const Tile&, std::vector<Pixel>&, RayCounts&);
+
+        static TileTracer pickTileTracer(RenderPath path, Simd::InstructionSet instructionSet) {
+            const bool wavefront = path == RenderPath::Wavefront;
+            switch (instructionSet) {
+                case Simd::InstructionSet::AVX512:
+                    return wavefront ? traceTileWavefrontAVX512 : traceTilePacketsAVX512;
+                case Simd::InstructionSet::AVX2:
+                    return wavefront ? traceTileWavefrontAVX2 : traceTilePacketsAVX2;
+                default:
+                    return wavefront ? traceTileWavefrontSSE2 : traceTilePacketsSSE2;
+            }
+        }
+
+        // Rows of the tile are cut into packets of N adjacent pixels, all lanes of a packet take the same sample index
+        // Lanes past the tile's right edge are masked off from the start, lanes whose pixel has converged from then on
+        template <int N>
+        static void traceTilePackets(const PacketContext& context, const Tile& tile, std::vector<Pixel>& result, RayCounts& counts) {
+            RayPacket<N> rays;
+            PacketHit<N> hit;
+            PixelEstimate estimates[N];
+            PixelSampler pixelSamplers[N];
+            OcclusionCache occlusionCache;
+            bool laneActive[N];
+            Ray laneRays[N];
+            g_RayHit laneHits[N];
+            int shadingOrder[N];
+            // View plane position of every lane's pixel corner, the samples only add their offset within the pixel
+            double laneX[N];
+            alignas(64) Real pixelX[N];
+            alignas(64) Real pixelY[N];
+            alignas(64) Real lensX[N];
+            alignas(64) Real lensY[N];
+            const bool hasLens = context.camera.hasLens();
+
+            for (int row = tile.y0; row < tile.y1; ++row) {
+                const double rowY = row - HalfPixelSize * context.vRes;
+                for (int col = tile.x0; col < tile.x1; col += N) {
+                    const int numLanes = std::min(N, tile.x1 - col);
+                    for (int lane = 0; lane < N; ++lane) {
+                        const int laneCol = col + std::min(lane, numLanes - 1);
+                        estimates[lane] = PixelEstimate();
+                        pixelSamplers[lane] = PixelSampler(context.policy, row * context.hRes + laneCol);
+                        laneX[lane] = laneCol - HalfPixelSize * context.hRes;
+                    }
+
+                    for (int sample = 0; ; ++sample) {
+                        bool anyActive = false;
+                        for (int lane = 0; lane < N; ++lane) {
+                            laneActive[lane] = lane < numLanes && !estimates[lane].isConverged(context.policy);
+                            anyActive |= laneActive[lane];
+                        }
+                        if (!anyActive) break;
+
+                        // Gather every lane's sample, then turn them all into rays in one pass
+                        for (int lane = 0; lane < N; ++lane) {
+                            const auto samplePoint = pixelSamplers[lane].sample(context.samples, context.indices, context.policy, sample);
+                            pixelX[lane] = static_cast<Real>(laneX[lane] + samplePoint.x);
+                            pixelY[lane] = static_cast<Real>(rowY + samplePoint.y);
+                            if (hasLens) {
+                                const auto lensSample = pixelSamplers[lane].lensSample(context.discSamples, context.indices, context.policy, sample);
+                                lensX[lane] = static_cast<Real>(lensSample.x);
+                                lensY[lane] = static_cast<Real>(lensSample.y);
+                            }
+                        }
+                        context.camera.generateRays(N, pixelX, pixelY, lensX, lensY, rays.arrays());
+                        rays.updateInverses();
+
+                        hit.reset();
+                        for (int lane = 0; lane < N; ++lane) {
+                            hit.active[lane] = laneActive[lane];
+                        }
+                        PacketAspect::hitAllObjects(rays, hit, context.spheres, context.planes, context.rectangles,
+                                                    context.triangles, context.meshVertices, context.bvhNodes, context.bvhIndices,
+                                                    context.numSpheres, context.numPlanes, context.numRects);
+
+                        // Resolve every lane's hit first, lanes are shaded ordered by material id after that, so that
+                        // runs of lanes go through the same BRDF with the same record
+                        int numShaded = 0;
+                        for (int lane = 0; lane < numLanes; ++lane) {
+                            if (!laneActive[lane]) continue;
+                            ++counts.primary;
+                            laneRays[lane] = rays.get(lane);
+                            auto& laneHit = laneHits[lane];
+                            laneHit = g_RayHit();
+                            laneHit.tMin = hit.tMin[lane];
+                            laneHit.hasHit = hit.type[lane] != PacketPrimitive::None;
+                            switch (hit.type[lane]) {
+                                case PacketPrimitive::Sphere:
+                                    resolveHit(context.spheres[hit.primitive[lane]], laneRays[lane], laneHit);
+                                    break;
+                                case PacketPrimitive::Plane:
+                                    resolveHit(context.planes[hit.primitive[lane]], laneRays[lane], laneHit);
+                                    break;
+                                case PacketPrimitive::Rectangle:
+                                    resolveHit(context.rectangles[hit.primitive[lane]], laneRays[lane], laneHit);
+                                    break;
+                                case PacketPrimitive::Triangle:
+                                    resolveHit(context.triangles[hit.primitive[lane]], context.meshVertices, context.meshNormals, laneRays[lane], laneHit);
+                                    break;
+                                default:
+                                    break;
+                            }
+                            int slot = numShaded++;
+                            for (; slot > 0 && laneHits[shadingOrder[slot - 1]].material > laneHit.material; --slot) {
+                                shadingOrder[slot] = shadingOrder[slot - 1];
+                            }
+                            shadingOrder[slot] = lane;
+                        }
+
+                        for (int shaded = 0; shaded < numShaded; ++shaded) {
+                            const int lane = shadingOrder[shaded];
+                            const auto& laneHit = laneHits[lane];
+                            const ShadingSampling shadingSampling{context.policy, pixelSamplers[lane], sample, 0};
+                            estimates[lane].add(laneHit.hasHit ? dispatchMaterial(laneHit, laneRays[lane], context.ambientLight, shadingSampling,
+                                                                                  context.materials, context.hemisphereSamples, context.sampleIndices,
+                                                                                  context.spheres, context.planes, context.rectangles,
+                                                                                  context.triangles, context.meshVertices,
+                                                                                  context.bvhNodes, context.bvhIndices,
+                                                                                  context.directionalLights, context.pointLights, context.pointLightCdf,
+                                                                                  context.numSpheres, context.numPlanes, context.numRects,
+                                                                                  context.numDirLights, context.numPointLights, occlusionCache, counts)
+                                                               : context.background);
+                        }
+                    }
+
+                    for (int lane = 0; lane < numLanes; ++lane) {
+                        result[row * context.hRes + col + lane] = Pixel(estimates[lane].average());
+                    }
+                }
+            }
+        }
+
+        SMURF_TARGET("avx512f,avx2,fma")
+        static void traceTilePacketsAVX512(const PacketContext& context, const Tile& tile, std::vector<Pixel>& result, RayCounts& counts) {
+            traceTilePackets<Simd::PacketWidthAVX512>(context, tile, result, counts);
+        }
+
+        SMURF_TARGET("avx2,fma")
+        static void traceTilePacketsAVX2(const PacketContext& context, const Tile& tile, std::vector<Pixel>& result, RayCounts& counts) {
+            traceTilePackets<Simd::PacketWidthAVX2>(context, tile, result, counts);
+        }
+
+        static void traceTilePacketsSSE2(const PacketContext& context, const Tile& tile, std::vector<Pixel>& result, RayCounts& counts) {
+            traceTilePackets<Simd::PacketWidthSSE2>(context, tile, result, counts);
+        }
+
+        // Whole paths instead of camera rays. Every round starts one path for each pixel of the tile that still wants
+        // samples, and all of them are pushed through the stages one bounce at a time until none is left. Each stage is
+        // one loop over its own queue. Extend intersects N rays at a time as packets. Shade goes through the hits grouped
+        // by material. Shadow answers every occlusion query the shading asked for. Paths that end just drop out of the
+        // next extend queue.
+        template <int N>
+        static void traceTileWavefront(const PacketContext& context, const Tile& tile, std::vector<Pixel>& result, RayCounts& counts) {
+            struct TilePixel {
+                int idx;
+                PixelSampler sampler;
+                PixelEstimate estimate;
+                double cornerX;
+                double cornerY;
+            };
+            std::vector<TilePixel> pixels;
+            pixels.reserve((tile.y1 - tile.y0) * (tile.x1 - tile.x0));
+            for (int row = tile.y0; row < tile.y1; ++row) {
+                for (int col = tile.x0; col < tile.x1; ++col) {
+                    const int pixelIdx = row * context.hRes + col;
+                    pixels.push_back({pixelIdx, PixelSampler(context.policy, pixelIdx), PixelEstimate(),
+                                      col - HalfPixelSize * context.hRes, row - HalfPixelSize * context.vRes});
+                }
+            }
+
+            std::vector<Wavefront::Path> paths;
+            std::vector<Wavefront::ExtendItem> extendQueue;
+            std::vector<Wavefront::ExtendItem> nextExtendQueue;
+            std::vector<Wavefront::ShadeItem> shadeQueue;
+            std::vector<Wavefront::ShadowItem> shadowQueue;
+            std::vector<int> shadeOrder;
+            std::vector<int> materialStarts(context.numMaterials + 1);
+            // Camera samples in, camera rays out - structure of arrays for the batched ray generation
+            std::vector<Real> cameraRays[10];
+            OcclusionCache occlusionCache;
+            RayPacket<N> rays;
+            PacketHit<N> hit;
+            const bool hasLens = context.camera.hasLens();
+
+            for (int sample = 0; ; ++sample) {
+                paths.clear();
+                for (auto& values : cameraRays) values.clear();
+                for (int slot = 0; slot < static_cast<int>(pixels.size()); ++slot) {
+                    auto& pixel = pixels[slot];
+                    if (pixel.estimate.isConverged(context.policy)) continue;
+                    paths.push_back({slot, {1.0F, 1.0F, 1.0F}, {}});
+                    const auto samplePoint = pixel.sampler.sample(context.samples, context.indices, context.policy, sample);
+                    cameraRays[0].push_back(static_cast<Real>(pixel.cornerX + samplePoint.x));
+                    cameraRays[1].push_back(static_cast<Real>(pixel.cornerY + samplePoint.y));
+                    const auto lensSample = hasLens ? pixel.sampler.lensSample(context.discSamples, context.indices, context.policy, sample)
+                                                    : Vec2<double>{0.0, 0.0};
+                    cameraRays[2].push_back(static_cast<Real>(lensSample.x));
+                    cameraRays[3].push_back(static_cast<Real>(lensSample.y));
+                }
+                if (paths.empty()) break;
+
+                const int numPaths = static_cast<int>(paths.size());
+                for (int component = 4; component < 10; ++component) cameraRays[component].resize(numPaths);
+                context.camera.generateRays(numPaths, cameraRays[0].data(), cameraRays[1].data(), cameraRays[2].data(), cameraRays[3].data(),
+                                            {cameraRays[4].data(), cameraRays[5].data(), cameraRays[6].data(),
+                                             cameraRays[7].data(), cameraRays[8].data(), cameraRays[9].data()});
+                extendQueue.clear();
+                for (int path = 0; path < numPaths; ++path) {
+                    extendQueue.push_back({path, 0, {{cameraRays[4][path], cameraRays[5][path], cameraRays[6][path]},
+                                                     {cameraRays[7][path], cameraRays[8][path], cameraRays[9][path]}}});
+                }
+                counts.primary += numPaths;
+
+                while (!extendQueue.empty()) {
+                    // Extend - misses pick up the background and end there
+                    shadeQueue.clear();
+                    const int numRays = static_cast<int>(extendQueue.size());
+                    for (int first = 0; first < numRays; first += N) {
+                        const int numLanes = std::min(N, numRays - first);
+                        hit.reset();
+                        for (int lane = 0; lane < N; ++lane) {
+                            rays.set(lane, extendQueue[first + std::min(lane, numLanes - 1)].ray);
+                            hit.active[lane] = lane < numLanes;
+                        }
+                        PacketAspect::hitAllObjects(rays, hit, context.spheres, context.planes, context.rectangles,
+                                                    context.triangles, context.meshVertices, context.bvhNodes, context.bvhIndices,
+                                                    context.numSpheres, context.numPlanes, context.numRects);
+
+                        for (int lane = 0; lane < numLanes; ++lane) {
+                            const auto& item = extendQueue[first + lane];
+                            auto& path = paths[item.path];
+                            if (hit.type[lane] == PacketPrimitive::None) {
+                                path.radiance += path.throughput * context.background;
+                                continue;
+                            }
+                            shadeQueue.push_back({item.path, item.depth, item.ray, g_RayHit()});
+                            auto& shadeHit = shadeQueue.back().hit;
+                            shadeHit.tMin = hit.tMin[lane];
+                            shadeHit.hasHit = true;
+                            switch (hit.type[lane]) {
+                                case PacketPrimitive::Sphere:
+                                    resolveHit(context.spheres[hit.primitive[lane]], item.ray, shadeHit);
+                                    break;
+                                case PacketPrimitive::Plane:
+                                    resolveHit(context.planes[hit.primitive[lane]], item.ray, shadeHit);
+                                    break;
+                                case PacketPrimitive::Rectangle:
+                                    resolveHit(context.rectangles[hit.primitive[lane]], item.ray, shadeHit);
+                                    break;
+                                default:
+                                    resolveHit(context.triangles[hit.primitive[lane]], context.meshVertices, context.meshNormals, item.ray, shadeHit);
+                                    break;
+                            }
+                        }
+                    }
+
+                    // Shade - a counting sort by material id first, so each material's hits go through in one run
+                    std::fill(materialStarts.begin(), materialStarts.end(), 0);
+                    for (const auto& item : shadeQueue) ++materialStarts[item.hit.material + 1];
+                    for (int material = 0; material < context.numMaterials; ++material) materialStarts[material + 1] += materialStarts[material];
+                    shadeOrder.resize(shadeQueue.size());
+                    for (int item = 0; item < static_cast<int>(shadeQueue.size()); ++item) {
+                        shadeOrder[materialStarts[shadeQueue[item].hit.material]++] = item;
+                    }
+
+                    // Shadow - in batches in between shading
+                    const auto traceShadows = [&] {
+                        for (const auto& item : shadowQueue) {
+                            if (occluded(context.spheres, context.planes, context.rectangles, context.triangles, context.meshVertices,
+                                         context.bvhNodes, context.bvhIndices, item.ray, item.tMax, *item.lastOccluder,
+                                         context.numSpheres, context.numPlanes, context.numRects)) {
+                                if (item.light >= 0) SMURF_COUNT(shadowOccluded[item.lightType][Instrumentation::lightSlot(item.light)]);
+                                continue;
+                            }
+                            paths[item.path].radiance += item.contribution;
+                        }
+                        shadowQueue.clear();
+                    };
+
+                    nextExtendQueue.clear();
+                    for (const int item : shadeOrder) {
+                        shadeWavefrontHit(context, shadeQueue[item], paths[shadeQueue[item].path], pixels[paths[shadeQueue[item].path].pixel].sampler,
+                                          sample, occlusionCache, shadowQueue, nextExtendQueue, counts);
+                        if (static_cast<int>(shadowQueue.size()) >= Wavefront::ShadowBatchSize) traceShadows();
+                    }
+                    traceShadows();
+
+                    std::swap(extendQueue, nextExtendQueue);
+                }
+
+                for (const auto& path : paths) {
+                    pixels[path.pixel].estimate.add(path.radiance);
+                }
+            }
+
+            for (const auto& pixel : pixels) {
+                result[pixel.idx] = Pixel(pixel.estimate.average());
+            }
+        }
+
+        // The shade stage for one hit. Shading itself goes the way shade() does it, but the occlusion queries are queued
+        // up rather than traced. So is the bounce, if the path goes on.
+        static void shadeWavefrontHit(const PacketContext& context, const Wavefront::ShadeItem& item, Wavefront::Path& path,
+                                      const PixelSampler& pixelSampler, int sampleIdx, OcclusionCache& occlusionCache,
+                                      std::vector<Wavefront::ShadowItem>& shadowQueue, std::vector<Wavefront::ExtendItem>& extendQueue,
+                                      RayCounts& counts) {
+            const auto& material = context.materials[item.hit.material];
+            SMURF_COUNT(materialDispatches[material.type]);
+            // Dielectrics get hit from inside as well, they're lit on the side the ray came from
+            auto normal = item.hit.normal;
+            if (material.type == ActiveMaterial::ActiveTransparent && item.ray.direction * normal > 0) normal = -normal;
+            const auto& hitPoint = item.hit.hitPoint;
+            const auto flippedDirection = -item.ray.direction;
+            const auto origin = offsetFromSurface(hitPoint, normal);
+            const ShadingSampling shadingSampling{context.policy, pixelSampler, sampleIdx, item.depth};
+
+            // Ambient light stands in for indirect light, which the bounces trace for real - so only the surface the
+            // camera ray hits gets it, past that it would be counted twice. Ambient occlusion rays share what it adds past
+            // its minimum between them.
+            if (item.depth == 0) {
+                const auto& ambientLight = context.ambientLight;
+                auto ambient = path.throughput * (material.ambient.rho() * ambientLight.getRadiance());
+                const int numOcclusionRays = ambientLight.occlusionSamples;
+                if (numOcclusionRays == 0) {
+                    path.radiance += ambient;
+                } else {
+                    path.radiance += ambient * ambientLight.minAmount;
+                    const auto perRay = ambient * ((1.0F - ambientLight.minAmount) / numOcclusionRays);
+                    Vec3<Real> tangent;
+                    Vec3<Real> bitangent;
+                    tangentFrame(normal, tangent, bitangent);
+                    for (int rayIdx = 0; rayIdx < numOcclusionRays; ++rayIdx) {
+                        const auto sample = pixelSampler.occlusionSample(context.hemisphereSamples, context.sampleIndices, context.policy,
+                                                                         sampleIdx, rayIdx, numOcclusionRays);
+                        const Ray ray(origin, static_cast<Real>(sample.x) * bitangent + static_cast<Real>(sample.y) * tangent
+                                              + static_cast<Real>(sample.z) * normal);
+                        ++counts.shadow;
+                        shadowQueue.push_back({item.path, ray, ambientLight.occlusionDistance, perRay, &occlusionCache.ambient,
+                                               Instrumentation::Directional, -1});
+                    }
+                }
+            }
+
+            for (int dirLight = 0; dirLight < context.numDirLights; ++dirLight) {
+                const auto& light = context.directionalLights[dirLight];
+                auto direction = light.getDirection();
                 auto normalDotDirection = normal * direction;
                 if (normalDotDirection > 0.0) {
-                    Ray shadowRay(hitPoint, direction);
-                    if (inShadow(spheres, planes, rectangles, shadowRay, directionalLights[dirLight], numSpheres, numPlanes, numRects)) {
-                        continue;
-                    }
-                    result += (glossy.getBrdfSpecular().diffuseF(normal, flippedDirection, direction) + glossy.getBrdfDiffuse().diffuseF())
-                        * directionalLights[dirLight].getRadiance() * static_cast<float>(normalDotDirection);
+                    ++counts.shadow;
+                    SMURF_COUNT(shadowRays[Instrumentation::Directional][Instrumentation::lightSlot(dirLight)]);
+                    shadowQueue.push_back({item.path, Ray(origin, direction), RealMax,
+                                           path.throughput * (material.diffuseF(normal, flippedDirection, direction) * light.getRadiance()
+                                                              * static_cast<float>(normalDotDirection)),
+                                           &occlusionCache.forDirectional(dirLight), Instrumentation::Directional, dirLight});
+                } else {
+                    SMURF_COUNT(lightsFacingAway);
                 }
             }
 
-            for (int pointLight = 0; pointLight < numPointLights; ++pointLight) {
-                const auto& direction = pointLights[pointLight].getDirection(hitPoint);
+            LightSampling::PointLightPicks picks(shadingSampling, context.numPointLights);
+            for (int pickIdx = 0; pickIdx < picks.count; ++pickIdx) {
+                float weight;
+                const int pointLight = picks.next(context.pointLightCdf, pickIdx, weight);
+                const auto& light = context.pointLights[pointLight];
+                auto direction = light.getDirection(hitPoint);
                 auto normalDotDirection = normal * direction;
                 if (normalDotDirection > 0.0) {
-                    Ray shadowRay(hitPoint, direction);
-                    if (inShadow(spheres, planes, rectangles, shadowRay, pointLights[pointLight], numSpheres, numPlanes, numRects)) {
-                        continue;
-                    }
-                    result += (glossy.getBrdfSpecular().diffuseF(normal, flippedDirection, direction) + glossy.getBrdfDiffuse().diffuseF())
-                        * pointLights[pointLight].getRadiance() * static_cast<float>(normalDotDirection);
+                    ++counts.shadow;
+                    SMURF_COUNT(shadowRays[Instrumentation::Point][Instrumentation::lightSlot(pointLight)]);
+                    shadowQueue.push_back({item.path, Ray(origin, direction), light.location.distance(origin),
+                                           path.throughput * (material.diffuseF(normal, flippedDirection, direction) * light.getRadiance()
+                                                              * (weight * static_cast<float>(normalDotDirection))),
+                                           &occlusionCache.forPoint(pointLight), Instrumentation::Point, pointLight});
+                } else {
+                    SMURF_COUNT(lightsFacingAway);
                 }
             }
 
-            return result;
+            if (item.depth + 1 >= context.maxDepth) return;
+            // Streams apart per bounce, and from the light picks above
+            Random::CounterRng rng{pixelSampler.scramble ^ Random::pcgHash(static_cast<unsigned>(item.depth)), static_cast<unsigned>(sampleIdx)};
+            Ray next;
+            Color weight;
+            if (!Wavefront::scatter(material, item.ray, item.hit.normal, hitPoint, rng, next, weight)) return;
+            auto throughput = path.throughput * weight;
+            if (item.depth + 1 >= Wavefront::RouletteDepth) {
+                const float survival = std::min(1.0F, Wavefront::maxComponent(throughput));
+                if (rng.nextFloat() >= survival) return;
+                throughput *= 1.0F / survival;
+            }
+            path.throughput = throughput;
+            ++counts.secondary;
+            extendQueue.push_back({item.path, item.depth + 1, next});
         }
 
-        friend Color dispatchMaterial(g_RayHit hit, Ray ray,
-                                      AmbientLight ambientLight,
-                                      const Concurrency::array<g_Sphere>& spheres,
-                                      const Concurrency::array<g_Plane>& planes,
-                                      const Concurrency::array<g_Rectangle>& rectangles,
-                                      const Concurrency::array<DirectionalLight>& g_DirectionalLights,
-                                      const Concurrency::array<PointLight>& g_PointLights,
-                                      int numSpheres, int numPlanes, int numRects,
-                                      int numDirLights, int numPointLights) restrict(amp) {
-            switch (hit.active) {
-            case ActiveMaterial::ActiveMatte:
-                return shade(hit.matte, ray, hit.normal, hit.hitPoint,
-                             ambientLight, spheres, planes, rectangles, g_DirectionalLights, g_PointLights,
-                             numSpheres, numPlanes, numRects, numDirLights, numPointLights);
-                break;
-            case ActiveMaterial::ActiveGlossy:
-                return shade(hit.glossy, ray, hit.normal, hit.hitPoint,
-                             ambientLight, spheres, planes, rectangles, g_DirectionalLights, g_PointLights,
-                             numSpheres, numPlanes, numRects, numDirLights, numPointLights);
-                break;
-            default:
-                return {};
-            }
-        }
-
-        friend bool inShadow(const Concurrency::array<g_Sphere>& spheres,
-                             const Concurrency::array<g_Plane>& planes,
-                             const Concurrency::array<g_Rectangle>& rectangles,
-                             Ray ray,
-                             PointLight light,
-                             const int numSpheres, const int numPlanes, const int numRectangles) restrict(amp) {
-            auto dist = light.location.distance(ray.origin);
+        SMURF_TARGET("avx512f,avx2,fma")
+        static void traceTileWavefrontAVX512(const PacketContext& context, const Tile& tile, std::vector<Pixel>& result, RayCounts& counts) {
+            traceTileWavefront<Simd::PacketWidthAVX512>(context, tile, result, counts);
+        }
 
-            #define REGISTER_SHADOW_PRIMITIVE(container, size) \
-                for (int i = 0; i < size; ++i) { \
-                    auto hit = OnRayCastAspect::onShadowRayCast(container[i], ray); \
-                    if (hit && hit.t < dist) { \
-                        return true; \
-                    } \
+        SMURF_TARGET("avx2,fma")
+        static void traceTileWavefrontAVX2(const PacketContext& context, const Tile& tile, std::vector<Pixel>& result, RayCounts& counts) {
+            traceTileWavefront<Simd::PacketWidthAVX2>(context, tile, result, counts);
+        }
+
+        static void traceTileWavefrontSSE2(const PacketContext& context, const Tile& tile, std::vector<Pixel>& result, RayCounts& counts) {
+            traceTileWavefront<Simd::PacketWidthSSE2>(context, tile, result, counts);
+        }
+        #endif
+
+    public:
+        // The object is taken apart into the geometry store and the material table, it isn't kept around itself
+        ObjectHandle addToScene(std::unique_ptr<GeometricObject> object) {
+            const int material = object->active == ActiveMaterial::ActiveGlossy ? addMaterial(object->color, object->glossy)
+                                                                                : addMaterial(object->color, object->matte);
+            if (auto sphere = dynamic_cast<Sphere*>(object.get())) {
+                return addSphere(sphere->getCenter(), sphere->getRadius(), material);
+            } else if (auto plane = dynamic_cast<Plane*>(object.get())) {
+                return addPlane(plane->getPoint(), plane->getNormal(), material);
+            } else if (auto rect = dynamic_cast<Rectangle*>(object.get())) {
+                return addRectangle(rect->getPoint(), rect->getA(), rect->getB(), rect->getNormal(), material);
+            } else if (auto mesh = dynamic_cast<TriangleMesh*>(object.get())) {
+                return addMesh(mesh->getVertices(), mesh->getNormals(), mesh->getIndices(), material);
+            }
+            throw std::runtime_error("Unknown kind of object");
+        }
+
+        template <typename Material>
+        int addMaterial(const Color& color, const Material& material) {
+            kernelScene.reset();
+            return materials.add(color, material);
+        }
+
+        // Materials are referred to by the index addMaterial returned, any number of primitives can share one
+        // The handle returned stays valid until the object is removed, whatever else is added or removed meanwhile
+        ObjectHandle addSphere(const Vec3<Real>& center, Real radius, int material) {
+            accelerationStructureDirty = true;
+            kernelScene.reset();
+            return {ObjectKind::Sphere, handlesOf(ObjectKind::Sphere).add(geometry.spheres.add(center, radius, material))};
+        }
+
+        ObjectHandle addPlane(const Vec3<Real>& point, const Vec3<Real>& normal, int material) {
+            kernelScene.reset();
+            return {ObjectKind::Plane, handlesOf(ObjectKind::Plane).add(geometry.planes.add(point, normal, material))};
+        }
+
+        ObjectHandle addRectangle(const Vec3<Real>& point, const Vec3<Real>& a, const Vec3<Real>& b, const Vec3<Real>& normal, int material) {
+            accelerationStructureDirty = true;
+            kernelScene.reset();
+            return {ObjectKind::Rectangle, handlesOf(ObjectKind::Rectangle).add(geometry.rectangles.add(point, a, b, normal, material))};
+        }
+
+        // Three indices into vertices per triangle, counter-clockwise seen from the front. Normals are one per vertex
+        // for smooth shading, or none for flat.
+        ObjectHandle addMesh(const std::vector<Vec3<Real>>& vertices, const std::vector<Vec3<Real>>& normals,
+                    const std::vector<int>& indices, int material) {
+            if (indices.empty()) {
+                throw std::runtime_error("Mesh has no triangles");
+            }
+            if (indices.size() % 3 != 0) {
+                throw std::runtime_error("Mesh indices don't come in threes");
+            }
+            if (!normals.empty() && normals.size() != vertices.size()) {
+                throw std::runtime_error("Mesh has " + std::to_string(normals.size()) + " normals for " + std::to_string(vertices.size()) + " vertices");
+            }
+            for (const int index : indices) {
+                if (index < 0 || index >= static_cast<int>(vertices.size())) {
+                    throw std::runtime_error("Mesh index " + std::to_string(index) + " is out of range");
                 }
-            REGISTER_SHADOW_PRIMITIVE(spheres, numSpheres);
-            REGISTER_SHADOW_PRIMITIVE(planes, numPlanes);
-            REGISTER_SHADOW_PRIMITIVE(rectangles, numRectangles);
+            }
+            accelerationStructureDirty = true;
+            kernelScene.reset();
+            return {ObjectKind::Mesh, handlesOf(ObjectKind::Mesh).add(geometry.triangles.addMesh(vertices, normals, indices, material))};
+        }
 
-            #undef REGISTER_SHADOW_PRIMITIVE
-            return false;
+        // Objects changed in place keep their slots: the BVH is refit around them rather than rebuilt, and the next
+        // render copies only them over to the kernels. Planes aren't in the BVH at all.
+        void updateSphere(ObjectHandle handle, const Vec3<Real>& center, Real radius) {
+            const int slot = slotOf(handle, ObjectKind::Sphere);
+            geometry.spheres.set(slot, center, radius, geometry.spheres.materials[slot]);
+            changedSpheres.push_back(slot);
+            movedPrimitives.push_back(slot);
         }
 
-        friend bool inShadow(const Concurrency::array<g_Sphere>& spheres,
-                             const Concurrency::array<g_Plane>& planes,
-                             const Concurrency::array<g_Rectangle>& rectangles,
-                             Ray ray,
-                             DirectionalLight light,
-                             const int numSpheres, const int numPlanes, const int numRectangles) restrict(amp) {
-            // Horrible constant is horrible, but works -> just scale the ray far in the direction and shoot for a shadowhit
-            auto location = ray.origin - 10000 * light.getDirection();
-            auto dist = location.distance(ray.origin);
-            #define REGISTER_SHADOW_PRIMITIVE_DIR(container, size) \
-                for (int i = 0; i < size; ++i) { \
-                    auto hit = OnRayCastAspect::onShadowRayCast(container[i], ray); \
-                    if (hit && hit.t < dist) { \
-                        return true; \
-                    } \
+        void updatePlane(ObjectHandle handle, const Vec3<Real>& point, const Vec3<Real>& normal) {
+            const int slot = slotOf(handle, ObjectKind::Plane);
+            geometry.planes.set(slot, point, normal, geometry.planes.materials[slot]);
+            changedPlanes.push_back(slot);
+        }
+
+        void updateRectangle(ObjectHandle handle, const Vec3<Real>& point, const Vec3<Real>& a, const Vec3<Real>& b, const Vec3<Real>& normal) {
+            const int slot = slotOf(handle, ObjectKind::Rectangle);
+            geometry.rectangles.set(slot, point, a, b, normal, geometry.rectangles.materials[slot]);
+            changedRectangles.push_back(slot);
+            movedPrimitives.push_back(geometry.spheres.size() + slot);
+        }
+
+        // Same vertex count as the mesh was added with, the triangles between them stay. Normals can be left out to
+        // keep the old ones, a flat mesh ignores them.
+        void updateMesh(ObjectHandle handle, const std::vector<Vec3<Real>>& vertices, const std::vector<Vec3<Real>>& normals = {}) {
+            const int mesh = slotOf(handle, ObjectKind::Mesh);
+            const auto& range = geometry.triangles.meshes[mesh];
+            if (static_cast<int>(vertices.size()) != range.numVertices || (!normals.empty() && normals.size() != vertices.size())) {
+                throw std::runtime_error("Mesh update has " + std::to_string(vertices.size()) + " vertices and " + std::to_string(normals.size())
+                                         + " normals for a mesh of " + std::to_string(range.numVertices));
+            }
+            geometry.triangles.setMeshVertices(mesh, vertices, normals);
+            changedMeshes.push_back(mesh);
+            const int firstBounded = geometry.spheres.size() + geometry.rectangles.size() + range.firstTriangle;
+            for (int i = 0; i < range.numTriangles; ++i) {
+                movedPrimitives.push_back(firstBounded + i);
+            }
+        }
+
+        std::vector<Vec3<Real>> getMeshVertices(ObjectHandle handle) const {
+            const auto& range = geometry.triangles.meshes[slotOf(handle, ObjectKind::Mesh)];
+            const auto first = std::begin(geometry.triangles.vertices) + range.firstVertex;
+            return {first, first + range.numVertices};
+        }
+
+        void translate(ObjectHandle handle, const Vec3<Real>& offset) {
+            switch (handle.kind) {
+                case ObjectKind::Sphere: {
+                    const int slot = slotOf(handle, ObjectKind::Sphere);
+                    updateSphere(handle, geometry.spheres.getCenter(slot) + offset, geometry.spheres.radii[slot]);
+                    break;
+                }
+                case ObjectKind::Plane: {
+                    const int slot = slotOf(handle, ObjectKind::Plane);
+                    updatePlane(handle, geometry.planes.getPoint(slot) + offset, geometry.planes.getNormal(slot));
+                    break;
+                }
+                case ObjectKind::Rectangle: {
+                    const int slot = slotOf(handle, ObjectKind::Rectangle);
+                    const auto& rectangles = geometry.rectangles;
+                    updateRectangle(handle, rectangles.getPoint(slot) + offset, rectangles.getA(slot), rectangles.getB(slot), rectangles.getNormal(slot));
+                    break;
                 }
-            REGISTER_SHADOW_PRIMITIVE_DIR(spheres, numSpheres);
-            REGISTER_SHADOW_PRIMITIVE_DIR(planes, numPlanes);
-            REGISTER_SHADOW_PRIMITIVE_DIR(rectangles, numRectangles);
+                default: {
+                    auto vertices = getMeshVertices(handle);
+                    for (auto& vertex : vertices) {
+                        vertex = vertex + offset;
+                    }
+                    updateMesh(handle, vertices);
+                    break;
+                }
+            }
+        }
 
-            #undef REGISTER_SHADOW_PRIMITIVE_DIR
-            return false;
+        void setMaterial(ObjectHandle handle, int material) {
+            if (material < 0 || material >= materials.size()) throw std::runtime_error("Material " + std::to_string(material) + " is out of range");
+            const int slot = slotOf(handle, handle.kind);
+            switch (handle.kind) {
+                case ObjectKind::Sphere: geometry.spheres.materials[slot] = material; changedSpheres.push_back(slot); break;
+                case ObjectKind::Plane: geometry.planes.materials[slot] = material; changedPlanes.push_back(slot); break;
+                case ObjectKind::Rectangle: geometry.rectangles.materials[slot] = material; changedRectangles.push_back(slot); break;
+                default: geometry.triangles.setMeshMaterial(slot, material); changedMeshes.push_back(slot); break;
+            }
+        }
+
+        // Slots after the object's move down, so this rebuilds the BVH and the kernel-side copy like an add does
+        void remove(ObjectHandle handle) {
+            const int slot = slotOf(handle, handle.kind);
+            switch (handle.kind) {
+                case ObjectKind::Sphere: geometry.spheres.remove(slot); break;
+                case ObjectKind::Plane: geometry.planes.remove(slot); break;
+                case ObjectKind::Rectangle: geometry.rectangles.remove(slot); break;
+                default: geometry.triangles.removeMesh(slot); break;
+            }
+            handlesOf(handle.kind).remove(handle.id);
+            if (handle.kind != ObjectKind::Plane) accelerationStructureDirty = true;
+            kernelScene.reset();
+            clearChanges();
+        }
+
+        // Everything constructed so far, BVH included, goes into a cache file for loadCache to map back in
+        // The source stamp ties the cache to the scene file it was loaded from, if any
+        void saveCache(const std::string& fileName, const std::string& sceneName, qword sourceStamp = 0) {
+            buildAccelerationStructure();
+            using namespace SceneCache;
+            Writer writer(sceneName, sourceStamp);
+            writer.add(CameraRecord, &camera, 1);
+            writer.add(BackgroundColor, &background, 1);
+            writer.add(AmbientLightRecord, &ambientLight, 1);
+            writer.add(MaterialColors, materials.getColors());
+            writer.add(MaterialRecords, materials.getRecords());
+
+            const auto& spheres = geometry.spheres;
+            writer.add(SphereCenterX, spheres.centerX);
+            writer.add(SphereCenterY, spheres.centerY);
+            writer.add(SphereCenterZ, spheres.centerZ);
+            writer.add(SphereRadii, spheres.radii);
+            writer.add(SphereMaterials, spheres.materials);
+
+            const auto& planes = geometry.planes;
+            writer.add(PlanePointX, planes.pointX);
+            writer.add(PlanePointY, planes.pointY);
+            writer.add(PlanePointZ, planes.pointZ);
+            writer.add(PlaneNormalX, planes.normalX);
+            writer.add(PlaneNormalY, planes.normalY);
+            writer.add(PlaneNormalZ, planes.normalZ);
+            writer.add(PlaneMaterials, planes.materials);
+
+            const auto& rectangles = geometry.rectangles;
+            writer.add(RectanglePointX, rectangles.pointX);
+            writer.add(RectanglePointY, rectangles.pointY);
+            writer.add(RectanglePointZ, rectangles.pointZ);
+            writer.add(RectangleAX, rectangles.aX);
+            writer.add(RectangleAY, rectangles.aY);
+            writer.add(RectangleAZ, rectangles.aZ);
+            writer.add(RectangleBX, rectangles.bX);
+            writer.add(RectangleBY, rectangles.bY);
+            writer.add(RectangleBZ, rectangles.bZ);
+            writer.add(RectangleNormalX, rectangles.normalX);
+            writer.add(RectangleNormalY, rectangles.normalY);
+            writer.add(RectangleNormalZ, rectangles.normalZ);
+            writer.add(RectangleALengthSquared, rectangles.aLengthSquared);
+            writer.add(RectangleBLengthSquared, rectangles.bLengthSquared);
+            writer.add(RectangleMaterials, rectangles.materials);
+
+            const auto& triangles = geometry.triangles;
+            writer.add(MeshVertices, triangles.vertices);
+            writer.add(MeshNormals, triangles.normals);
+            writer.add(TriangleV0, triangles.v0);
+            writer.add(TriangleV1, triangles.v1);
+            writer.add(TriangleV2, triangles.v2);
+            writer.add(TriangleMaterials, triangles.materials);
+            writer.add(TriangleSmoothFlags, triangles.smoothFlags);
+            writer.add(MeshRanges, triangles.meshes);
+
+            writer.add(PointLights, pointLights);
+            writer.add(DirectionalLights, directionalLights);
+            writer.add(BVHNodes, objectBVH.getNodes());
+            writer.add(BVHIndices, objectBVH.getPrimitiveIndices());
+            writer.save(fileName);
         }
 
-        void addToScene(std::unique_ptr<GeometricObject> object) {
-            objects.emplace_back(std::move(object));
+        // A scene exactly as saveCache left it, without constructing the objects or building the BVH again
+        // Throws SceneCache::StaleCache if the file holds another scene or doesn't fit this build
+        static std::unique_ptr<Scene> loadCache(const std::string& fileName, const std::string& sceneName, qword sourceStamp = 0) {
+            using namespace SceneCache;
+            const Reader reader(fileName, sceneName, sourceStamp);
+            auto scene = Utils::make_unique<Scene>(reader.readOne<Camera>(CameraRecord), reader.readOne<Color>(BackgroundColor));
+            scene->ambientLight = reader.readOne<AmbientLight>(AmbientLightRecord);
+            scene->materials.restore(reader.read<Color>(MaterialColors), reader.read<g_Material>(MaterialRecords));
+
+            auto& spheres = scene->geometry.spheres;
+            spheres.centerX = reader.read<Real>(SphereCenterX);
+            spheres.centerY = reader.read<Real>(SphereCenterY);
+            spheres.centerZ = reader.read<Real>(SphereCenterZ);
+            spheres.radii = reader.read<Real>(SphereRadii);
+            spheres.materials = reader.read<int>(SphereMaterials);
+
+            auto& planes = scene->geometry.planes;
+            planes.pointX = reader.read<Real>(PlanePointX);
+            planes.pointY = reader.read<Real>(PlanePointY);
+            planes.pointZ = reader.read<Real>(PlanePointZ);
+            planes.normalX = reader.read<Real>(PlaneNormalX);
+            planes.normalY = reader.read<Real>(PlaneNormalY);
+            planes.normalZ = reader.read<Real>(PlaneNormalZ);
+            planes.materials = reader.read<int>(PlaneMaterials);
+
+            auto& rectangles = scene->geometry.rectangles;
+            rectangles.pointX = reader.read<Real>(RectanglePointX);
+            rectangles.pointY = reader.read<Real>(RectanglePointY);
+            rectangles.pointZ = reader.read<Real>(RectanglePointZ);
+            rectangles.aX = reader.read<Real>(RectangleAX);
+            rectangles.aY = reader.read<Real>(RectangleAY);
+            rectangles.aZ = reader.read<Real>(RectangleAZ);
+            rectangles.bX = reader.read<Real>(RectangleBX);
+            rectangles.bY = reader.read<Real>(RectangleBY);
+            rectangles.bZ = reader.read<Real>(RectangleBZ);
+            rectangles.normalX = reader.read<Real>(RectangleNormalX);
+            rectangles.normalY = reader.read<Real>(RectangleNormalY);
+            rectangles.normalZ = reader.read<Real>(RectangleNormalZ);
+            rectangles.aLengthSquared = reader.read<Real>(RectangleALengthSquared);
+            rectangles.bLengthSquared = reader.read<Real>(RectangleBLengthSquared);
+            rectangles.materials = reader.read<int>(RectangleMaterials);
+
+            auto& triangles = scene->geometry.triangles;
+            triangles.vertices = reader.read<Vec3<Real>>(MeshVertices);
+            triangles.normals = reader.read<Vec3<Real>>(MeshNormals);
+            triangles.v0 = reader.read<int>(TriangleV0);
+            triangles.v1 = reader.read<int>(TriangleV1);
+            triangles.v2 = reader.read<int>(TriangleV2);
+            triangles.materials = reader.read<int>(TriangleMaterials);
+            triangles.smoothFlags = reader.read<int>(TriangleSmoothFlags);
+            triangles.meshes = reader.read<TriangleArrays::MeshRange>(MeshRanges);
+
+            scene->pointLights = reader.read<PointLight>(PointLights);
+            scene->directionalLights = reader.read<DirectionalLight>(DirectionalLights);
+            scene->objectBVH.restore(reader.read<BVHNode>(BVHNodes), reader.read<int>(BVHIndices));
+            scene->accelerationStructureDirty = false;
+            scene->checkRestored();
+            scene->handlesOf(ObjectKind::Sphere).reset(spheres.size());
+            scene->handlesOf(ObjectKind::Plane).reset(planes.size());
+            scene->handlesOf(ObjectKind::Rectangle).reset(rectangles.size());
+            scene->handlesOf(ObjectKind::Mesh).reset(static_cast<int>(triangles.meshes.size()));
+            return scene;
         }
 
         template <typename T>
@@ -502,10 +1840,12 @@ namespace Smurf {
         }
 
         void _dispatchAddLight(PointLight&& light) {
+            kernelScene.reset();
             pointLights.emplace_back(std::move(light));
         }
 
         void _dispatchAddLight(DirectionalLight&& light) {
+            kernelScene.reset();
             directionalLights.emplace_back(std::move(light));
         }
     };
@@ -0,0 +1,277 @@
+#pragma once
+
+#include "Wheels.hpp"
+#include "Real.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Smurf {
+    // Binary snapshot of a constructed scene - materials, geometry, lights and the built BVH, each one flat array
+    // A header with a table of sections comes first, every section starts on a 64 byte boundary after it. Records are
+    // stored bytewise, the same way the AMP backend copies them to the device, so a cache only loads into a build of
+    // the same version, precision and record layout. Anything else is treated as stale and rebuilt.
+    namespace SceneCache {
+        const dword Version = 3;
+        const std::size_t SectionAlignment = 64;
+
+        enum Section {
+            CameraRecord, BackgroundColor, AmbientLightRecord,
+            MaterialColors, MaterialRecords,
+            SphereCenterX, SphereCenterY, SphereCenterZ, SphereRadii, SphereMaterials,
+            PlanePointX, PlanePointY, PlanePointZ, PlaneNormalX, PlaneNormalY, PlaneNormalZ, PlaneMaterials,
+            RectanglePointX, RectanglePointY, RectanglePointZ, RectangleAX, RectangleAY, RectangleAZ,
+            RectangleBX, RectangleBY, RectangleBZ, RectangleNormalX, RectangleNormalY, RectangleNormalZ,
+            RectangleALengthSquared, RectangleBLengthSquared, RectangleMaterials,
+            MeshVertices, MeshNormals, TriangleV0, TriangleV1, TriangleV2, TriangleMaterials, TriangleSmoothFlags, MeshRanges,
+            PointLights, DirectionalLights,
+            BVHNodes, BVHIndices,
+            NumSections
+        };
+
+        struct SectionEntry {
+            qword offset;       // From the start of the file
+            qword count;
+            qword elementSize;  // sizeof the record type that wrote it, a layout change makes the cache stale
+        };
+
+        struct Header {
+            char magic[8];
+            dword version;
+            dword realSize;
+            char sceneName[256];
+            qword sourceStamp;  // Of the scene file it was built from, 0 for the sample scenes
+            SectionEntry sections[NumSections];
+        };
+
+        const char Magic[8] = {'S', 'M', 'U', 'R', 'F', 'S', 'C', 'N'};
+
+        // The file exists but can't be used as it is - another version, another precision, another scene, cut short
+        class StaleCache : public std::runtime_error {
+        public:
+            explicit StaleCache(const std::string& what) : std::runtime_error(what) { }
+        };
+
+        // Read-only view of a whole file, pages are faulted in as they're touched
+        class MappedFile {
+        public:
+            explicit MappedFile(const std::string& fileName) : data{nullptr}, size{0} {
+                #ifdef _WIN32
+                file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+                if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Cannot open file: " + fileName);
+                LARGE_INTEGER fileSize;
+                GetFileSizeEx(file, &fileSize);
+                size = static_cast<std::size_t>(fileSize.QuadPart);
+                mapping = size ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+                if (mapping) data = static_cast<const byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                #else
+                file = open(fileName.c_str(), O_RDONLY);
+                if (file < 0) throw std::runtime_error("Cannot open file: " + fileName);
+                struct stat status;
+                fstat(file, &status);
+                size = static_cast<std::size_t>(status.st_size);
+                if (size) {
+                    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+                    if (mapped != MAP_FAILED) {
+                        data = static_cast<const byte*>(mapped);
+                        // The sections are copied out front to back
+                        madvise(mapped, size, MADV_SEQUENTIAL);
+                    }
+                }
+                #endif
+                if (size && !data) {
+                    release();
+                    throw std::runtime_error("Cannot map file: " + fileName);
+                }
+            }
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            ~MappedFile() {
+                release();
+            }
+
+            const byte* getData() const {
+                return data;
+            }
+
+            std::size_t getSize() const {
+                return size;
+            }
+
+        private:
+            void release() {
+                #ifdef _WIN32
+                if (data) UnmapViewOfFile(data);
+                if (mapping) CloseHandle(mapping);
+                CloseHandle(file);
+                #else
+                if (data) munmap(const_cast<byte*>(data), size);
+                close(file);
+                #endif
+            }
+
+            const byte* data;
+            std::size_t size;
+            #ifdef _WIN32
+            HANDLE file;
+            HANDLE mapping = nullptr;
+            #else
+            int file;
+            #endif
+        };
+
+        // Modification time and size of a file the cache is built from, either changing makes the cache stale
+        inline qword sourceStamp(const std::string& fileName) {
+            #ifdef _WIN32
+            WIN32_FILE_ATTRIBUTE_DATA attributes;
+            if (!GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &attributes)) throw std::runtime_error("Cannot open file: " + fileName);
+            const qword modified = static_cast<qword>(attributes.ftLastWriteTime.dwHighDateTime) << 32 | attributes.ftLastWriteTime.dwLowDateTime;
+            const qword size = static_cast<qword>(attributes.nFileSizeHigh) << 32 | attributes.nFileSizeLow;
+            #else
+            struct stat status;
+            if (stat(fileName.c_str(), &status) != 0) throw std::runtime_error("Cannot open file: " + fileName);
+            const qword modified = static_cast<qword>(status.st_mtime);
+            const qword size = static_cast<qword>(status.st_size);
+            #endif
+            return modified * 31 + size;
+        }
+
+        // Records are copied bytewise, so they have to be trivially copyable - no vtables, no pointers into themselves
+        // and no copy constructors of their own
+        template <typename T>
+        void checkStorable() {
+            static_assert(std::is_trivially_copyable<T>::value, "Scene cache records are copied bytewise");
+        }
+
+        // Collects where every section's data lives, and writes them all out in one go
+        // The data isn't copied, it has to stay put until save() is done
+        class Writer {
+        public:
+            explicit Writer(const std::string& sceneName, qword sourceStamp = 0) : header() {
+                if (sceneName.size() >= sizeof(header.sceneName)) throw std::runtime_error("Scene name too long for the cache: " + sceneName);
+                std::memcpy(header.magic, Magic, sizeof(Magic));
+                header.version = Version;
+                header.realSize = sizeof(Real);
+                header.sourceStamp = sourceStamp;
+                std::memcpy(header.sceneName, sceneName.c_str(), sceneName.size());
+                for (auto& source : sources) source = nullptr;
+            }
+
+            template <typename T>
+            void add(Section section, const std::vector<T>& values) {
+                add(section, values.data(), values.size());
+            }
+
+            template <typename T>
+            void add(Section section, const T* values, std::size_t count) {
+                checkStorable<T>();
+                sources[section] = values;
+                header.sections[section].count = count;
+                header.sections[section].elementSize = sizeof(T);
+            }
+
+            // Written next to the destination first and moved over it once complete, so that a render started
+            // meanwhile never maps half a file
+            void save(const std::string& fileName) {
+                qword offset = alignUp(sizeof(Header));
+                for (auto& section : header.sections) {
+                    section.offset = offset;
+                    offset = alignUp(offset + section.count * section.elementSize);
+                }
+
+                const auto partialName = fileName + ".partial";
+                {
+                    std::ofstream file(partialName, std::ios::binary | std::ios::trunc);
+                    if (!file) throw std::runtime_error("Cannot write scene cache: " + partialName);
+                    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+                    qword written = sizeof(Header);
+                    const char padding[SectionAlignment] = {};
+                    for (int section = 0; section < NumSections; ++section) {
+                        const auto& entry = header.sections[section];
+                        file.write(padding, static_cast<std::streamsize>(entry.offset - written));
+                        file.write(static_cast<const char*>(sources[section]), static_cast<std::streamsize>(entry.count * entry.elementSize));
+                        written = entry.offset + entry.count * entry.elementSize;
+                    }
+                    if (!file) throw std::runtime_error("Cannot write scene cache: " + partialName);
+                }
+                std::remove(fileName.c_str());
+                if (std::rename(partialName.c_str(), fileName.c_str()) != 0) {
+                    throw std::runtime_error("Cannot move scene cache into place: " + fileName);
+                }
+            }
+
+        private:
+            static qword alignUp(qword offset) {
+                return (offset + SectionAlignment - 1) / SectionAlignment * SectionAlignment;
+            }
+
+            Header header;
+            const void* sources[NumSections];
+        };
+
+        // Maps a cache and hands its sections out, one bulk copy per section
+        class Reader {
+        public:
+            Reader(const std::string& fileName, const std::string& sceneName, qword sourceStamp = 0) : file{fileName} {
+                if (file.getSize() < sizeof(Header)) throw StaleCache("Scene cache is cut short: " + fileName);
+                std::memcpy(&header, file.getData(), sizeof(Header));
+                if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0) throw StaleCache("Not a scene cache: " + fileName);
+                if (header.version != Version || header.realSize != sizeof(Real)) {
+                    throw StaleCache("Scene cache was written by another build: " + fileName);
+                }
+                header.sceneName[sizeof(header.sceneName) - 1] = '\0';
+                if (sceneName != header.sceneName) {
+                    throw StaleCache("Scene cache holds " + std::string(header.sceneName) + " rather than " + sceneName + ": " + fileName);
+                }
+                if (header.sourceStamp != sourceStamp) throw StaleCache("Scene cache is older than " + sceneName + ": " + fileName);
+                for (const auto& section : header.sections) {
+                    if (section.offset > file.getSize() || section.count * section.elementSize > file.getSize() - section.offset) {
+                        throw StaleCache("Scene cache is cut short: " + fileName);
+                    }
+                }
+            }
+
+            template <typename T>
+            std::vector<T> read(Section section) const {
+                checkStorable<T>();
+                const auto& entry = header.sections[section];
+                if (entry.elementSize != sizeof(T)) throw StaleCache("Scene cache records have another layout");
+                std::vector<T> values(static_cast<std::size_t>(entry.count));
+                if (!values.empty()) std::memcpy(values.data(), file.getData() + entry.offset, values.size() * sizeof(T));
+                return values;
+            }
+
+            // Single values are stored as sections of one
+            template <typename T>
+            T readOne(Section section) const {
+                auto values = read<T>(section);
+                if (values.size() != 1) throw StaleCache("Scene cache section should hold a single value");
+                return values[0];
+            }
+
+        private:
+            MappedFile file;
+            Header header;
+        };
+    } // namespace SceneCache
+} // namespace Smurf
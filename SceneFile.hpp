@@ -0,0 +1,462 @@
+#pragma once
+
+#include "Scene.hpp"
+#include "SceneCache.hpp"
+#include "ThreadPool.hpp"
+#include "Material.hpp"
+#include "Light.hpp"
+#include "Camera.hpp"
+#include "Color.hpp"
+#include "Vec3.hpp"
+#include "Real.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Smurf {
+    // Declarative scenes - one statement per line, # starts a comment, positions are x y z and colors r g b:
+    //     camera 120 75 450   0 0 0   0 1 0   400     # eye, look at, up, view plane distance
+    //     background 0 0 0
+    //     ambient 1 1 1 0.2                           # color, scale, optionally the minimum left by occlusion
+    //     material floor matte color 1 1 0 ambient 0.15 diffuse 0.8
+    //     material shiny glossy color 0.2 0.7 0.3 specular 0.4 exponent 30
+    //     material mirror reflective reflective 0.85 reflective-color 1 1 1
+    //     material glass transparent ior 1.5 transmission 0.9
+    //     plane floor   0 -10 0   0 1 0               # material, point, normal
+    //     sphere shiny  0 0 0   100                   # material, center, radius
+    //     rectangle floor   -25 25 0   50 0 0   0 -50 0   0 0 1   # material, corner, side a, side b, normal
+    //     pointlight 150 450 300   1 0.95 0.9   2     # location, color, scale
+    //     directionallight -1 2 1   0.6 0.7 1   0.4   # direction towards the light, color, scale
+    //     mesh shiny                                  # material, the v / vn / f lines that follow belong to it
+    //     v 0 0 0
+    //     vn 0 0 1                                    # either none or one per v, smooth shading if there are any
+    //     f 0 1 2                                     # vertex indices within the mesh from 0, polygons are fanned
+    // Material keys all kinds take are color, ambient and diffuse. Glossy adds specular and exponent, reflective adds
+    // reflective and reflective-color on top, transparent adds transmission and ior on top of that.
+    // Materials have to come before the statements using them, the camera is required.
+    namespace SceneFile {
+        namespace Internal {
+            // Files are cut at line boundaries into chunks parsed on their own, smaller files stay in one
+            const std::size_t MinChunkSize = 1 << 20;
+
+            enum class Keyword { Camera, Background, Ambient, Material, PointLight, DirectionalLight,
+                                 Sphere, Plane, Rectangle, Mesh, Vertex, Normal, Face };
+
+            struct KeywordInfo {
+                const char* name;
+                Keyword keyword;
+                bool named;         // A material name comes first - its own for material, the one used otherwise
+                int minNumbers;
+                int maxNumbers;     // -1 - as many as there are, material takes its key-value pairs as text instead
+            };
+
+            const KeywordInfo Keywords[] = {
+                {"v", Keyword::Vertex, false, 3, 3},
+                {"vn", Keyword::Normal, false, 3, 3},
+                {"f", Keyword::Face, false, 3, -1},
+                {"sphere", Keyword::Sphere, true, 4, 4},
+                {"plane", Keyword::Plane, true, 6, 6},
+                {"rectangle", Keyword::Rectangle, true, 12, 12},
+                {"mesh", Keyword::Mesh, true, 0, 0},
+                {"material", Keyword::Material, true, 0, 0},
+                {"camera", Keyword::Camera, false, 10, 10},
+                {"background", Keyword::Background, false, 3, 3},
+                {"ambient", Keyword::Ambient, false, 4, 5},
+                {"pointlight", Keyword::PointLight, false, 7, 7},
+                {"directionallight", Keyword::DirectionalLight, false, 7, 7},
+            };
+
+            struct Statement {
+                Keyword keyword;
+                int line;           // Within the chunk, from 1
+                int firstNumber;    // Into the chunk's numbers
+                int numNumbers;
+                std::string name;
+                std::string text;   // The rest of a material statement
+            };
+
+            struct Chunk {
+                const char* begin = nullptr;
+                const char* end = nullptr;
+                int numLines = 0;
+                std::vector<Statement> statements;
+                std::vector<double> numbers;
+                std::string error;  // The first one, parsing stops there
+                int errorLine = 0;
+            };
+
+            // Next whitespace separated token before end, false once there are none
+            inline bool nextToken(const char*& cursor, const char* end, const char*& tokenBegin, const char*& tokenEnd) {
+                while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')) ++cursor;
+                if (cursor == end) return false;
+                tokenBegin = cursor;
+                while (cursor < end && *cursor != ' ' && *cursor != '\t' && *cursor != '\r') ++cursor;
+                tokenEnd = cursor;
+                return true;
+            }
+
+            // The mapped file isn't null terminated, tokens are copied out for strtod
+            inline bool parseNumber(const char* begin, const char* end, double& value) {
+                char buffer[64];
+                const auto length = static_cast<std::size_t>(end - begin);
+                if (length == 0 || length >= sizeof(buffer)) return false;
+                std::memcpy(buffer, begin, length);
+                buffer[length] = '\0';
+                char* parsedEnd;
+                value = std::strtod(buffer, &parsedEnd);
+                return parsedEnd == buffer + length && std::isfinite(value);
+            }
+
+            inline const KeywordInfo* findKeyword(const char* begin, const char* end) {
+                for (const auto& info : Keywords) {
+                    const auto length = std::strlen(info.name);
+                    if (static_cast<std::size_t>(end - begin) == length && std::memcmp(begin, info.name, length) == 0) return &info;
+                }
+                return nullptr;
+            }
+
+            // Statements and their numbers, up to the first error. Lines are still counted after one, so that the
+            // chunks after it get their line numbers right.
+            inline void parseChunk(Chunk& chunk) {
+                chunk.numLines = 0;
+                const char* lineBegin = chunk.begin;
+                while (lineBegin < chunk.end) {
+                    const auto* newline = static_cast<const char*>(std::memchr(lineBegin, '\n', chunk.end - lineBegin));
+                    const char* lineEnd = newline ? newline : chunk.end;
+                    const auto* comment = static_cast<const char*>(std::memchr(lineBegin, '#', lineEnd - lineBegin));
+                    const char* contentEnd = comment ? comment : lineEnd;
+                    const char* cursor = lineBegin;
+                    const int line = ++chunk.numLines;
+                    lineBegin = lineEnd + 1;
+                    if (!chunk.error.empty()) continue;
+
+                    const auto fail = [&chunk, line](const std::string& error) {
+                        chunk.error = error;
+                        chunk.errorLine = line;
+                    };
+                    const char* tokenBegin;
+                    const char* tokenEnd;
+                    if (!nextToken(cursor, contentEnd, tokenBegin, tokenEnd)) continue;
+                    const auto* info = findKeyword(tokenBegin, tokenEnd);
+                    if (!info) {
+                        fail("Unknown statement: " + std::string(tokenBegin, tokenEnd));
+                        continue;
+                    }
+
+                    Statement statement{info->keyword, line, static_cast<int>(chunk.numbers.size()), 0, {}, {}};
+                    if (info->named) {
+                        if (!nextToken(cursor, contentEnd, tokenBegin, tokenEnd)) {
+                            fail(std::string(info->name) + " needs a material name");
+                            continue;
+                        }
+                        statement.name.assign(tokenBegin, tokenEnd);
+                    }
+                    if (info->keyword == Keyword::Material) {
+                        statement.text.assign(cursor, contentEnd);
+                        chunk.statements.push_back(std::move(statement));
+                        continue;
+                    }
+
+                    bool numeric = true;
+                    while (numeric && nextToken(cursor, contentEnd, tokenBegin, tokenEnd)) {
+                        double value;
+                        numeric = parseNumber(tokenBegin, tokenEnd, value);
+                        if (numeric) {
+                            chunk.numbers.push_back(value);
+                            ++statement.numNumbers;
+                        }
+                    }
+                    if (!numeric) {
+                        fail("Expected a number, got: " + std::string(tokenBegin, tokenEnd));
+                    } else if (statement.numNumbers < info->minNumbers || (info->maxNumbers >= 0 && statement.numNumbers > info->maxNumbers)) {
+                        fail(std::string(info->name) + " takes " + (info->maxNumbers < 0 ? "at least " + std::to_string(info->minNumbers)
+                             : info->minNumbers == info->maxNumbers ? std::to_string(info->minNumbers)
+                             : std::to_string(info->minNumbers) + " to " + std::to_string(info->maxNumbers))
+                             + " numbers, got " + std::to_string(statement.numNumbers));
+                    } else {
+                        chunk.statements.push_back(std::move(statement));
+                    }
+                }
+            }
+
+            struct MaterialKey {
+                std::string name;
+                std::vector<float> values;
+            };
+
+            template <typename Material>
+            bool setBaseKey(Material& material, const MaterialKey& key) {
+                if (key.name == "color") material.setColor({key.values[0], key.values[1], key.values[2]});
+                else if (key.name == "ambient") material.setAmbientIntensity(key.values[0]);
+                else if (key.name == "diffuse") material.setDiffuseIntensity(key.values[0]);
+                else return false;
+                return true;
+            }
+
+            inline bool setKey(Matte& material, const MaterialKey& key) {
+                return setBaseKey(material, key);
+            }
+
+            inline bool setKey(Glossy& material, const MaterialKey& key) {
+                if (setBaseKey(material, key)) return true;
+                if (key.name == "specular") material.setSpecularIntensity(key.values[0]);
+                else if (key.name == "exponent") material.setSpecularExponent(key.values[0]);
+                else return false;
+                return true;
+            }
+
+            inline bool setKey(Reflective& material, const MaterialKey& key) {
+                if (setKey(static_cast<Glossy&>(material), key)) return true;
+                if (key.name == "reflective") material.setReflectiveIntensity(key.values[0]);
+                else if (key.name == "reflective-color") material.setReflectiveColor({key.values[0], key.values[1], key.values[2]});
+                else return false;
+                return true;
+            }
+
+            inline bool setKey(Transparent& material, const MaterialKey& key) {
+                if (setKey(static_cast<Reflective&>(material), key)) return true;
+                if (key.name == "transmission") material.setTransmissionIntensity(key.values[0]);
+                else if (key.name == "ior") material.setIor(key.values[0]);
+                else return false;
+                return true;
+            }
+
+            // The flat color the tile path draws is the material's color key, white without one
+            template <typename Material>
+            int addMaterial(Scene& scene, const std::string& kind, const std::vector<MaterialKey>& keys) {
+                Material material;
+                Color color{1.0F, 1.0F, 1.0F};
+                for (const auto& key : keys) {
+                    if (!setKey(material, key)) throw std::runtime_error(kind + " material has no " + key.name);
+                    if (key.name == "color") color = {key.values[0], key.values[1], key.values[2]};
+                }
+                return scene.addMaterial(color, material);
+            }
+
+            // The kind and key-value pairs after a material's name
+            inline int addMaterial(Scene& scene, const std::string& text) {
+                const char* cursor = text.data();
+                const char* end = cursor + text.size();
+                const char* tokenBegin;
+                const char* tokenEnd;
+                if (!nextToken(cursor, end, tokenBegin, tokenEnd)) throw std::runtime_error("material needs a kind");
+                const std::string kind(tokenBegin, tokenEnd);
+
+                std::vector<MaterialKey> keys;
+                while (nextToken(cursor, end, tokenBegin, tokenEnd)) {
+                    MaterialKey key{std::string(tokenBegin, tokenEnd), {}};
+                    const int numValues = key.name == "color" || key.name == "reflective-color" ? 3 : 1;
+                    for (int i = 0; i < numValues; ++i) {
+                        double value;
+                        if (!nextToken(cursor, end, tokenBegin, tokenEnd) || !parseNumber(tokenBegin, tokenEnd, value)) {
+                            throw std::runtime_error(key.name + " takes " + std::to_string(numValues) + " numbers");
+                        }
+                        key.values.push_back(static_cast<float>(value));
+                    }
+                    keys.push_back(std::move(key));
+                }
+
+                if (kind == "matte") return addMaterial<Matte>(scene, kind, keys);
+                if (kind == "glossy") return addMaterial<Glossy>(scene, kind, keys);
+                if (kind == "reflective") return addMaterial<Reflective>(scene, kind, keys);
+                if (kind == "transparent") return addMaterial<Transparent>(scene, kind, keys);
+                throw std::runtime_error("Unknown material kind: " + kind);
+            }
+
+            // A mesh statement and the v / vn / f lines after it, added to the scene at the first other statement
+            struct PendingMesh {
+                bool open = false;
+                int material = 0;
+                std::string where;
+                std::vector<Vec3<Real>> vertices;
+                std::vector<Vec3<Real>> normals;
+                std::vector<int> indices;
+            };
+
+            // Runs the statements in file order, straight into the scene's arrays
+            inline std::unique_ptr<Scene> build(const std::string& fileName, const std::vector<Chunk>& chunks) {
+                std::vector<int> firstLines(chunks.size());
+                int numLines = 0;
+                for (std::size_t i = 0; i < chunks.size(); ++i) {
+                    firstLines[i] = numLines;
+                    numLines += chunks[i].numLines;
+                }
+                const auto where = [&](std::size_t chunk, int line) {
+                    return fileName + ":" + std::to_string(firstLines[chunk] + line) + ": ";
+                };
+                for (std::size_t i = 0; i < chunks.size(); ++i) {
+                    if (!chunks[i].error.empty()) throw std::runtime_error(where(i, chunks[i].errorLine) + chunks[i].error);
+                }
+
+                // The scene is made with its camera and background, so those are looked for first
+                bool hasCamera = false;
+                Camera camera;
+                Color background{0.0F, 0.0F, 0.0F};
+                for (std::size_t i = 0; i < chunks.size(); ++i) {
+                    for (const auto& statement : chunks[i].statements) {
+                        const double* n = chunks[i].numbers.data() + statement.firstNumber;
+                        if (statement.keyword == Keyword::Camera) {
+                            if (hasCamera) throw std::runtime_error(where(i, statement.line) + "The scene already has a camera");
+                            camera = Camera({static_cast<Real>(n[0]), static_cast<Real>(n[1]), static_cast<Real>(n[2])},
+                                            {static_cast<Real>(n[3]), static_cast<Real>(n[4]), static_cast<Real>(n[5])},
+                                            {static_cast<Real>(n[6]), static_cast<Real>(n[7]), static_cast<Real>(n[8])},
+                                            static_cast<float>(n[9]));
+                            hasCamera = true;
+                        } else if (statement.keyword == Keyword::Background) {
+                            background = {static_cast<float>(n[0]), static_cast<float>(n[1]), static_cast<float>(n[2])};
+                        }
+                    }
+                }
+                if (!hasCamera) throw std::runtime_error(fileName + ": The scene has no camera");
+
+                auto scene = Utils::make_unique<Scene>(camera, background);
+                std::unordered_map<std::string, int> materials;
+                PendingMesh mesh;
+                const auto addMesh = [&] {
+                    if (!mesh.open) return;
+                    try {
+                        scene->addMesh(mesh.vertices, mesh.normals, mesh.indices, mesh.material);
+                    } catch (const std::runtime_error& e) {
+                        throw std::runtime_error(mesh.where + e.what());
+                    }
+                    mesh = PendingMesh{};
+                };
+
+                for (std::size_t i = 0; i < chunks.size(); ++i) {
+                    const auto& chunk = chunks[i];
+                    for (const auto& statement : chunk.statements) {
+                        const double* n = chunk.numbers.data() + statement.firstNumber;
+                        const auto vec = [n](int first) {
+                            return Vec3<Real>{static_cast<Real>(n[first]), static_cast<Real>(n[first + 1]), static_cast<Real>(n[first + 2])};
+                        };
+                        const auto color = [n](int first) {
+                            return Color{static_cast<float>(n[first]), static_cast<float>(n[first + 1]), static_cast<float>(n[first + 2])};
+                        };
+                        const auto material = [&]() {
+                            const auto found = materials.find(statement.name);
+                            if (found == materials.end()) throw std::runtime_error(where(i, statement.line) + "Unknown material: " + statement.name);
+                            return found->second;
+                        };
+                        const bool meshLine = statement.keyword == Keyword::Vertex || statement.keyword == Keyword::Normal
+                                           || statement.keyword == Keyword::Face;
+                        if (!meshLine) {
+                            addMesh();
+                        } else if (!mesh.open) {
+                            throw std::runtime_error(where(i, statement.line) + "Vertex data outside of a mesh");
+                        }
+
+                        switch (statement.keyword) {
+                        case Keyword::Camera:
+                        case Keyword::Background:
+                            break;
+                        case Keyword::Ambient:
+                            scene->ambientLight.color = color(0);
+                            scene->ambientLight.radianceScale = static_cast<float>(n[3]);
+                            if (statement.numNumbers > 4) scene->ambientLight.minAmount = static_cast<float>(n[4]);
+                            break;
+                        case Keyword::Material:
+                            if (materials.count(statement.name)) {
+                                throw std::runtime_error(where(i, statement.line) + "Material " + statement.name + " is already defined");
+                            }
+                            try {
+                                materials[statement.name] = addMaterial(*scene, statement.text);
+                            } catch (const std::runtime_error& e) {
+                                throw std::runtime_error(where(i, statement.line) + e.what());
+                            }
+                            break;
+                        case Keyword::PointLight:
+                            scene->addLight(PointLight{color(3), static_cast<float>(n[6]), vec(0)});
+                            break;
+                        case Keyword::DirectionalLight:
+                            scene->addLight(DirectionalLight{color(3), static_cast<float>(n[6]), vec(0)});
+                            break;
+                        case Keyword::Sphere:
+                            scene->addSphere(vec(0), static_cast<Real>(n[3]), material());
+                            break;
+                        case Keyword::Plane:
+                            scene->addPlane(vec(0), vec(3).normalizeAndReturn(), material());
+                            break;
+                        case Keyword::Rectangle:
+                            scene->addRectangle(vec(0), vec(3), vec(6), vec(9).normalizeAndReturn(), material());
+                            break;
+                        case Keyword::Mesh:
+                            mesh.open = true;
+                            mesh.material = material();
+                            mesh.where = where(i, statement.line);
+                            break;
+                        case Keyword::Vertex:
+                            mesh.vertices.push_back(vec(0));
+                            break;
+                        case Keyword::Normal:
+                            mesh.normals.push_back(vec(0));
+                            break;
+                        case Keyword::Face:
+                            for (int k = 0; k < statement.numNumbers; ++k) {
+                                if (n[k] < 0.0 || n[k] > 2147483647.0 || n[k] != std::floor(n[k])) {
+                                    throw std::runtime_error(where(i, statement.line) + "Face indices are whole numbers from 0");
+                                }
+                            }
+                            for (int k = 1; k + 1 < statement.numNumbers; ++k) {
+                                mesh.indices.push_back(static_cast<int>(n[0]));
+                                mesh.indices.push_back(static_cast<int>(n[k]));
+                                mesh.indices.push_back(static_cast<int>(n[k + 1]));
+                            }
+                            break;
+                        }
+                    }
+                }
+                addMesh();
+                return scene;
+            }
+        } // namespace Internal
+
+        // The file is mapped and cut at line breaks into chunks of at least MinChunkSize, which the thread pool
+        // tokenizes side by side. Building the scene from their statements stays sequential, it's in file order and
+        // only appends to arrays.
+        inline std::unique_ptr<Scene> load(const std::string& fileName) {
+            const SceneCache::MappedFile file(fileName);
+            const char* data = reinterpret_cast<const char*>(file.getData());
+            const std::size_t size = file.getSize();
+            auto& pool = Utils::ThreadPool::instance();
+            const std::size_t numChunks = std::max<std::size_t>(1, std::min<std::size_t>(size / Internal::MinChunkSize,
+                                                                                         4 * static_cast<std::size_t>(pool.size())));
+
+            std::vector<Internal::Chunk> chunks(numChunks);
+            const char* begin = data;
+            for (std::size_t i = 0; i < numChunks; ++i) {
+                const char* end = data + size;
+                if (i + 1 < numChunks) {
+                    const char* split = std::max(begin, data + size / numChunks * (i + 1));
+                    const auto* newline = static_cast<const char*>(std::memchr(split, '\n', data + size - split));
+                    if (newline) end = newline + 1;
+                }
+                chunks[i].begin = begin;
+                chunks[i].end = end;
+                begin = end;
+            }
+
+            // Tasks can't let exceptions out of the pool, running out of memory ends up as the chunk's error
+            pool.parallelFor(static_cast<int>(numChunks), [&chunks](int i) {
+                try {
+                    Internal::parseChunk(chunks[i]);
+                } catch (const std::exception& e) {
+                    chunks[i].error = e.what();
+                    chunks[i].errorLine = chunks[i].numLines;
+                }
+            });
+            return Internal::build(fileName, chunks);
+        }
+
+        inline bool isSceneFile(const std::string& name) {
+            const std::string extension = ".scene";
+            return name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0;
+        }
+    } // namespace SceneFile
+} // namespace Smurf
@@ -5,9 +5,20 @@ namespace Smurf {
         const int NumSamples = 16;
         const int HRes = 1920;
         const int VRes = 1200;
+        const int TileSize = 32;
+
+        // Every pixel starts out with InitialSamples and keeps being sampled until the standard error of its mean
+        // luminance drops below ErrorThreshold, up to MaxSamples. Disabled, every pixel gets exactly NumSamples.
+        // Off unless a render config turns it on (adaptive = on, --adaptive on), so images stay as they were.
+        namespace Adaptive {
+            const bool Enabled = false;
+            const int InitialSamples = 4;
+            const int MaxSamples = 4 * NumSamples;
+            const float ErrorThreshold = 0.004F;
+        } // namespace Adaptive
 
         namespace Internal {
-            const int NumSupportedPrimitives = 3;
+            const int NumSupportedPrimitives = 4;
             const double HemisphereMapFactor = 1.0;
             const int NumSampleGroups = 79;
         } // namespace Internal
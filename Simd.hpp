@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Real.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace Smurf {
+    namespace Simd {
+        enum class InstructionSet { Scalar, SSE2, AVX2, AVX512 };
+
+        // Best instruction set both the CPU and the OS support, queried once at runtime
+        inline InstructionSet detectInstructionSet() {
+            #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) return InstructionSet::AVX512;
+            if (__builtin_cpu_supports("avx2")) return InstructionSet::AVX2;
+            if (__builtin_cpu_supports("sse2")) return InstructionSet::SSE2;
+            return InstructionSet::Scalar;
+            #elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+            int info[4];
+            __cpuid(info, 0);
+            const int maxLeaf = info[0];
+            __cpuid(info, 1);
+            const bool sse2 = (info[3] & (1 << 26)) != 0;
+            const bool osxsave = (info[2] & (1 << 27)) != 0;
+            const bool avx = (info[2] & (1 << 28)) != 0;
+            // The OS has to save the wide registers on context switches too
+            const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+            const bool osAvx = (xcr0 & 0x6) == 0x6;
+            const bool osAvx512 = (xcr0 & 0xE6) == 0xE6;
+            if (maxLeaf >= 7 && avx && osAvx) {
+                __cpuidex(info, 7, 0);
+                if ((info[1] & (1 << 16)) != 0 && osAvx512) return InstructionSet::AVX512;
+                if ((info[1] & (1 << 5)) != 0) return InstructionSet::AVX2;
+            }
+            return sse2 ? InstructionSet::SSE2 : InstructionSet::Scalar;
+            #else
+            return InstructionSet::Scalar;
+            #endif
+        }
+
+        inline const char* name(InstructionSet instructionSet) {
+            switch (instructionSet) {
+                case InstructionSet::AVX512: return "AVX-512";
+                case InstructionSet::AVX2: return "AVX2";
+                case InstructionSet::SSE2: return "SSE2";
+                default: return "Scalar";
+            }
+        }
+
+        // Rays per packet, two registers' worth of Reals per lane group - twice as many in single precision
+        const int PacketWidthSSE2 = 2 * 16 / sizeof(Real);
+        const int PacketWidthAVX2 = 2 * 32 / sizeof(Real);
+        const int PacketWidthAVX512 = 2 * 64 / sizeof(Real);
+
+        inline int packetWidth(InstructionSet instructionSet) {
+            switch (instructionSet) {
+                case InstructionSet::AVX512: return PacketWidthAVX512;
+                case InstructionSet::AVX2: return PacketWidthAVX2;
+                default: return PacketWidthSSE2;
+            }
+        }
+
+        // sin and cos for |angle| <= pi/4 as plain polynomials, good to about 1e-14 - no calls and no branches, so that
+        // loops over them vectorize
+        inline void sinCosQuarter(double angle, double& sine, double& cosine) {
+            const double a2 = angle * angle;
+            sine = angle * (1.0 + a2 * (-1.0 / 6 + a2 * (1.0 / 120 + a2 * (-1.0 / 5040 + a2 * (1.0 / 362880
+                   + a2 * (-1.0 / 39916800 + a2 * (1.0 / 6227020800)))))));
+            cosine = 1.0 + a2 * (-1.0 / 2 + a2 * (1.0 / 24 + a2 * (-1.0 / 720 + a2 * (1.0 / 40320
+                     + a2 * (-1.0 / 3628800 + a2 * (1.0 / 479001600 + a2 * (-1.0 / 87178291200)))))));
+        }
+
+        // sin and cos of a non-negative angle given in turns, reduced to the nearest quarter turn and rotated back
+        inline void sinCosTurns(double turns, double& sine, double& cosine) {
+            const int quadrant = static_cast<int>(turns * 4.0 + 0.5);
+            double s;
+            double c;
+            sinCosQuarter((turns * 4.0 - quadrant) * (3.14159265358979323846 / 2), s, c);
+            // Selects rather than a switch, those turn into blends
+            const double swappedSine = (quadrant & 1) ? c : s;
+            const double swappedCosine = (quadrant & 1) ? s : c;
+            sine = (quadrant & 2) ? -swappedSine : swappedSine;
+            cosine = ((quadrant + 1) & 2) ? -swappedCosine : swappedCosine;
+        }
+    } // namespace Simd
+} // namespace Smurf
+
+// Compiles a function (and, through flatten, everything inlined into it) for a given instruction set so that it can
+// be picked at runtime. MSVC has no per-function targets, there the code generation follows /arch for every width.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SMURF_TARGET(isa) __attribute__((target(isa), flatten))
+#else
+#define SMURF_TARGET(isa)
+#endif
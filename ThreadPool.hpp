@@ -0,0 +1,195 @@
+#pragma once
+
+#include "Wheels.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Smurf {
+    namespace Utils {
+        // Work-stealing thread pool
+        // Every worker owns a deque, pops its own work from the back and steals from the front of the others' deques
+        class ThreadPool {
+            typedef std::function<void()> Task;
+
+            struct WorkQueue {
+                std::mutex mutex;
+                std::deque<Task> tasks;
+            };
+
+            // Tasks of a single parallelFor still to finish, owned by the call that waits for them
+            struct Batch {
+                explicit Batch(int count) : remaining{count} {}
+
+                std::atomic<int> remaining;
+            };
+
+        public:
+            explicit ThreadPool(unsigned numThreads = std::thread::hardware_concurrency()) : queued{0},
+                                                                                              nextQueue{0},
+                                                                                              stop{false} {
+                if (numThreads == 0) numThreads = 1;
+                queues.reserve(numThreads);
+                for (unsigned i = 0; i < numThreads; ++i) {
+                    queues.emplace_back(Utils::make_unique<WorkQueue>());
+                }
+                workers.reserve(numThreads);
+                for (unsigned i = 0; i < numThreads; ++i) {
+                    workers.emplace_back([this, i] { workerLoop(i); });
+                }
+            }
+
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            ~ThreadPool() {
+                {
+                    std::lock_guard<std::mutex> lock(sleepMutex);
+                    stop = true;
+                }
+                wakeUp.notify_all();
+                for (auto&& worker : workers) {
+                    worker.join();
+                }
+            }
+
+            // Process-wide pool shared by the tiled renderer and the CPU backend
+            static ThreadPool& instance() {
+                static ThreadPool instance(requestedSize() == 0 ? std::thread::hardware_concurrency() : requestedSize());
+                return instance;
+            }
+
+            // Size for the process-wide pool, has to be called before its first use - 0 means one per hardware thread
+            static void configureInstance(unsigned numThreads) {
+                requestedSize() = numThreads;
+            }
+
+            unsigned size() const {
+                return static_cast<unsigned>(workers.size());
+            }
+
+            // Tasks submitted from within a worker go to its own deque, the rest are spread round robin
+            void submit(Task task) {
+                auto queueIdx = currentWorker().first == this ? currentWorker().second
+                                                              : nextQueue++ % static_cast<unsigned>(queues.size());
+                {
+                    std::lock_guard<std::mutex> lock(queues[queueIdx]->mutex);
+                    queues[queueIdx]->tasks.emplace_back(std::move(task));
+                }
+                {
+                    std::lock_guard<std::mutex> lock(sleepMutex);
+                    ++queued;
+                }
+                wakeUp.notify_one();
+            }
+
+            // Runs closure(i) for i in [0, count) and blocks until all of them are done
+            // Only waits for its own tasks, so it can be called from within a worker or by several threads at once
+            template <typename F>
+            void parallelFor(int count, F&& closure) {
+                if (count <= 0) return;
+                Batch batch(count);
+                for (int i = 0; i < count; ++i) {
+                    submit([&closure, &batch, this, i] {
+                        closure(i);
+                        finish(batch);
+                    });
+                }
+                wait(batch);
+            }
+
+        private:
+            static unsigned& requestedSize() {
+                static unsigned numThreads = 0;
+                return numThreads;
+            }
+
+            static std::pair<const ThreadPool*, unsigned>& currentWorker() {
+                static thread_local std::pair<const ThreadPool*, unsigned> worker{nullptr, 0};
+                return worker;
+            }
+
+            bool tryPopOwn(unsigned queueIdx, Task& task) {
+                std::lock_guard<std::mutex> lock(queues[queueIdx]->mutex);
+                if (queues[queueIdx]->tasks.empty()) return false;
+                task = std::move(queues[queueIdx]->tasks.back());
+                queues[queueIdx]->tasks.pop_back();
+                return true;
+            }
+
+            bool trySteal(unsigned firstVictim, Task& task) {
+                for (unsigned i = 0; i < queues.size(); ++i) {
+                    auto& victim = *queues[(firstVictim + i) % queues.size()];
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (victim.tasks.empty()) continue;
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    return true;
+                }
+                return false;
+            }
+
+            void run(Task& task) {
+                {
+                    std::lock_guard<std::mutex> lock(sleepMutex);
+                    --queued;
+                }
+                task();
+                task = nullptr;
+            }
+
+            // Waiters sleep on the same condition as idle workers, so the last task of a batch wakes them all
+            void finish(Batch& batch) {
+                if (--batch.remaining == 0) {
+                    std::lock_guard<std::mutex> lock(sleepMutex);
+                    wakeUp.notify_all();
+                }
+            }
+
+            // Blocks until the batch has finished, the calling thread runs queued tasks in the meantime - any of them,
+            // the batch's own may be stuck behind others in a deque
+            void wait(Batch& batch) {
+                const bool isWorker = currentWorker().first == this;
+                const unsigned queueIdx = isWorker ? currentWorker().second : 0;
+                Task task;
+                while (batch.remaining > 0) {
+                    if ((isWorker && tryPopOwn(queueIdx, task)) || trySteal(queueIdx, task)) {
+                        run(task);
+                        continue;
+                    }
+                    std::unique_lock<std::mutex> lock(sleepMutex);
+                    wakeUp.wait(lock, [this, &batch] { return batch.remaining == 0 || queued > 0; });
+                }
+            }
+
+            void workerLoop(unsigned queueIdx) {
+                currentWorker() = std::make_pair(this, queueIdx);
+                Task task;
+                for (;;) {
+                    if (tryPopOwn(queueIdx, task) || trySteal(queueIdx + 1, task)) {
+                        run(task);
+                        continue;
+                    }
+                    std::unique_lock<std::mutex> lock(sleepMutex);
+                    wakeUp.wait(lock, [this] { return stop || queued > 0; });
+                    if (stop && queued == 0) return;
+                }
+            }
+
+        private:
+            std::vector<std::unique_ptr<WorkQueue>> queues;
+            std::vector<std::thread> workers;
+            std::mutex sleepMutex;
+            std::condition_variable wakeUp;
+            int queued; // Guarded by sleepMutex
+            std::atomic<unsigned> nextQueue;
+            bool stop;
+        };
+    } // namespace Utils
+} // namespace Smurf
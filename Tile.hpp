@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+namespace Smurf {
+    // Rectangular block of the framebuffer, [x0, x1) * [y0, y1)
+    struct Tile {
+        Tile() : x0{0}, y0{0}, x1{0}, y1{0} { }
+        Tile(int x0, int y0, int x1, int y1) : x0{x0}, y0{y0}, x1{x1}, y1{y1} { }
+
+        int width() const {
+            return x1 - x0;
+        }
+
+        int height() const {
+            return y1 - y0;
+        }
+
+        int x0, y0, x1, y1;
+    };
+
+    // Splits the framebuffer into tileSize * tileSize blocks, the ones on the right and top edges get clipped
+    inline std::vector<Tile> makeTiles(int hRes, int vRes, int tileSize) {
+        std::vector<Tile> tiles;
+        tiles.reserve(((hRes + tileSize - 1) / tileSize) * ((vRes + tileSize - 1) / tileSize));
+        for (int y = 0; y < vRes; y += tileSize) {
+            for (int x = 0; x < hRes; x += tileSize) {
+                tiles.emplace_back(x, y, std::min(x + tileSize, hRes), std::min(y + tileSize, vRes));
+            }
+        }
+        return tiles;
+    }
+} // namespace Smurf
@@ -7,20 +7,23 @@
 #include <string>
 
 namespace Smurf {
+    // Monotonic, so that measurements don't jump along with the wall clock
     class Timer {
-        std::chrono::time_point<std::chrono::system_clock> startTime, endTime;
+        std::chrono::time_point<std::chrono::steady_clock> startTime, endTime;
     public:
-        std::chrono::time_point<std::chrono::system_clock> start() {
-            startTime = std::chrono::system_clock::now();
+        std::chrono::time_point<std::chrono::steady_clock> start() {
+            startTime = std::chrono::steady_clock::now();
             return startTime;
         }
-        std::chrono::time_point<std::chrono::system_clock> end() {
-            endTime = std::chrono::system_clock::now();
+        std::chrono::time_point<std::chrono::steady_clock> end() {
+            endTime = std::chrono::steady_clock::now();
             return endTime;
         }
+        double seconds() const {
+            return std::chrono::duration<double>(endTime - startTime).count();
+        }
         std::string elapsed() const {
-            std::chrono::duration<double> elapsed_seconds = endTime - startTime;
-            return std::string("Elapsed time: ") + std::to_string(elapsed_seconds.count()) + "s";
+            return std::string("Elapsed time: ") + std::to_string(seconds()) + "s";
         }
         template <typename F, typename... Args>
         auto timedOperation(F closure, Args&&... args) -> std::pair<decltype(closure(std::forward<Args>(args)...)), std::string> {
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Backend.hpp"
+#include "Ray.hpp"
+#include "Vec3.hpp"
+#include "Real.hpp"
+
+namespace Smurf {
+    inline Real component(const Vec3<Real>& vec, int axis) restrict(cpu, amp) {
+        return axis == 0 ? vec.x : axis == 1 ? vec.y : vec.z;
+    }
+
+    // The per-ray half of the watertight ray/triangle test (Woop, Benthin and Wald, "Watertight Ray/Triangle
+    // Intersection") - the axes get permuted so that the ray's dominant one is z, and a shear turns the ray into +z
+    // Set up once per ray and shared by every triangle it's tested against
+    struct WatertightRay {
+        WatertightRay() restrict(cpu, amp) { }
+        explicit WatertightRay(const Ray& ray) restrict(cpu, amp) : origin{ray.origin} {
+            const Real absX = ray.direction.x < 0 ? -ray.direction.x : ray.direction.x;
+            const Real absY = ray.direction.y < 0 ? -ray.direction.y : ray.direction.y;
+            const Real absZ = ray.direction.z < 0 ? -ray.direction.z : ray.direction.z;
+            kz = absX > absY ? (absX > absZ ? 0 : 2) : (absY > absZ ? 1 : 2);
+            kx = kz == 2 ? 0 : kz + 1;
+            ky = kx == 2 ? 0 : kx + 1;
+            // Keeps the winding, and with it the sign of the edge functions, the same
+            if (component(ray.direction, kz) < 0) {
+                const int swapped = kx;
+                kx = ky;
+                ky = swapped;
+            }
+            shearX = component(ray.direction, kx) / component(ray.direction, kz);
+            shearY = component(ray.direction, ky) / component(ray.direction, kz);
+            shearZ = 1 / component(ray.direction, kz);
+        }
+
+        Vec3<Real> origin;
+        int kx, ky, kz;
+        Real shearX, shearY, shearZ;
+    };
+
+    // True if the ray hits the triangle at 0 < t < tMax, with t and the barycentric weights of v1 and v2 written out
+    // Edges shared by two triangles are never missed nor hit twice, the edge functions are exactly the same for both
+    inline bool intersectTriangle(const WatertightRay& ray, const Vec3<Real>& v0, const Vec3<Real>& v1, const Vec3<Real>& v2,
+                                  Real tMax, Real& t, Real& b1, Real& b2) restrict(cpu, amp) {
+        const auto a = v0 - ray.origin;
+        const auto b = v1 - ray.origin;
+        const auto c = v2 - ray.origin;
+        const Real ax = component(a, ray.kx) - ray.shearX * component(a, ray.kz);
+        const Real ay = component(a, ray.ky) - ray.shearY * component(a, ray.kz);
+        const Real bx = component(b, ray.kx) - ray.shearX * component(b, ray.kz);
+        const Real by = component(b, ray.ky) - ray.shearY * component(b, ray.kz);
+        const Real cx = component(c, ray.kx) - ray.shearX * component(c, ray.kz);
+        const Real cy = component(c, ray.ky) - ray.shearY * component(c, ray.kz);
+
+        Real u = cx * by - cy * bx;
+        Real v = ax * cy - ay * cx;
+        Real w = bx * ay - by * ax;
+        // Right on an edge single precision can't tell the side, double precision settles it
+        if (sizeof(Real) < sizeof(double) && (u == 0 || v == 0 || w == 0)) {
+            u = static_cast<Real>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+            v = static_cast<Real>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+            w = static_cast<Real>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+        }
+        if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) return false;
+
+        const Real determinant = u + v + w;
+        if (determinant == 0) return false;
+
+        const Real scaledT = u * ray.shearZ * component(a, ray.kz) + v * ray.shearZ * component(b, ray.kz)
+                           + w * ray.shearZ * component(c, ray.kz);
+        const Real hitT = scaledT / determinant;
+        if (hitT <= 0 || hitT >= tMax) return false;
+
+        t = hitT;
+        b1 = v / determinant;
+        b2 = w / determinant;
+        return true;
+    }
+
+    // Counter-clockwise seen from the front
+    inline Vec3<Real> triangleNormal(const Vec3<Real>& v0, const Vec3<Real>& v1, const Vec3<Real>& v2) restrict(cpu, amp) {
+        return (v1 - v0).crossProduct(v2 - v0).normalizeAndReturn();
+    }
+} // namespace Smurf
@@ -1,8 +1,8 @@
 #pragma once
 
-#ifdef USE_AMP
-#include <amp_math.h>
-#endif
+#include "Backend.hpp"
+
+#include <cmath>
 
 namespace Smurf {
     template <typename T>
@@ -62,7 +62,7 @@ namespace Smurf {
         #ifdef USE_AMP
         
         inline double length() const restrict(amp) {
-            return Concurrency::fast_math::sqrtf(static_cast<float>(x * x + y * y));
+            return Backend::fast_math::sqrtf(static_cast<float>(x * x + y * y));
         }
 
         #endif
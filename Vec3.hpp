@@ -1,8 +1,8 @@
 #pragma once
 
-#ifdef USE_AMP
-#include <amp_math.h>
-#endif
+#include "Backend.hpp"
+
+#include <cmath>
 
 namespace Smurf {
     template <typename T>
@@ -50,32 +50,32 @@ namespace Smurf {
                    lhs.z * rhs.z;
         }
 
-        inline friend Vec3<T> operator*(const Vec3<T>& lhs, double scalar) restrict(cpu, amp) {
+        inline friend Vec3<T> operator*(const Vec3<T>& lhs, T scalar) restrict(cpu, amp) {
             return { lhs.x * scalar,
                      lhs.y * scalar,
                      lhs.z * scalar };
         }
 
-        inline friend Vec3<T> operator*(double scalar, const Vec3<T>& rhs) restrict(cpu, amp) {
+        inline friend Vec3<T> operator*(T scalar, const Vec3<T>& rhs) restrict(cpu, amp) {
             return rhs * scalar;
         }
 
         inline void normalize() restrict(cpu, amp) {
-            double len = length();
+            T len = length();
             x /= len; y /= len; z /= len;
         }
 
         inline Vec3<T> normalizeAndReturn() restrict(cpu, amp) {
-            double len = length();
+            T len = length();
             x /= len; y /= len; z /= len;
             return *this;
         }
 
-        inline double length() const restrict(cpu) {
-            return sqrt(x * x + y * y + z * z);
+        inline T length() const restrict(cpu) {
+            return std::sqrt(x * x + y * y + z * z);
         }
 
-        inline double lengthSquared() const restrict(cpu, amp) {
+        inline T lengthSquared() const restrict(cpu, amp) {
             return x * x + y * y + z * z;
         }
 
@@ -89,7 +89,7 @@ namespace Smurf {
 
         inline T distance(const Vec3<T>& other) const restrict(amp) {
             return {
-                Concurrency::fast_math::sqrtf(
+                Backend::fast_math::sqrtf(
                     static_cast<float>(
                         (x - other.x) * (x - other.x) +
                         (y - other.y) * (y - other.y) +
@@ -99,8 +99,16 @@ namespace Smurf {
             };
         }
 
-        inline double length() const restrict(amp) {
-            return Concurrency::fast_math::sqrtf(static_cast<float>(x * x + y * y + z * z));
+        inline T length() const restrict(amp) {
+            return Backend::fast_math::sqrtf(static_cast<float>(x * x + y * y + z * z));
+        }
+
+        #else
+
+        inline T distance(const Vec3<T>& other) const {
+            return std::sqrt((x - other.x) * (x - other.x) +
+                        (y - other.y) * (y - other.y) +
+                        (z - other.z) * (z - other.z));
         }
        
         #endif
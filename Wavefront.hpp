@@ -0,0 +1,132 @@
+#pragma once
+
+#include "GeometricObject.hpp"
+#include "Material.hpp"
+#include "Instrumentation.hpp"
+#include "Random.hpp"
+#include "Color.hpp"
+#include "Ray.hpp"
+#include "Simd.hpp"
+#include "Vec3.hpp"
+#include "Real.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Smurf {
+    namespace Wavefront {
+        // Paths that have hit this many surfaces go on with a probability that follows their throughput
+        const int RouletteDepth = 2;
+
+        // The shadow stage runs whenever this many occlusion queries have queued up, many lights would otherwise grow
+        // the queue well past the cache
+        const int ShadowBatchSize = 2048;
+
+        // One camera sample on its way through the scene
+        struct Path {
+            int pixel;          // The pixel's slot in the tile
+            Color throughput;   // What the next surface sends back along the path arrives scaled by this
+            Color radiance;     // Everything that has reached the camera along the path so far
+        };
+
+        // The stage queues - extend finds every ray's closest hit, shade turns hits into shadow rays and bounces,
+        // shadow adds up the contributions that nothing blocks
+        struct ExtendItem {
+            int path;
+            int depth;          // Surfaces hit before this ray, 0 for the camera ray
+            Ray ray;
+        };
+
+        struct ShadeItem {
+            int path;
+            int depth;
+            Ray ray;
+            g_RayHit hit;
+        };
+
+        struct ShadowItem {
+            int path;
+            Ray ray;
+            Real tMax;
+            Color contribution;         // Added to the path's radiance if the ray gets through
+            int* lastOccluder;          // The tile's OcclusionCache slot for the light
+            Instrumentation::LightType lightType;
+            int light;                  // -1 for ambient occlusion rays
+        };
+
+        inline float maxComponent(const Color& color) {
+            return std::max(color.red, std::max(color.green, color.blue));
+        }
+
+        inline Vec3<Real> reflect(const Vec3<Real>& direction, const Vec3<Real>& normal) {
+            return direction - (2 * (direction * normal)) * normal;
+        }
+
+        // Direction bent by Snell's law, false on total internal reflection
+        // The normal faces the outside, leaving the surface from the inside inverts the index of refraction
+        inline bool refract(const Vec3<Real>& direction, Vec3<Real> normal, float ior, Vec3<Real>& refracted) {
+            Real cosIncident = -(direction * normal);
+            Real eta = ior;
+            if (cosIncident < 0) {
+                normal = -normal;
+                cosIncident = -cosIncident;
+                eta = 1 / eta;
+            }
+            const Real cosTransmittedSquared = 1 - (1 - cosIncident * cosIncident) / (eta * eta);
+            if (cosTransmittedSquared < 0) return false;
+            refracted = (1 / eta) * direction + (cosIncident / eta - std::sqrt(cosTransmittedSquared)) * normal;
+            return true;
+        }
+
+        // Cosine-weighted around the normal - the Lambertian's cosine and pdf cancel, leaving rho as the weight
+        inline Vec3<Real> cosineDirection(const Vec3<Real>& normal, float u1, float u2) {
+            Vec3<Real> tangent;
+            Vec3<Real> bitangent;
+            tangentFrame(normal, tangent, bitangent);
+            double sine;
+            double cosine;
+            Simd::sinCosTurns(u2, sine, cosine);
+            const Real radius = std::sqrt(static_cast<Real>(u1));
+            return static_cast<Real>(radius * cosine) * bitangent + static_cast<Real>(radius * sine) * tangent
+                 + std::sqrt(static_cast<Real>(1 - u1)) * normal;
+        }
+
+        // Continues a path off a surface - one of diffuse, mirror and transmission, picked with odds that follow how
+        // much each passes on. The picked one's weight is divided by its odds, so the estimate stays unbiased.
+        // The glossy lobe isn't sampled, it only lights the surface directly. False if nothing passes light on.
+        inline bool scatter(const g_Material& material, const Ray& ray, const Vec3<Real>& normal, const Vec3<Real>& hitPoint,
+                            Random::CounterRng& rng, Ray& next, Color& weight) {
+            auto diffuse = material.diffuse.rho();
+            auto mirror = material.reflective.rho();
+            float transmission = material.transmitter.intensity;
+            Vec3<Real> refracted{0, 0, 0}; // Only read if transmission survives the check below, which sets it
+            if (transmission > 0 && !refract(ray.direction, normal, material.transmitter.ior, refracted)) {
+                // Total internal reflection, whatever would have gone through is mirrored instead
+                mirror += Color{transmission, transmission, transmission};
+                transmission = 0;
+            }
+
+            const float diffuseOdds = diffuse.luminance();
+            const float mirrorOdds = mirror.luminance();
+            const float total = diffuseOdds + mirrorOdds + transmission;
+            if (total <= 0) return false;
+
+            // Bounces leave on the side the ray came from, transmissions on the other one
+            const auto facing = ray.direction * normal < 0 ? normal : -normal;
+            const float pick = rng.nextFloat() * total;
+            if (pick < diffuseOdds) {
+                weight = diffuse * (total / diffuseOdds);
+                const float u1 = rng.nextFloat();
+                const float u2 = rng.nextFloat();
+                next = {offsetFromSurface(hitPoint, facing), cosineDirection(facing, u1, u2)};
+            } else if (pick < diffuseOdds + mirrorOdds) {
+                weight = mirror * (total / mirrorOdds);
+                next = {offsetFromSurface(hitPoint, facing), reflect(ray.direction, facing)};
+            } else {
+                weight = Color{total, total, total};
+                next = {offsetFromSurface(hitPoint, -facing), refracted};
+            }
+            return true;
+        }
+    } // namespace Wavefront
+} // namespace Smurf
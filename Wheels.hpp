@@ -3,10 +3,16 @@
 #include <stdint.h>
 #include <memory>
 #include <limits>
-#include <random>
 #include <chrono>
 #include <ctime>
 #include <algorithm>
+#include <string>
+#include <tuple>
+#include <ostream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #ifdef USE_AMP
 #undef max
@@ -18,16 +24,18 @@ namespace Smurf {
     typedef uint16_t word;
     typedef uint32_t dword;
     typedef uint64_t qword;
-    const double ReciprocalPi = 1 / std::_Pi;
-    const double TwoPi = std::_Pi * 2;
-    const double PiHalf = std::_Pi / 2;
-    const double PiQuarter = std::_Pi / 4;
+    const double Pi = 3.14159265358979323846;
+    const double ReciprocalPi = 1 / Pi;
+    const double TwoPi = Pi * 2;
+    const double PiHalf = Pi / 2;
+    const double PiQuarter = Pi / 4;
     namespace CompileTime {
         // Endian manipulation
         inline byte _swapEndian(byte arg) {
             return arg;
         }
 
+        #ifdef _MSC_VER
         inline word _swapEndian(word arg) {
             return _byteswap_ushort(arg);
         }
@@ -39,6 +47,19 @@ namespace Smurf {
         inline qword _swapEndian(qword arg) {
             return _byteswap_uint64(arg);
         }
+        #else
+        inline word _swapEndian(word arg) {
+            return __builtin_bswap16(arg);
+        }
+
+        inline dword _swapEndian(dword arg) {
+            return __builtin_bswap32(arg);
+        }
+
+        inline qword _swapEndian(qword arg) {
+            return __builtin_bswap64(arg);
+        }
+        #endif
 
         template <typename T>
         inline T swapEndian(const T& arg) {
@@ -96,7 +117,7 @@ namespace Smurf {
         };
 
         // Foreach elem in tuple
-        void applyToAll() { }
+        inline void applyToAll() { }
 
         template <typename Lambda, typename... Lambdas>
         void applyToAll(Lambda&& closure, Lambdas&&... closures) {
@@ -145,12 +166,12 @@ namespace Smurf {
         // TODO - constexpr
         template <typename Tuple, int N>
         struct _RelevantTupleSize {
-            static const int value = sizeof(std::tuple_element<N, Tuple>::type) + _RelevantTupleSize<Tuple, N - 1>::value;
+            static const int value = sizeof(typename std::tuple_element<N, Tuple>::type) + _RelevantTupleSize<Tuple, N - 1>::value;
         };
 
         template <typename Tuple>
         struct _RelevantTupleSize<Tuple, 0> {
-            static const int value = sizeof(std::tuple_element<0, Tuple>::type);
+            static const int value = sizeof(typename std::tuple_element<0, Tuple>::type);
         };
 
         template <typename Tuple>
@@ -159,6 +180,9 @@ namespace Smurf {
         };
 
         // Simple static square root
+        template <int N>
+        struct SimpleSquareRoot;
+
         template <int N, int C, bool D>
         struct _SquareRootInternalDispatch { };
 
@@ -218,71 +242,15 @@ namespace Smurf {
             return (bytes < 1 ? 1 : bytes) + (rmndr ? 1 : 0);
         }
 
-        // Uniform pseudo-random number generator
-        class RandomEngine {
-            std::random_device randomDevice;
-            std::mt19937 mersenneTwisterEngine;
-            std::uniform_real_distribution<> uniformRealDistribution;
-            std::uniform_real_distribution<> *customRealDistribution;
-            std::uniform_int_distribution<> uniformIntegralDistribution;
-            std::uniform_int_distribution<> *customIntegralDistribution;
-            RandomEngine() : mersenneTwisterEngine{randomDevice()},
-                             customIntegralDistribution(nullptr),
-                             customRealDistribution(nullptr) { }
-            ~RandomEngine() {
-                delete customIntegralDistribution;
-                delete customRealDistribution;
-            }
-        public:
-            static RandomEngine& instance() {
-                static RandomEngine instance;
-                return instance;
-            }
-
-            double randReal() {
-                return uniformRealDistribution(mersenneTwisterEngine);
-            }
-
-            double randRealCustom() {
-                return (*customRealDistribution)(mersenneTwisterEngine);
-            }
-
-            int randInt() {
-                return uniformIntegralDistribution(mersenneTwisterEngine);
-            }
-
-            int randIntCustom() {
-                return (*customIntegralDistribution)(mersenneTwisterEngine);
-            }
-
-            void setIntegralCustomRange(int rangeBegin, int rangeEnd) {
-                if (rangeBegin < 0 || rangeEnd < 0) {
-                    return;
-                }
-                customIntegralDistribution = new std::uniform_int_distribution<>(rangeBegin, rangeEnd);
-            }
-
-            void setRealCustomRange(int rangeBegin, int rangeEnd) {
-                if (rangeBegin < 0 || rangeEnd < 0) {
-                    return;
-                }
-                customRealDistribution = new std::uniform_real_distribution<>(rangeBegin, rangeEnd);
-            }
-
-            std::pair<double, double> getRealCustomRange() const {
-                return std::make_pair((*customRealDistribution).min(), (*customRealDistribution).max());
-            }
-
-            std::pair<int, int> getIntegralCustomRange() const {
-                return std::make_pair((*customIntegralDistribution).min(), (*customIntegralDistribution).max());
-            }
-        };
-
-        std::string getTimestamp() {
+        inline std::string getTimestamp() {
             auto timeStamp = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+            #ifdef _MSC_VER
             #pragma warning(disable : 4996)
+            #endif
             auto temp = std::string(std::ctime(&timeStamp));
+            #ifdef _MSC_VER
             #pragma warning(default : 4996)
+            #endif
             temp.erase(std::remove_if(std::begin(temp), std::end(temp),
                                       [](char c){ return c == '\n'; }
                                      )
@@ -3,16 +3,21 @@
 #include "Wheels.hpp"
 #include "_DIBHeader.hpp"
 
+#include <boost/predef/other/endian.h>
+
 #include <tuple>
 
 namespace Smurf {
     struct _BitmapFileHeader {
-        _BitmapFileHeader() : fileSize{sizeof(_BitmapFileHeader) + sizeof(_DIBHeader)},
+        // Sizes as written to the file, the structs themselves leave out the static fields and pick up padding
+        _BitmapFileHeader() : fileSize{headerSize + _DIBHeader::headerSize},
                               reserved1{0},
                               reserved2{0},
-                              offset{sizeof(_BitmapFileHeader) + sizeof(_DIBHeader)} { }
+                              offset{headerSize + _DIBHeader::headerSize} { }
+
+        static const dword headerSize = 14;
 
-        #ifdef BOOST_LITTLE_ENDIAN
+        #if BOOST_ENDIAN_LITTLE_BYTE
             static const word type = Smurf::CompileTime::ConcatScalarTypes<char, 'M', 'B'>::value;
         #else
             static const word type = Smurf::CompileTime::ConcatScalarTypes<char, 'B', 'M'>::value;
@@ -23,13 +28,15 @@ namespace Smurf {
         dword offset;
 
         friend std::ostream& operator<<(std::ostream& os, const _BitmapFileHeader& _bitmapFileHeader) {
-            std::tuple<const word&, dword&, word&, word&, dword&> fields(std::tie(_bitmapFileHeader.type,
+            // Local copy so that the static member isn't odr-used, it has no out-of-class definition
+            const word type = _BitmapFileHeader::type;
+            std::tuple<const word&, dword&, word&, word&, dword&> fields(std::tie(type,
                                                                                   const_cast<dword&>(_bitmapFileHeader.fileSize),
                                                                                   const_cast<word&>(_bitmapFileHeader.reserved1),
                                                                                   const_cast<word&>(_bitmapFileHeader.reserved2),
                                                                                   const_cast<dword&>(_bitmapFileHeader.offset)));
 
-        #ifndef BOOST_LITTLE_ENDIAN
+        #if !BOOST_ENDIAN_LITTLE_BYTE
             Smurf::CompileTime::foreachElemInTuple(fields, Utils::_SwapEndianOutputRefForward());
         #endif
             Smurf::CompileTime::foreachElemInTuple(fields, Utils::_WriteToStreamForward(os));
@@ -2,7 +2,7 @@
 
 #include "Wheels.hpp"
 
-#include <boost/detail/endian.hpp>
+#include <boost/predef/other/endian.h>
 
 #include <tuple>
 
@@ -41,15 +41,18 @@ namespace Smurf {
         dword numImportantColors;
 
         friend std::ostream& operator<<(std::ostream& os, const _DIBHeader& _dibHeader) {
+            // Local copies so that the static members aren't odr-used, they have no out-of-class definitions
+            const dword headerSize = _DIBHeader::headerSize;
+            const word numColorPlanes = _DIBHeader::numColorPlanes;
             std::tuple<const dword&, int32_t&, int32_t&, const word&, word&, dword&, dword&, dword&, dword&, dword&, dword&> fields(
                 std::tie(
-                    _dibHeader.headerSize, const_cast<int32_t&>(_dibHeader.width), const_cast<int32_t&>(_dibHeader.height),
-                    _dibHeader.numColorPlanes, const_cast<word&>(_dibHeader.colorDepth), const_cast<dword&>(_dibHeader.compression),
+                    headerSize, const_cast<int32_t&>(_dibHeader.width), const_cast<int32_t&>(_dibHeader.height),
+                    numColorPlanes, const_cast<word&>(_dibHeader.colorDepth), const_cast<dword&>(_dibHeader.compression),
                     const_cast<dword&>(_dibHeader.imageSize), const_cast<dword&>(_dibHeader.hResPixelPerMeter),
                     const_cast<dword&>(_dibHeader.vResPixelPerMeter), const_cast<dword&>(_dibHeader.numColorsUsed),
                     const_cast<dword&>(_dibHeader.numImportantColors)));
 
-            #ifndef BOOST_LITTLE_ENDIAN
+            #if !BOOST_ENDIAN_LITTLE_BYTE
             Smurf::CompileTime::foreachElemInTuple(fields, Utils::_SwapEndianOutputRefForward());
             #endif
             Smurf::CompileTime::foreachElemInTuple(fields, Utils::_WriteToStreamForward(os));
@@ -0,0 +1,291 @@
+// Throughput benchmark over the sample scenes, or .scene files given by path
+// Every scene is rendered at every resolution and sample count, after warmup renders, a number of times. Results go
+// to stdout as a table and to a JSON file meant to be diffed between builds:
+//     benchmark --scenes gpu0,quasicube --resolutions 320x200,1920x1200 --spp 1,16 --repetitions 5 --json before.json
+// Any other --key value is handed to the render config, e.g. --path tiles or --threads 4. Adaptive sampling is off
+// unless asked for so that every repetition does the same amount of work.
+// With --scene-cache DIR every scene goes through DIR/<scene>.cache, scene files by their name without the directory.
+// The construct time is then the time to load it and the build time is zero from the second run on.
+
+// C++ AMP only exists on MSVC, everywhere else the kernels run on the CPU backend
+#if defined(_MSC_VER) && !defined(SMURF_CPU_BACKEND)
+#define USE_AMP
+#endif
+
+#include "Scene.hpp"
+#include "SampleScenes.hpp"
+#include "RenderConfig.hpp"
+#include "RenderStats.hpp"
+#include "Instrumentation.hpp"
+#include "Simd.hpp"
+#include "Timer.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace Smurf;
+
+namespace {
+    struct BenchmarkOptions {
+        std::vector<std::string> scenes{"quasicube", "spheres", "gpu0", "gpu2", "planes"};
+        std::vector<std::pair<int, int>> resolutions{{320, 200}, {960, 600}};
+        std::vector<int> sampleCounts{1, 16};
+        int warmup = 1;
+        int repetitions = 3;
+        std::string jsonFile = "benchmark.json";
+        RenderConfig config;
+    };
+
+    struct BenchmarkResult {
+        std::string scene;
+        int hRes;
+        int vRes;
+        int numSamples;
+        double constructSeconds;
+        double buildSeconds;
+        std::vector<double> setupSeconds;
+        std::vector<double> traceSeconds;
+        RenderStats stats; // Of the last repetition
+        Instrumentation::Counters counters; // Likewise, all zeros unless built with SMURF_INSTRUMENT
+    };
+
+    std::vector<std::string> split(const std::string& list) {
+        std::vector<std::string> result;
+        std::stringstream stream(list);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            if (!item.empty()) result.push_back(item);
+        }
+        return result;
+    }
+
+    int parsePositive(const std::string& key, const std::string& value) {
+        std::size_t parsed = 0;
+        int result = 0;
+        try {
+            result = std::stoi(value, &parsed);
+        } catch (const std::logic_error&) { }
+        if (parsed == 0 || parsed != value.size() || result < 0) throw std::runtime_error("Expected a count for " + key + ", got: " + value);
+        return result;
+    }
+
+    BenchmarkOptions parseOptions(int argc, char** argv) {
+        BenchmarkOptions options;
+        options.config.adaptive = false;
+        for (int i = 1; i < argc; ++i) {
+            std::string flag = argv[i];
+            if (flag.compare(0, 2, "--") != 0 || i + 1 >= argc) {
+                throw std::runtime_error("Expected --flag value, got: " + flag);
+            }
+            const auto key = flag.substr(2);
+            const std::string value = argv[++i];
+            if (key == "scenes") {
+                options.scenes = split(value);
+            } else if (key == "resolutions") {
+                options.resolutions.clear();
+                for (auto&& resolution : split(value)) {
+                    const auto separator = resolution.find('x');
+                    if (separator == std::string::npos) throw std::runtime_error("Expected WIDTHxHEIGHT, got: " + resolution);
+                    options.resolutions.emplace_back(parsePositive(key, resolution.substr(0, separator)),
+                                                     parsePositive(key, resolution.substr(separator + 1)));
+                }
+            } else if (key == "spp") {
+                options.sampleCounts.clear();
+                for (auto&& count : split(value)) {
+                    options.sampleCounts.push_back(parsePositive(key, count));
+                }
+            } else if (key == "warmup") {
+                options.warmup = parsePositive(key, value);
+            } else if (key == "repetitions") {
+                options.repetitions = std::max(1, parsePositive(key, value));
+            } else if (key == "json") {
+                options.jsonFile = value;
+            } else {
+                options.config.set(key, value);
+            }
+        }
+        return options;
+    }
+
+    // The renderers report progress on stdout, which would drown the results
+    class SilencedOutput {
+    public:
+        SilencedOutput() : buffer{std::cout.rdbuf(nullptr)} { }
+        ~SilencedOutput() {
+            std::cout.rdbuf(buffer);
+            std::cout.clear();
+        }
+    private:
+        std::streambuf* buffer;
+    };
+
+    double median(std::vector<double> values) {
+        std::sort(std::begin(values), std::end(values));
+        const auto middle = values.size() / 2;
+        return values.size() % 2 ? values[middle] : 0.5 * (values[middle - 1] + values[middle]);
+    }
+
+    double perSecond(long long count, double seconds) {
+        return seconds > 0.0 ? count / seconds : 0.0;
+    }
+
+    BenchmarkResult run(const BenchmarkOptions& options, const std::string& sceneName, int hRes, int vRes, int numSamples) {
+        BenchmarkResult result{sceneName, hRes, vRes, numSamples, 0.0, 0.0, {}, {}, {}, Instrumentation::Counters()};
+
+        auto config = options.config;
+        config.scene = sceneName;
+        config.hRes = hRes;
+        config.vRes = vRes;
+        config.numSamples = numSamples;
+        config.validate();
+
+        Timer timer;
+        timer.start();
+        const auto cacheName = sceneName.substr(sceneName.find_last_of("/\\") + 1) + ".cache";
+        auto scene = config.sceneCache.empty() ? Scenes::construct(sceneName)
+                                               : Scenes::constructCached(sceneName, config.sceneCache + "/" + cacheName);
+        timer.end();
+        result.constructSeconds = timer.seconds();
+
+        timer.start();
+        scene->buildAccelerationStructure();
+        timer.end();
+        result.buildSeconds = timer.seconds();
+
+        scene->configure(config);
+        for (int i = 0; i < options.warmup + options.repetitions; ++i) {
+            Instrumentation::reset();
+            {
+                SilencedOutput silence;
+                scene->render();
+            }
+            if (i < options.warmup) continue;
+            result.stats = scene->getLastStats();
+            result.counters = Instrumentation::merged();
+            result.setupSeconds.push_back(result.stats.setupSeconds);
+            result.traceSeconds.push_back(result.stats.traceSeconds);
+        }
+        return result;
+    }
+
+    void writeSeconds(std::ostream& os, const std::vector<double>& seconds) {
+        os << "{\"min\": " << *std::min_element(std::begin(seconds), std::end(seconds))
+           << ", \"median\": " << median(seconds)
+           << ", \"max\": " << *std::max_element(std::begin(seconds), std::end(seconds)) << "}";
+    }
+
+    #ifdef SMURF_INSTRUMENTED
+    void writeCounters(std::ostream& os, const Instrumentation::Counters& counters) {
+        const char* primitiveNames[] = {"spheres", "planes", "rectangles", "triangles"};
+        os << "{\"intersectionTests\": {";
+        for (int type = 0; type < Instrumentation::NumPrimitiveTypes; ++type) {
+            os << (type ? ", " : "") << "\"" << primitiveNames[type] << "\": " << counters.intersectionTests[type];
+        }
+        os << "}, \"intersectionHits\": {";
+        for (int type = 0; type < Instrumentation::NumPrimitiveTypes; ++type) {
+            os << (type ? ", " : "") << "\"" << primitiveNames[type] << "\": " << counters.intersectionHits[type];
+        }
+        long long shadowRays = 0;
+        long long shadowOccluded = 0;
+        for (int type = 0; type < Instrumentation::NumLightTypes; ++type) {
+            for (int slot = 0; slot < Instrumentation::MaxCountedLights; ++slot) {
+                shadowRays += counters.shadowRays[type][slot];
+                shadowOccluded += counters.shadowOccluded[type][slot];
+            }
+        }
+        os << "}, \"bvhLeaves\": " << counters.bvhLeaves << ", \"shadowBvhLeaves\": " << counters.shadowBvhLeaves
+           << ", \"shadowRays\": " << shadowRays << ", \"shadowOccluded\": " << shadowOccluded
+           << ", \"lightsFacingAway\": " << counters.lightsFacingAway
+           << ", \"occluderCacheHits\": " << counters.occluderCacheHits
+           << ", \"matteDispatches\": " << counters.materialDispatches[ActiveMaterial::ActiveMatte]
+           << ", \"glossyDispatches\": " << counters.materialDispatches[ActiveMaterial::ActiveGlossy]
+           << ", \"reflectiveDispatches\": " << counters.materialDispatches[ActiveMaterial::ActiveReflective]
+           << ", \"transparentDispatches\": " << counters.materialDispatches[ActiveMaterial::ActiveTransparent] << "}";
+    }
+    #endif
+
+    void writeJson(std::ostream& os, const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results) {
+        os << std::setprecision(9);
+        os << "{\n"
+           << "  \"build\": {\"backend\": \"" << Backend::name() << "\", "
+           << "\"instructionSet\": \"" << Simd::name(Simd::detectInstructionSet()) << "\", "
+           << "\"precision\": \"" << (sizeof(Real) == sizeof(float) ? "single" : "double") << "\"},\n"
+           << "  \"settings\": {\"path\": \"" << name(options.config.path) << "\", "
+           << "\"sampler\": \"" << name(options.config.pattern) << "\", "
+           << "\"threads\": " << Utils::ThreadPool::instance().size() << ", "
+           << "\"adaptive\": " << (options.config.adaptive ? "true" : "false") << ", "
+           << "\"warmup\": " << options.warmup << ", "
+           << "\"repetitions\": " << options.repetitions << "},\n"
+           << "  \"results\": [\n";
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            const auto& result = results[i];
+            const auto traceSeconds = median(result.traceSeconds);
+            os << "    {\"scene\": \"" << result.scene << "\", "
+               << "\"width\": " << result.hRes << ", \"height\": " << result.vRes << ", \"spp\": " << result.numSamples << ",\n"
+               << "     \"seconds\": {\"construct\": " << result.constructSeconds << ", \"build\": " << result.buildSeconds << ", "
+               << "\"setup\": ";
+            writeSeconds(os, result.setupSeconds);
+            os << ", \"trace\": ";
+            writeSeconds(os, result.traceSeconds);
+            os << "},\n"
+               << "     \"counts\": {\"samples\": " << result.stats.samples << ", \"primaryRays\": " << result.stats.primaryRays
+               << ", \"secondaryRays\": " << result.stats.secondaryRays << ", \"shadowRays\": " << result.stats.shadowRays << "},\n"
+               << "     \"perSecond\": {\"samples\": " << perSecond(result.stats.samples, traceSeconds)
+               << ", \"primaryRays\": " << perSecond(result.stats.primaryRays, traceSeconds)
+               << ", \"secondaryRays\": " << perSecond(result.stats.secondaryRays, traceSeconds)
+               << ", \"shadowRays\": " << perSecond(result.stats.shadowRays, traceSeconds) << "}";
+            #ifdef SMURF_INSTRUMENTED
+            os << ",\n     \"counters\": ";
+            writeCounters(os, result.counters);
+            #endif
+            os << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        os << "  ]\n}\n";
+    }
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        const auto options = parseOptions(argc, argv);
+        Utils::ThreadPool::configureInstance(options.config.numThreads);
+
+        std::cout << "Benchmarking the " << name(options.config.path) << " path on "
+                  << Utils::ThreadPool::instance().size() << " threads, median of " << options.repetitions << "\n"
+                  << std::left << std::setw(12) << "scene" << std::setw(12) << "resolution" << std::setw(6) << "spp"
+                  << std::setw(12) << "trace [s]" << std::setw(16) << "Mprimary/s" << std::setw(16) << "Mshadow/s" << std::endl;
+
+        std::vector<BenchmarkResult> results;
+        for (auto&& scene : options.scenes) {
+            for (auto&& resolution : options.resolutions) {
+                for (auto numSamples : options.sampleCounts) {
+                    results.push_back(run(options, scene, resolution.first, resolution.second, numSamples));
+                    const auto& result = results.back();
+                    const auto traceSeconds = median(result.traceSeconds);
+                    std::cout << std::setw(12) << scene
+                              << std::setw(12) << (std::to_string(result.hRes) + "x" + std::to_string(result.vRes))
+                              << std::setw(6) << numSamples
+                              << std::setw(12) << traceSeconds
+                              << std::setw(16) << perSecond(result.stats.primaryRays, traceSeconds) / 1e6
+                              << std::setw(16) << perSecond(result.stats.shadowRays, traceSeconds) / 1e6 << std::endl;
+                }
+            }
+        }
+
+        std::ofstream json(options.jsonFile);
+        if (!json) throw std::runtime_error("Cannot open " + options.jsonFile);
+        writeJson(json, options, results);
+        std::cout << "Results written to " << options.jsonFile << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
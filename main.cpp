@@ -1,22 +1,54 @@
+// C++ AMP only exists on MSVC, everywhere else the kernels run on the CPU backend
+#if defined(_MSC_VER) && !defined(SMURF_CPU_BACKEND)
 #define USE_AMP
+#endif
 
 #include "Scene.hpp"
 #include "SampleScenes.hpp"
+#include "Batch.hpp"
 #include "ComputerInfo.hpp"
 
 #include <iosfwd>
+#include <iostream>
+#include <cstdlib>
+#include <exception>
 
-const enum Extensions { bmp };
+enum Extensions { bmp };
 const char* extensions[] = {".bmp"};
 
 using namespace Smurf;
 using namespace Smurf::Utils;
 
-int main() {
-    printPCInfo(std::wcout);
-    printRayTraceInfo(std::wcout);
-    auto scene = Scenes::constructSceneGPU0();
-    //scene->renderScene(scene->rayTraceScene());
-    scene->renderScene(scene->rayTraceSceneGPU());
+int main(int argc, char** argv) {
+    try {
+        const auto config = RenderConfig::fromCommandLine(argc, argv);
+        ThreadPool::configureInstance(config.numThreads);
+
+        printPCInfo(std::cout);
+        printRayTraceInfo(std::cout, config);
+        auto scene = config.sceneCache.empty() ? Scenes::construct(config.scene) : Scenes::constructCached(config.scene, config.sceneCache);
+        scene->configure(config);
+        // A batch runs unattended, it neither writes the single frame's heatmap nor waits for a key press at the end
+        if (!config.batch.empty()) {
+            Batch::render(*scene, Batch::loadJobs(config.batch, config, scene->getCamera()), std::cout);
+            #ifdef SMURF_INSTRUMENTED
+            Instrumentation::print(std::cout, Instrumentation::merged());
+            #endif
+            return EXIT_SUCCESS;
+        }
+        scene->renderToFile(getTimestamp() + ".bmp");
+        #ifdef SMURF_INSTRUMENTED
+        Instrumentation::print(std::cout, Instrumentation::merged());
+        const auto& tileSeconds = scene->getLastStats().tileSeconds;
+        if (!tileSeconds.empty()) {
+            Instrumentation::writeHeatmap(getTimestamp() + "_cost.bmp", config.hRes, config.vRes, config.tileSize, tileSeconds);
+        }
+        #endif
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    #ifdef _WIN32
     system("PAUSE");
+    #endif
 }
\ No newline at end of file